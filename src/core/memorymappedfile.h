@@ -1,52 +1,210 @@
 #ifndef MEMORYMAPPEDFILE_H
 #define MEMORYMAPPEDFILE_H
 
+#include <stdint.h>
+#include <stdexcept>
+#include <string>
+
 #ifdef WIN32
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #endif
 
+/*
+ * Read-only mapping of a file, or of a sub-range of it. Pages are only
+ * read in when touched, so large files can be mapped up-front and paged
+ * in on demand; prefetch() kicks off read-ahead for a range without
+ * waiting for it.
+ */
 class MemoryMappedFile
 {
 public:
-	explicit MemoryMappedFile(const std::string &path)
-	{
-		WIN32_FILE_ATTRIBUTE_DATA attr;
-		if (!GetFileAttributesEx(path.c_str(), GetFileExInfoStandard, &attr))
-			throw std::runtime_error("failed to get file attributes");
-		size = attr.nFileSizeLow;
+	enum class AccessPattern {
+		NORMAL,
+		SEQUENTIAL,
+		RANDOM
+	};
 
-		if (attr.nFileSizeHigh != 0)
-			throw std::runtime_error("too large file");
+	static const uint64_t WHOLE_FILE = UINT64_MAX;
 
-		hfile = CreateFile(path.c_str(), GENERIC_READ, 0, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	explicit MemoryMappedFile(const std::string &path, uint64_t offset = 0, uint64_t length = WHOLE_FILE, AccessPattern accessPattern = AccessPattern::NORMAL) :
+		mapping(nullptr),
+		mappingSize(0),
+		data(nullptr),
+		size(0)
+	{
+#ifdef WIN32
+		DWORD flags = FILE_ATTRIBUTE_NORMAL;
+		if (accessPattern == AccessPattern::SEQUENTIAL)
+			flags |= FILE_FLAG_SEQUENTIAL_SCAN;
+		else if (accessPattern == AccessPattern::RANDOM)
+			flags |= FILE_FLAG_RANDOM_ACCESS;
+
+		hfile = CreateFile(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, flags, nullptr);
 		if (INVALID_HANDLE_VALUE == hfile)
 			throw std::runtime_error("failed to open file for reading");
 
+		LARGE_INTEGER fileSizeLarge;
+		if (!GetFileSizeEx(hfile, &fileSizeLarge)) {
+			CloseHandle(hfile);
+			throw std::runtime_error("failed to get file size");
+		}
+		fileSize = uint64_t(fileSizeLarge.QuadPart);
+		hmap = nullptr;
+#else
+		fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+			throw std::runtime_error("failed to open file for reading");
+
+		struct stat st;
+		if (fstat(fd, &st) != 0) {
+			close(fd);
+			throw std::runtime_error("failed to get file size");
+		}
+		fileSize = uint64_t(st.st_size);
+#endif
+
+		try {
+			map(offset, length, accessPattern);
+		} catch (...) {
+			unmap();
+			throw;
+		}
+	}
+
+	~MemoryMappedFile()
+	{
+		unmap();
+	}
+
+	MemoryMappedFile(const MemoryMappedFile &) = delete;
+	MemoryMappedFile &operator=(const MemoryMappedFile &) = delete;
+
+	// start read-ahead for [offset, offset + length) of the mapped range, without blocking
+	void prefetch(size_t offset = 0, size_t length = SIZE_MAX) const
+	{
+		if (offset >= size)
+			return;
+		if (length > size - offset)
+			length = size - offset;
+
+		auto begin = static_cast<const uint8_t *>(data) + offset;
+		auto pageOffset = uintptr_t(begin) % pageSize();
+		begin -= pageOffset;
+		length += pageOffset;
+
+#ifdef WIN32
+#if _WIN32_WINNT >= 0x0602
+		WIN32_MEMORY_RANGE_ENTRY range;
+		range.VirtualAddress = const_cast<uint8_t *>(begin);
+		range.NumberOfBytes = length;
+		PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#endif
+#else
+		// only a hint; failing is harmless
+		madvise(const_cast<uint8_t *>(begin), length, MADV_WILLNEED);
+#endif
+	}
+
+	const void *getData() const { return data; }
+	size_t getSize() const { return size; }
+	uint64_t getFileSize() const { return fileSize; }
+
+private:
+	void map(uint64_t offset, uint64_t length, AccessPattern accessPattern)
+	{
+		if (offset > fileSize)
+			throw std::runtime_error("mapping offset past end of file");
+		if (length > fileSize - offset)
+			length = fileSize - offset;
+		if (length > SIZE_MAX)
+			throw std::runtime_error("too large file");
+
+		size = size_t(length);
+		if (size == 0)
+			return; // nothing to map, and zero-sized mappings are an error
+
+		// the view has to start on an allocation-granularity boundary
+		auto mappingOffset = offset - offset % allocationGranularity();
+		mappingSize = size_t(offset - mappingOffset) + size;
+
+#ifdef WIN32
 		hmap = CreateFileMapping(hfile, 0, PAGE_READONLY, 0, 0, nullptr);
 		if (!hmap)
 			throw std::runtime_error("failed to create file mapping");
 
-		data = MapViewOfFile(hmap, FILE_MAP_READ, 0, 0, 0);
-		if (!data)
+		mapping = MapViewOfFile(hmap, FILE_MAP_READ, DWORD(mappingOffset >> 32), DWORD(mappingOffset), mappingSize);
+		if (!mapping)
 			throw std::runtime_error("failed to map view of file");
+#else
+		mapping = mmap(nullptr, mappingSize, PROT_READ, MAP_PRIVATE, fd, off_t(mappingOffset));
+		if (mapping == MAP_FAILED) {
+			mapping = nullptr;
+			throw std::runtime_error("failed to map file");
+		}
+
+		if (accessPattern == AccessPattern::SEQUENTIAL)
+			madvise(mapping, mappingSize, MADV_SEQUENTIAL);
+		else if (accessPattern == AccessPattern::RANDOM)
+			madvise(mapping, mappingSize, MADV_RANDOM);
+#endif
+
+		data = static_cast<uint8_t *>(mapping) + (offset - mappingOffset);
 	}
 
-	~MemoryMappedFile()
+	void unmap()
 	{
-		UnmapViewOfFile(data);
-		CloseHandle(hmap);
+#ifdef WIN32
+		if (mapping)
+			UnmapViewOfFile(mapping);
+		if (hmap)
+			CloseHandle(hmap);
 		CloseHandle(hfile);
+#else
+		if (mapping)
+			munmap(mapping, mappingSize);
+		close(fd);
+#endif
 	}
 
-	const void *getData() const { return data; }
-	size_t getSize() const { return size; }
+	static size_t pageSize()
+	{
+#ifdef WIN32
+		SYSTEM_INFO systemInfo;
+		GetSystemInfo(&systemInfo);
+		return systemInfo.dwPageSize;
+#else
+		return size_t(sysconf(_SC_PAGESIZE));
+#endif
+	}
 
-private:
+	static uint64_t allocationGranularity()
+	{
+#ifdef WIN32
+		SYSTEM_INFO systemInfo;
+		GetSystemInfo(&systemInfo);
+		return systemInfo.dwAllocationGranularity;
+#else
+		return pageSize();
+#endif
+	}
+
+#ifdef WIN32
 	HANDLE hfile;
 	HANDLE hmap;
-	void *data;
+#else
+	int fd;
+#endif
+	void *mapping;
+	size_t mappingSize;
+	const void *data;
 	size_t size;
+	uint64_t fileSize;
 };
 
 #endif // MEMORYMAPPEDFILE_H
@@ -0,0 +1,123 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * A fixed set of worker threads, draining a FIFO of tasks. By default,
+ * one thread per core, minus the one that's rendering.
+ */
+class ThreadPool {
+public:
+	explicit ThreadPool(unsigned threadCount = defaultThreadCount()) :
+		stopping(false)
+	{
+		for (unsigned i = 0; i < std::max(threadCount, 1u); ++i)
+			threads.emplace_back([this] { workerMain(); });
+	}
+
+	// runs whatever is still queued, then joins the workers
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		condition.notify_all();
+
+		for (auto &thread : threads)
+			thread.join();
+	}
+
+	ThreadPool(const ThreadPool &) = delete;
+	ThreadPool &operator=(const ThreadPool &) = delete;
+
+	template <typename F>
+	auto enqueue(F &&f) -> std::future<decltype(f())>
+	{
+		// std::function wants something copyable, so share the task
+		auto task = std::make_shared<std::packaged_task<decltype(f())()>>(std::forward<F>(f));
+		auto future = task->get_future();
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			tasks.push_back([task] { (*task)(); });
+		}
+		condition.notify_one();
+
+		return future;
+	}
+
+	/*
+	 * Waits for a future, running queued tasks in the meantime. Tasks
+	 * that wait on tasks they've enqueued themselves must use this, or
+	 * they could tie up every worker while their work sits in the queue.
+	 */
+	template <typename T>
+	void wait(const std::future<T> &future)
+	{
+		while (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+			// with nothing left to help with, whatever we wait for is already running
+			if (!runPendingTask())
+				future.wait();
+		}
+	}
+
+	size_t getThreadCount() const { return threads.size(); }
+
+	static unsigned defaultThreadCount()
+	{
+		auto cores = std::thread::hardware_concurrency();
+		return cores > 1 ? cores - 1 : 1;
+	}
+
+private:
+	bool runPendingTask()
+	{
+		std::function<void()> task;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (tasks.empty())
+				return false;
+
+			task = std::move(tasks.front());
+			tasks.pop_front();
+		}
+		task();
+		return true;
+	}
+
+	void workerMain()
+	{
+		for (;;) {
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				condition.wait(lock, [this] { return stopping || !tasks.empty(); });
+				if (tasks.empty())
+					return;
+
+				task = std::move(tasks.front());
+				tasks.pop_front();
+			}
+			task();
+		}
+	}
+
+	std::vector<std::thread> threads;
+	std::deque<std::function<void()>> tasks;
+	std::mutex mutex;
+	std::condition_variable condition;
+	bool stopping;
+};
+
+#endif // THREADPOOL_H
@@ -0,0 +1,222 @@
+#include "descriptorallocator.h"
+
+#include <stdexcept>
+
+using namespace vulkan;
+
+using std::vector;
+using std::runtime_error;
+
+// roughly what a set needs on average; a pool that runs dry just means another pool, but only these types can be allocated
+static const struct {
+	VkDescriptorType type;
+	float perSet;
+} poolRatios[] = {
+	{ VK_DESCRIPTOR_TYPE_SAMPLER, 0.5f },
+	{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2.0f },
+	{ VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 2.0f },
+	{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1.0f },
+	{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1.0f },
+	{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1.0f },
+	{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1.0f },
+	{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1.0f },
+};
+
+DescriptorAllocator::DescriptorAllocator(uint32_t setsPerPool) :
+	setsPerPool(setsPerPool),
+	currentPool(0)
+{
+	pools.push_back(createPool());
+	beginPool(0);
+}
+
+DescriptorAllocator::~DescriptorAllocator()
+{
+	for (auto pool : pools)
+		vkDestroyDescriptorPool(device, pool, nullptr);
+}
+
+static uint32_t getPoolDescriptorCount(size_t ratio, uint32_t setsPerPool)
+{
+	return std::max(uint32_t(poolRatios[ratio].perSet * setsPerPool), 1u);
+}
+
+VkDescriptorPool DescriptorAllocator::createPool()
+{
+	vector<VkDescriptorPoolSize> poolSizes;
+	for (size_t i = 0; i < ARRAY_SIZE(poolRatios); ++i)
+		poolSizes.push_back({ poolRatios[i].type, getPoolDescriptorCount(i, setsPerPool) });
+
+	return createDescriptorPool(poolSizes, setsPerPool);
+}
+
+void DescriptorAllocator::beginPool(size_t pool)
+{
+	currentPool = pool;
+	setsLeft = setsPerPool;
+	descriptorsLeft.resize(ARRAY_SIZE(poolRatios));
+	for (size_t i = 0; i < ARRAY_SIZE(poolRatios); ++i)
+		descriptorsLeft[i] = getPoolDescriptorCount(i, setsPerPool);
+}
+
+VkDescriptorSet DescriptorAllocator::allocate(const ShaderProgram &shaderProgram)
+{
+	uint32_t descriptorsNeeded[ARRAY_SIZE(poolRatios)] = {};
+	for (auto &descriptor : shaderProgram.getDescriptors()) {
+		auto binding = descriptor.getBinding();
+
+		size_t ratio = 0;
+		while (ratio < ARRAY_SIZE(poolRatios) && poolRatios[ratio].type != binding.descriptorType)
+			++ratio;
+		if (ratio == ARRAY_SIZE(poolRatios))
+			throw runtime_error("descriptor type not supported by the descriptor allocator!");
+
+		descriptorsNeeded[ratio] += binding.descriptorCount;
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(poolRatios); ++i)
+		if (descriptorsNeeded[i] > getPoolDescriptorCount(i, setsPerPool))
+			throw runtime_error("descriptor set doesn't fit in an empty pool!");
+
+	auto fits = [&]() {
+		if (setsLeft == 0)
+			return false;
+		for (size_t i = 0; i < ARRAY_SIZE(poolRatios); ++i)
+			if (descriptorsNeeded[i] > descriptorsLeft[i])
+				return false;
+		return true;
+	};
+
+	// on to the next pool, which reset() left empty, or a new one
+	if (!fits()) {
+		if (currentPool + 1 == pools.size())
+			pools.push_back(createPool());
+		beginPool(currentPool + 1);
+	}
+
+	VkDescriptorSetAllocateInfo descriptorSetAllocateInfo = {};
+	descriptorSetAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	descriptorSetAllocateInfo.descriptorPool = pools[currentPool];
+	descriptorSetAllocateInfo.descriptorSetCount = 1;
+	auto descriptorSetLayout = shaderProgram.getDescriptorSetLayout();
+	descriptorSetAllocateInfo.pSetLayouts = &descriptorSetLayout;
+
+	// the counts keep the pool from running dry, and sets are never freed one by one, so it can't fragment either
+	VkDescriptorSet descriptorSet;
+	auto err = vkAllocateDescriptorSets(device, &descriptorSetAllocateInfo, &descriptorSet);
+	if (err != VK_SUCCESS)
+		throw runtime_error("vkAllocateDescriptorSets failed!");
+
+	--setsLeft;
+	for (size_t i = 0; i < ARRAY_SIZE(poolRatios); ++i)
+		descriptorsLeft[i] -= descriptorsNeeded[i];
+
+	return descriptorSet;
+}
+
+void DescriptorAllocator::reset()
+{
+	for (size_t i = 0; i <= currentPool; ++i) {
+		auto err = vkResetDescriptorPool(device, pools[i], 0);
+		assert(err == VK_SUCCESS);
+	}
+	beginPool(0);
+}
+
+static_assert(sizeof(DescriptorInfo) == sizeof(VkDescriptorImageInfo) && sizeof(DescriptorInfo) == sizeof(VkDescriptorBufferInfo),
+              "image and buffer infos must be able to alias an array of DescriptorInfo");
+
+DescriptorUpdateTemplate::DescriptorUpdateTemplate(const ShaderProgram &shaderProgram) :
+	descriptorCount(0),
+	descriptorUpdateTemplate(VK_NULL_HANDLE)
+{
+	for (auto &descriptor : shaderProgram.getDescriptors()) {
+		auto binding = descriptor.getBinding();
+
+		VkDescriptorUpdateTemplateEntryKHR entry = {};
+		entry.dstBinding = binding.binding;
+		entry.dstArrayElement = 0;
+		entry.descriptorCount = binding.descriptorCount;
+		entry.descriptorType = binding.descriptorType;
+		entry.offset = descriptorCount * sizeof(DescriptorInfo);
+		entry.stride = sizeof(DescriptorInfo);
+		entries.push_back(entry);
+
+		descriptorCount += binding.descriptorCount;
+	}
+
+	if (deviceFuncs.vkCreateDescriptorUpdateTemplateKHR != nullptr) {
+		VkDescriptorUpdateTemplateCreateInfoKHR descriptorUpdateTemplateCreateInfo = {};
+		descriptorUpdateTemplateCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO_KHR;
+		descriptorUpdateTemplateCreateInfo.descriptorUpdateEntryCount = uint32_t(entries.size());
+		descriptorUpdateTemplateCreateInfo.pDescriptorUpdateEntries = entries.data();
+		descriptorUpdateTemplateCreateInfo.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET_KHR;
+		descriptorUpdateTemplateCreateInfo.descriptorSetLayout = shaderProgram.getDescriptorSetLayout();
+
+		auto err = deviceFuncs.vkCreateDescriptorUpdateTemplateKHR(device, &descriptorUpdateTemplateCreateInfo, nullptr, &descriptorUpdateTemplate);
+		assert(err == VK_SUCCESS);
+	}
+}
+
+DescriptorUpdateTemplate::~DescriptorUpdateTemplate()
+{
+	if (descriptorUpdateTemplate != VK_NULL_HANDLE)
+		deviceFuncs.vkDestroyDescriptorUpdateTemplateKHR(device, descriptorUpdateTemplate, nullptr);
+}
+
+void DescriptorUpdateTemplate::update(VkDescriptorSet descriptorSet, const vector<DescriptorInfo> &descriptorInfos) const
+{
+	assert(descriptorInfos.size() == descriptorCount);
+
+	if (descriptorUpdateTemplate != VK_NULL_HANDLE) {
+		deviceFuncs.vkUpdateDescriptorSetWithTemplateKHR(device, descriptorSet, descriptorUpdateTemplate, descriptorInfos.data());
+		return;
+	}
+
+	// texel buffer views are smaller than a DescriptorInfo, so they need to be packed
+	vector<VkBufferView> texelBufferViews(descriptorInfos.size());
+	vector<VkWriteDescriptorSet> writeDescriptorSets;
+	writeDescriptorSets.reserve(entries.size());
+	for (auto &entry : entries) {
+		auto first = entry.offset / sizeof(DescriptorInfo);
+
+		VkWriteDescriptorSet writeDescriptorSet = {};
+		writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writeDescriptorSet.dstSet = descriptorSet;
+		writeDescriptorSet.dstBinding = entry.dstBinding;
+		writeDescriptorSet.dstArrayElement = entry.dstArrayElement;
+		writeDescriptorSet.descriptorCount = entry.descriptorCount;
+		writeDescriptorSet.descriptorType = entry.descriptorType;
+
+		switch (entry.descriptorType) {
+		case VK_DESCRIPTOR_TYPE_SAMPLER:
+		case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
+		case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
+		case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
+		case VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT:
+			writeDescriptorSet.pImageInfo = &descriptorInfos[first].image;
+			break;
+
+		case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+		case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+		case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC:
+		case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC:
+			writeDescriptorSet.pBufferInfo = &descriptorInfos[first].buffer;
+			break;
+
+		case VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER:
+		case VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER:
+			for (size_t i = 0; i < entry.descriptorCount; ++i)
+				texelBufferViews[first + i] = descriptorInfos[first + i].texelBufferView;
+			writeDescriptorSet.pTexelBufferView = &texelBufferViews[first];
+			break;
+
+		default:
+			unreachable("unexpected descriptor type");
+		}
+
+		writeDescriptorSets.push_back(writeDescriptorSet);
+	}
+
+	vkUpdateDescriptorSets(device, uint32_t(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
+}
@@ -0,0 +1,83 @@
+#ifndef DESCRIPTORALLOCATOR_H
+#define DESCRIPTORALLOCATOR_H
+
+#include "vulkan.h"
+#include "shader.h"
+
+#include <vector>
+
+/*
+ * Hands out descriptor sets that live until the next reset(), from a
+ * growing list of pools. reset() recycles them all at once with
+ * vkResetDescriptorPool, so there's no per-set freeing, and no pool
+ * sized for exactly one use. FrameContext owns one per frame in flight.
+ *
+ * Vulkan 1.0 without VK_KHR_maintenance1 doesn't report a full pool,
+ * so the sets and descriptors left in the current pool are counted,
+ * and allocation moves on to the next pool before it runs out.
+ */
+class DescriptorAllocator {
+public:
+	explicit DescriptorAllocator(uint32_t setsPerPool = 64);
+	~DescriptorAllocator();
+
+	DescriptorAllocator(const DescriptorAllocator &) = delete;
+	DescriptorAllocator &operator=(const DescriptorAllocator &) = delete;
+
+	VkDescriptorSet allocate(const ShaderProgram &shaderProgram);
+
+	// every set allocated so far must be out of use
+	void reset();
+
+private:
+	VkDescriptorPool createPool();
+	void beginPool(size_t pool);
+
+	uint32_t setsPerPool;
+	std::vector<VkDescriptorPool> pools; // the last one is the one we allocate from
+	size_t currentPool;
+
+	// what's left in the current pool; descriptorsLeft follows poolRatios
+	uint32_t setsLeft;
+	std::vector<uint32_t> descriptorsLeft;
+};
+
+/*
+ * What goes into one array element of a descriptor; which member is used
+ * depends on the descriptor type.
+ */
+union DescriptorInfo {
+	DescriptorInfo(const VkDescriptorImageInfo &image) : image(image) {}
+	DescriptorInfo(const VkDescriptorBufferInfo &buffer) : buffer(buffer) {}
+	DescriptorInfo(VkBufferView texelBufferView) : texelBufferView(texelBufferView) {}
+
+	VkDescriptorImageInfo image;
+	VkDescriptorBufferInfo buffer;
+	VkBufferView texelBufferView;
+};
+
+/*
+ * Writes a whole set for a ShaderProgram in one call, from an array with
+ * one DescriptorInfo per descriptor-element, in the order of the
+ * program's ShaderDescriptors.
+ *
+ * Uses VK_KHR_descriptor_update_template when it's enabled, and the
+ * equivalent vkUpdateDescriptorSets call otherwise.
+ */
+class DescriptorUpdateTemplate {
+public:
+	explicit DescriptorUpdateTemplate(const ShaderProgram &shaderProgram);
+	~DescriptorUpdateTemplate();
+
+	DescriptorUpdateTemplate(const DescriptorUpdateTemplate &) = delete;
+	DescriptorUpdateTemplate &operator=(const DescriptorUpdateTemplate &) = delete;
+
+	void update(VkDescriptorSet descriptorSet, const std::vector<DescriptorInfo> &descriptorInfos) const;
+
+private:
+	std::vector<VkDescriptorUpdateTemplateEntryKHR> entries;
+	size_t descriptorCount;
+	VkDescriptorUpdateTemplateKHR descriptorUpdateTemplate;
+};
+
+#endif // DESCRIPTORALLOCATOR_H
@@ -0,0 +1,73 @@
+#include "framecontext.h"
+
+using namespace vulkan;
+
+FrameContext::FrameContext(VkDeviceSize ringBufferSize, bool asyncCompute) :
+	computeCommandPool(VK_NULL_HANDLE),
+	computeCommandBuffer(VK_NULL_HANDLE),
+	presentCommandBuffer(VK_NULL_HANDLE),
+	renderCompleteSemaphore(VK_NULL_HANDLE),
+	postProcessCompleteSemaphore(VK_NULL_HANDLE),
+	ringBuffer(ringBufferSize)
+{
+	commandPool = createCommandPool(graphicsQueueIndex);
+
+	auto commandBuffers = allocateCommandBuffers(commandPool, asyncCompute ? 2 : 1);
+	commandBuffer = commandBuffers[0];
+	if (asyncCompute)
+		presentCommandBuffer = commandBuffers[1];
+	delete[] commandBuffers;
+
+	if (asyncCompute) {
+		computeCommandPool = createCommandPool(computeQueueIndex);
+
+		commandBuffers = allocateCommandBuffers(computeCommandPool, 1);
+		computeCommandBuffer = commandBuffers[0];
+		delete[] commandBuffers;
+
+		renderCompleteSemaphore = createSemaphore();
+		postProcessCompleteSemaphore = createSemaphore();
+	}
+
+	// signaled, so the first begin() doesn't block
+	fence = createFence(VK_FENCE_CREATE_SIGNALED_BIT);
+	imageAvailableSemaphore = createSemaphore();
+	presentReadySemaphore = createSemaphore();
+}
+
+FrameContext::~FrameContext()
+{
+	vkDestroySemaphore(device, imageAvailableSemaphore, nullptr);
+	vkDestroySemaphore(device, presentReadySemaphore, nullptr);
+	if (renderCompleteSemaphore != VK_NULL_HANDLE)
+		vkDestroySemaphore(device, renderCompleteSemaphore, nullptr);
+	if (postProcessCompleteSemaphore != VK_NULL_HANDLE)
+		vkDestroySemaphore(device, postProcessCompleteSemaphore, nullptr);
+
+	vkDestroyFence(device, fence, nullptr);
+
+	vkDestroyCommandPool(device, commandPool, nullptr);
+	if (computeCommandPool != VK_NULL_HANDLE)
+		vkDestroyCommandPool(device, computeCommandPool, nullptr);
+}
+
+void FrameContext::begin()
+{
+	VkResult err = vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX);
+	assert(err == VK_SUCCESS);
+
+	ringBuffer.beginFrame(fence);
+	descriptorAllocator.reset();
+
+	err = vkResetFences(device, 1, &fence);
+	assert(err == VK_SUCCESS);
+
+	// cheaper than resetting the command buffers one by one
+	err = vkResetCommandPool(device, commandPool, 0);
+	assert(err == VK_SUCCESS);
+
+	if (computeCommandPool != VK_NULL_HANDLE) {
+		err = vkResetCommandPool(device, computeCommandPool, 0);
+		assert(err == VK_SUCCESS);
+	}
+}
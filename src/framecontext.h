@@ -0,0 +1,59 @@
+#ifndef FRAMECONTEXT_H
+#define FRAMECONTEXT_H
+
+#include "vulkan.h"
+#include "descriptorallocator.h"
+#include "scene/ringbuffer.h"
+
+/*
+ * Everything a frame needs while it's being recorded and executed. The
+ * renderer cycles through a fixed number of these, independently of how
+ * many images the swap-chain has, so the CPU can record one frame while
+ * the GPU is still busy with the previous ones.
+ */
+class FrameContext {
+public:
+	FrameContext(VkDeviceSize ringBufferSize, bool asyncCompute);
+	~FrameContext();
+
+	FrameContext(const FrameContext &) = delete;
+	FrameContext &operator=(const FrameContext &) = delete;
+
+	/*
+	 * Waits for the GPU to finish the last frame that used this context,
+	 * then recycles its command buffers, descriptor sets and transient
+	 * memory. The frame's final submit must signal getFence().
+	 */
+	void begin();
+
+	VkCommandBuffer getCommandBuffer() const { return commandBuffer; }
+
+	// only with async compute
+	VkCommandBuffer getComputeCommandBuffer() const { return computeCommandBuffer; }
+	VkCommandBuffer getPresentCommandBuffer() const { return presentCommandBuffer; }
+
+	VkFence getFence() const { return fence; }
+
+	VkSemaphore getImageAvailableSemaphore() const { return imageAvailableSemaphore; }
+	VkSemaphore getPresentReadySemaphore() const { return presentReadySemaphore; }
+
+	// only with async compute
+	VkSemaphore getRenderCompleteSemaphore() const { return renderCompleteSemaphore; }
+	VkSemaphore getPostProcessCompleteSemaphore() const { return postProcessCompleteSemaphore; }
+
+	RingBuffer &getRingBuffer() { return ringBuffer; }
+	DescriptorAllocator &getDescriptorAllocator() { return descriptorAllocator; }
+
+private:
+	VkCommandPool commandPool, computeCommandPool;
+	VkCommandBuffer commandBuffer, computeCommandBuffer, presentCommandBuffer;
+
+	VkFence fence;
+	VkSemaphore imageAvailableSemaphore, presentReadySemaphore;
+	VkSemaphore renderCompleteSemaphore, postProcessCompleteSemaphore;
+
+	RingBuffer ringBuffer;
+	DescriptorAllocator descriptorAllocator;
+};
+
+#endif // FRAMECONTEXT_H
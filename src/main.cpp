@@ -6,16 +6,33 @@
 
 #define _USE_MATH_DEFINES
 #include <cmath>
+#include <cstdlib>
+#include <cstring>
 #include <algorithm>
+#include <chrono>
 #include <list>
-#include <map>
+#include <memory>
 #include <stdexcept>
 
+#include <sys/stat.h>
+
 #include "vulkan.h"
+#include "memoryallocator.h"
+#include "pipeline.h"
+#include "pipelinecache.h"
 #include "core/core.h"
 #include "swapchain.h"
+#include "descriptorallocator.h"
+#include "framecontext.h"
+#include "profiler.h"
 #include "shader.h"
+#include "scene/assetpack.h"
 #include "scene/import-texture.h"
+#include "scene/asyncuploader.h"
+#include "scene/textureresidency.h"
+#include "scene/texturestreamer.h"
+#include "scene/textureheap.h"
+#include "scene/uploadbatch.h"
 
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <GLFW/glfw3.h>
@@ -26,7 +43,8 @@
 using namespace vulkan;
 
 using std::vector;
-using std::map;
+using std::unique_ptr;
+using std::make_unique;
 using std::exception;
 using std::runtime_error;
 using glm::vec2;
@@ -43,98 +61,6 @@ static vector<const char *> getRequiredInstanceExtensions()
 #include "scene/scene.h"
 #include "scene/rendertarget.h"
 
-static VkPipeline createGraphicsPipeline(const ShaderProgram &shaderProgram, VkRenderPass renderPass, const VkPipelineVertexInputStateCreateInfo &pipelineVertexInputStateCreateInfo)
-{
-	VkPipelineInputAssemblyStateCreateInfo pipelineInputAssemblyStateCreateInfo = {};
-	pipelineInputAssemblyStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-	pipelineInputAssemblyStateCreateInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-	pipelineInputAssemblyStateCreateInfo.primitiveRestartEnable = VK_FALSE;
-
-	VkPipelineRasterizationStateCreateInfo pipelineRasterizationStateCreateInfo = {};
-	pipelineRasterizationStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-	pipelineRasterizationStateCreateInfo.polygonMode = VK_POLYGON_MODE_FILL;
-	pipelineRasterizationStateCreateInfo.cullMode = VK_CULL_MODE_BACK_BIT;
-	pipelineRasterizationStateCreateInfo.frontFace = VK_FRONT_FACE_CLOCKWISE;
-	pipelineRasterizationStateCreateInfo.lineWidth = 1.0f;
-
-	VkPipelineColorBlendAttachmentState pipelineColorBlendAttachmentState[1] = { { 0 } };
-	pipelineColorBlendAttachmentState[0].colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-	pipelineColorBlendAttachmentState[0].blendEnable = VK_FALSE;
-
-	VkPipelineColorBlendStateCreateInfo pipelineColorBlendStateCreateInfo = {};
-	pipelineColorBlendStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-	pipelineColorBlendStateCreateInfo.attachmentCount = ARRAY_SIZE(pipelineColorBlendAttachmentState);
-	pipelineColorBlendStateCreateInfo.pAttachments = pipelineColorBlendAttachmentState;
-
-	VkPipelineMultisampleStateCreateInfo pipelineMultisampleStateCreateInfo = {};
-	pipelineMultisampleStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-	pipelineMultisampleStateCreateInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-
-	VkPipelineViewportStateCreateInfo pipelineViewportStateCreateInfo = {};
-	pipelineViewportStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-	pipelineViewportStateCreateInfo.viewportCount = 1;
-	pipelineViewportStateCreateInfo.pViewports = nullptr;
-	pipelineViewportStateCreateInfo.scissorCount = 1;
-	pipelineViewportStateCreateInfo.pScissors = nullptr;
-
-	VkPipelineDepthStencilStateCreateInfo pipelineDepthStencilStateCreateInfo = {};
-	pipelineDepthStencilStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-	pipelineDepthStencilStateCreateInfo.depthTestEnable = VK_TRUE;
-	pipelineDepthStencilStateCreateInfo.depthWriteEnable = VK_TRUE;
-	pipelineDepthStencilStateCreateInfo.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
-
-	VkDynamicState dynamicStateEnables[] = {
-		VK_DYNAMIC_STATE_VIEWPORT,
-		VK_DYNAMIC_STATE_SCISSOR
-	};
-
-	VkPipelineDynamicStateCreateInfo pipelineDynamicStateCreateInfo = {};
-	pipelineDynamicStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-	pipelineDynamicStateCreateInfo.pDynamicStates = dynamicStateEnables;
-	pipelineDynamicStateCreateInfo.dynamicStateCount = ARRAY_SIZE(dynamicStateEnables);
-
-	VkGraphicsPipelineCreateInfo pipelineCreateInfo = {};
-	pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-	pipelineCreateInfo.layout = shaderProgram.getPipelineLayout();
-	pipelineCreateInfo.renderPass = renderPass;
-	pipelineCreateInfo.pVertexInputState = &pipelineVertexInputStateCreateInfo;
-	pipelineCreateInfo.pInputAssemblyState = &pipelineInputAssemblyStateCreateInfo;
-	pipelineCreateInfo.pRasterizationState = &pipelineRasterizationStateCreateInfo;
-	pipelineCreateInfo.pColorBlendState = &pipelineColorBlendStateCreateInfo;
-	pipelineCreateInfo.pMultisampleState = &pipelineMultisampleStateCreateInfo;
-	pipelineCreateInfo.pViewportState = &pipelineViewportStateCreateInfo;
-	pipelineCreateInfo.pDepthStencilState = &pipelineDepthStencilStateCreateInfo;
-	pipelineCreateInfo.pDynamicState = &pipelineDynamicStateCreateInfo;
-
-	auto shaderStages = shaderProgram.getPipelineShaderStageCreateInfos();
-	pipelineCreateInfo.stageCount = shaderStages.size();
-	pipelineCreateInfo.pStages = shaderStages.data();
-
-	VkPipeline pipeline;
-	auto err = vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &pipeline);
-	assert(err == VK_SUCCESS);
-
-	return pipeline;
-}
-
-static VkPipeline createComputePipeline(const ShaderProgram &shaderProgram)
-{
-	VkComputePipelineCreateInfo computePipelineCreateInfo = {};
-	computePipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
-
-	auto stages = shaderProgram.getPipelineShaderStageCreateInfos();
-	assert(stages.size() == 1);
-	assert(stages[0].stage == VK_SHADER_STAGE_COMPUTE_BIT);
-
-	computePipelineCreateInfo.stage = stages[0];
-	computePipelineCreateInfo.layout = shaderProgram.getPipelineLayout();
-
-	VkPipeline computePipeline;
-	auto err = vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &computePipelineCreateInfo, nullptr, &computePipeline);
-	assert(err == VK_SUCCESS);
-	return computePipeline;
-}
-
 namespace CubeData
 {
 	vec3 vertexPositions[] = {
@@ -246,45 +172,113 @@ int main(int argc, char *argv[])
 	auto appName = "some excess demo";
 	auto width = 1280, height = 720;
 	auto fullscreen = false;
+	auto framesInFlight = 2;
 	GLFWwindow *win = nullptr;
+	auto pipelineCachePath = "pipeline-cache.bin";
+	auto assetPackPath = "assets/assets.pack";
+
+#ifdef WIN32
+	auto argc = __argc;
+	auto argv = __argv;
+#endif
+
+	// --headless [frames]: render offscreen without a window, and report the throughput
+	// --profile [trace.json]: print GPU/CPU timings on exit, and optionally write a Chrome trace
+	// --texture-budget megabytes: how much device-memory textures may keep resident
+	auto headless = false;
+	auto headlessFrames = 1000;
+	auto profile = false;
+	const char *traceFilename = nullptr;
+	auto textureBudget = VkDeviceSize(256) << 20;
+	for (auto i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "--headless")) {
+			headless = true;
+			if (i + 1 < argc && atoi(argv[i + 1]) > 0)
+				headlessFrames = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "--profile")) {
+			profile = true;
+			if (i + 1 < argc && strncmp(argv[i + 1], "--", 2))
+				traceFilename = argv[++i];
+		} else if (!strcmp(argv[i], "--texture-budget")) {
+			if (i + 1 < argc && atoi(argv[i + 1]) > 0)
+				textureBudget = VkDeviceSize(atoi(argv[++i])) << 20;
+		}
+	}
 
 	try {
-		if (!glfwInit())
-			throw runtime_error("glfwInit failed!");
+		vector<const char *> enabledExtensions;
+
+		if (!headless) {
+			if (!glfwInit())
+				throw runtime_error("glfwInit failed!");
 
-		if (!glfwVulkanSupported())
-			throw runtime_error("no vulkan support!");
+			if (!glfwVulkanSupported())
+				throw runtime_error("no vulkan support!");
 
-		glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-		glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
-		win = glfwCreateWindow(width, height, appName, fullscreen ? glfwGetPrimaryMonitor() : nullptr, nullptr);
-		if (fullscreen)
-			glfwSetInputMode(win, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+			glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+			glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+			win = glfwCreateWindow(width, height, appName, fullscreen ? glfwGetPrimaryMonitor() : nullptr, nullptr);
+			if (fullscreen)
+				glfwSetInputMode(win, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
-		glfwSetKeyCallback(win, [](GLFWwindow* window, int key, int scancode, int action, int mods) {
-			if (action == GLFW_PRESS && key == GLFW_KEY_ESCAPE)
-				glfwSetWindowShouldClose(window, GLFW_TRUE);
-			});
+			glfwSetKeyCallback(win, [](GLFWwindow* window, int key, int scancode, int action, int mods) {
+				if (action == GLFW_PRESS && key == GLFW_KEY_ESCAPE)
+					glfwSetWindowShouldClose(window, GLFW_TRUE);
+				});
 
+			enabledExtensions = getRequiredInstanceExtensions();
+		}
 
-		auto enabledExtensions = getRequiredInstanceExtensions();
 #ifndef NDEBUG
 		enabledExtensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
 #endif
 
+		// needed to query for descriptor-indexing
+		auto physicalDeviceProperties2 = instanceExtensionSupported(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+		if (physicalDeviceProperties2)
+			enabledExtensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+
 		instanceInit(appName, enabledExtensions);
 
+		vector<const char *> enabledDeviceExtensions;
+		if (!headless)
+			enabledDeviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+
 		auto physicalDevice = choosePhysicalDevice();
-		deviceInit(physicalDevice, [](VkInstance instance, VkPhysicalDevice physicalDevice, uint32_t queueIndex) {
-			return glfwGetPhysicalDevicePresentationSupport(instance, physicalDevice, queueIndex) == GLFW_TRUE;
-		});
+		if (physicalDeviceProperties2 &&
+		    deviceExtensionSupported(physicalDevice, VK_KHR_MAINTENANCE3_EXTENSION_NAME) &&
+		    deviceExtensionSupported(physicalDevice, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME)) {
+			enabledDeviceExtensions.push_back(VK_KHR_MAINTENANCE3_EXTENSION_NAME);
+			enabledDeviceExtensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+		}
+
+		if (deviceExtensionSupported(physicalDevice, VK_KHR_DESCRIPTOR_UPDATE_TEMPLATE_EXTENSION_NAME))
+			enabledDeviceExtensions.push_back(VK_KHR_DESCRIPTOR_UPDATE_TEMPLATE_EXTENSION_NAME);
+
+		// lets textures make room when the device runs low
+		if (physicalDeviceProperties2 && deviceExtensionSupported(physicalDevice, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME))
+			enabledDeviceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
+		deviceInit(physicalDevice, [headless](VkInstance instance, VkPhysicalDevice physicalDevice, uint32_t queueIndex) {
+			return headless || glfwGetPhysicalDevicePresentationSupport(instance, physicalDevice, queueIndex) == GLFW_TRUE;
+		}, enabledDeviceExtensions);
 
-		VkSurfaceKHR surface;
-		auto err = glfwCreateWindowSurface(instance, win, nullptr, &surface);
-		if (err)
-			throw runtime_error("glfwCreateWindowSurface failed!");
+		pipelineCacheInit(pipelineCachePath);
 
-		auto swapChain = SwapChain(surface, width, height, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+		ThreadPool threadPool;
+		PipelineRegistry pipelineRegistry(threadPool);
+
+		VkResult err;
+		unique_ptr<SwapChainBase> swapChain;
+		if (!headless) {
+			VkSurfaceKHR surface;
+			err = glfwCreateWindowSurface(instance, win, nullptr, &surface);
+			if (err)
+				throw runtime_error("glfwCreateWindowSurface failed!");
+
+			swapChain = make_unique<SwapChain>(surface, width, height, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+		} else
+			swapChain = make_unique<HeadlessSwapChain>(width, height, 3, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
 
 		vector<VkFormat> depthCandidates = {
 			VK_FORMAT_D32_SFLOAT,
@@ -293,11 +287,21 @@ int main(int argc, char *argv[])
 		};
 
 		auto depthFormat = findBestFormat(depthCandidates, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
-		DepthRenderTarget depthRenderTarget(depthFormat, width, height);
 
 		auto renderTargetFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
-		ColorRenderTarget colorRenderTarget(renderTargetFormat, width, height, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
-		ColorRenderTarget postProcessRenderTarget(renderTargetFormat, width, height, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+
+		// with async compute, a frame's post-processing overlaps the next frame's rendering, so they need separate targets
+		// (and a frame is only finished by the next one, so that takes at least two frames in flight)
+		auto asyncCompute = computeQueueIndex != graphicsQueueIndex && framesInFlight > 1;
+
+		// frames in flight can overlap their geometry passes, so each gets its own depth target too
+		vector<unique_ptr<DepthRenderTarget>> depthRenderTargets;
+		vector<unique_ptr<ColorRenderTarget>> colorRenderTargets, postProcessRenderTargets;
+		for (auto i = 0; i < framesInFlight; ++i) {
+			depthRenderTargets.push_back(make_unique<DepthRenderTarget>(depthFormat, width, height));
+			colorRenderTargets.push_back(make_unique<ColorRenderTarget>(renderTargetFormat, width, height, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT));
+			postProcessRenderTargets.push_back(make_unique<ColorRenderTarget>(renderTargetFormat, width, height, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT));
+		}
 
 		VkAttachmentDescription attachments[2];
 		attachments[0].flags = 0;
@@ -346,13 +350,15 @@ int main(int argc, char *argv[])
 		assert(err == VK_SUCCESS);
 
 
-		auto framebuffer = createFramebuffer(
-			width, height, 1,
-			{ depthRenderTarget.getImageView(), colorRenderTarget.getImageView() },
-			renderPass);
+		vector<VkFramebuffer> framebuffers;
+		for (auto i = 0; i < framesInFlight; ++i)
+			framebuffers.push_back(createFramebuffer(
+				width, height, 1,
+				{ depthRenderTargets[i]->getImageView(), colorRenderTargets[i]->getImageView() },
+				renderPass));
 
-		auto imageViews = swapChain.getImageViews();
-		auto images = swapChain.getImages();
+		auto imageViews = swapChain->getImageViews();
+		auto images = swapChain->getImages();
 
 		Scene scene;
 
@@ -379,153 +385,251 @@ int main(int argc, char *argv[])
 
 		// OK, let's prepare for rendering!
 
-		auto texture = importTexture2D("assets/excess-logo.png", TextureImportFlags::GENERATE_MIPMAPS);
+		/*
+		 * Get the pipelines compiling on the worker-threads first, so they
+		 * overlap with loading and uploading everything else.
+		 */
+		// every texture also registers here, which keeps them within the budget
+		TextureResidency textureResidency(textureBudget);
+
+		struct {
+			uint32_t objectIndex;
+			uint32_t textureIndex;
+		} perDrawConstants;
+
+		/*
+		 * Where the device allows, every texture goes in a heap, and draws
+		 * pick theirs with a push-constant. Otherwise, each draw binds a set
+		 * with its own texture, and a shader that samples just that.
+		 */
+		unique_ptr<TextureHeap> textureHeap;
+		vector<ShaderDescriptor> descriptors = {
+			{ 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_VERTEX_BIT }
+		};
+		vector<VkDescriptorSetLayout> extraDescriptorSetLayouts;
+		auto fragmentShaderPath = "data/shaders/triangle.frag.spv";
+		if (TextureHeap::isSupported()) {
+			auto textureHeapSampler = createSampler(VK_LOD_CLAMP_NONE, true, true);
+			textureHeap = make_unique<TextureHeap>(4096, textureHeapSampler, framesInFlight);
+			extraDescriptorSetLayouts.push_back(textureHeap->getDescriptorSetLayout());
+		} else {
+			descriptors.push_back({ 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT });
+			fragmentShaderPath = "data/shaders/triangle-perdraw.frag.spv";
+		}
 
 		auto shaderProgram = ShaderProgram({
 			ShaderStage(VK_SHADER_STAGE_VERTEX_BIT, loadShaderModule("data/shaders/triangle.vert.spv")),
-			ShaderStage(VK_SHADER_STAGE_FRAGMENT_BIT, loadShaderModule("data/shaders/triangle.frag.spv"))
+			ShaderStage(VK_SHADER_STAGE_FRAGMENT_BIT, loadShaderModule(fragmentShaderPath))
+		}, descriptors, {
+			{ VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(perDrawConstants) }
+		}, extraDescriptorSetLayouts);
+		auto pipelineLayout = shaderProgram.getPipelineLayout();
+
+		auto pipelineDescription = PipelineDescription(shaderProgram, renderPass);
+		pipelineDescription.vertexBindings = { { 0, sizeof(float) * 3, VK_VERTEX_INPUT_RATE_VERTEX } };
+		pipelineDescription.vertexAttributes = { { 0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0 } };
+		auto pipeline = pipelineRegistry.request(pipelineDescription);
+
+		auto postProcessShaderProgram = ShaderProgram({
+			ShaderStage(VK_SHADER_STAGE_COMPUTE_BIT, loadShaderModule("data/shaders/postprocess.comp.spv"))
 		}, {
-			{ 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_VERTEX_BIT },
-			{ 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT }
+			ShaderDescriptor(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT),
+			ShaderDescriptor(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT),
 		});
-		auto pipelineLayout = createPipelineLayout({ shaderProgram.getDescriptorSetLayout() }, {});
+		auto postProcessPipeline = pipelineRegistry.request(PipelineDescription(postProcessShaderProgram));
+
+		UploadBatch uploadBatch;
 
-		VkVertexInputBindingDescription vertexInputBindingDesc[1];
-		vertexInputBindingDesc[0].binding = 0;
-		vertexInputBindingDesc[0].stride = sizeof(float) * 3;
-		vertexInputBindingDesc[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+		// for anything streamed in while running
+		AsyncUploader asyncUploader;
 
-		VkVertexInputAttributeDescription vertexInputAttributeDescription[1];
-		vertexInputAttributeDescription[0].binding = 0;
-		vertexInputAttributeDescription[0].location = 0;
-		vertexInputAttributeDescription[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-		vertexInputAttributeDescription[0].offset = 0;
+		// prefer the baked version, if there is one
+		unique_ptr<AssetPack> assetPack;
+		unique_ptr<TextureStreamer> textureStreamer;
+		struct stat st;
+		if (stat(assetPackPath, &st) == 0) {
+			assetPack = make_unique<AssetPack>(assetPackPath);
+			textureStreamer = make_unique<TextureStreamer>(*assetPack, asyncUploader, textureResidency, framesInFlight);
+		}
 
-		VkPipelineVertexInputStateCreateInfo pipelineVertexInputStateCreateInfo = {};
-		pipelineVertexInputStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-		pipelineVertexInputStateCreateInfo.vertexBindingDescriptionCount = ARRAY_SIZE(vertexInputBindingDesc);
-		pipelineVertexInputStateCreateInfo.pVertexBindingDescriptions = vertexInputBindingDesc;
-		pipelineVertexInputStateCreateInfo.vertexAttributeDescriptionCount = ARRAY_SIZE(vertexInputAttributeDescription);
-		pipelineVertexInputStateCreateInfo.pVertexAttributeDescriptions = vertexInputAttributeDescription;
+		// baked textures start out with their mip-tails and sharpen while running; otherwise, it's decoded on the thread pool while we set up the rest
+		Texture2D *texture = nullptr;
+		unique_ptr<Texture2D> importedTexture;
+		std::future<unique_ptr<Texture2D>> textureImport;
+		if (assetPack && assetPack->isTextureSupported("assets/excess-logo.png"))
+			texture = textureStreamer->loadTexture2D(uploadBatch, "assets/excess-logo.png");
+		else
+			textureImport = importTexture2DAsync(threadPool, uploadBatch, "assets/excess-logo.png", TextureImportFlags::GENERATE_MIPMAPS);
 
-		auto pipeline = createGraphicsPipeline(shaderProgram, renderPass, pipelineVertexInputStateCreateInfo);
+		// one matrix per transform, in a single block per frame
+		auto objectMatricesSize = VkDeviceSize(sizeof(mat4) * scene.getTransforms().size());
 
-		auto descriptorPool = createDescriptorPool({
-			{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1 },
-			{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 },
-		}, 1);
+		// a frame only ever needs half of its ring, so it never has to wait for space
+		vector<unique_ptr<FrameContext>> frameContexts;
+		for (auto i = 0; i < framesInFlight; ++i)
+			frameContexts.push_back(make_unique<FrameContext>(alignSize(objectMatricesSize, deviceProperties.limits.minStorageBufferOffsetAlignment) * 2, asyncCompute));
 
-		struct {
-			mat4 modelViewProjectionMatrix;
-		} perObjectUniforms;
-		auto uniformSize = sizeof(perObjectUniforms);
-		auto uniformBufferSpacing = uint32_t(alignSize(uniformSize, deviceProperties.limits.minUniformBufferOffsetAlignment));
-		auto uniformBufferSize = VkDeviceSize(uniformBufferSpacing * scene.getTransforms().size());
+		// descriptor sets come from the frame's allocator, and get written through these
+		DescriptorUpdateTemplate descriptorUpdateTemplate(shaderProgram);
+		DescriptorUpdateTemplate postProcessDescriptorUpdateTemplate(postProcessShaderProgram);
 
-		auto uniformBuffer = Buffer(uniformBufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+		// on unified memory, static buffers can be host-visible for free, which lets the upload write them in place
+		auto staticBufferPreferredFlags = unifiedMemory ? VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT : 0;
 
-		auto descriptorSet = allocateDescriptorSet(descriptorPool, shaderProgram.getDescriptorSetLayout());
+		auto vertexBuffer = Buffer(sizeof(CubeData::vertexPositions), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, staticBufferPreferredFlags);
+		uploadBatch.uploadBuffer(vertexBuffer, 0, CubeData::vertexPositions, sizeof(CubeData::vertexPositions));
 
-		VkDescriptorBufferInfo descriptorBufferInfo = uniformBuffer.getDescriptorBufferInfo();
+		auto indexBuffer = Buffer(sizeof(CubeData::vertexIndices), VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, staticBufferPreferredFlags);
+		uploadBatch.uploadBuffer(indexBuffer, 0, CubeData::vertexIndices, sizeof(CubeData::vertexIndices));
 
-		VkWriteDescriptorSet writeDescriptorSets[2] = {};
-		writeDescriptorSets[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		writeDescriptorSets[0].dstSet = descriptorSet;
-		writeDescriptorSets[0].descriptorCount = 1;
-		writeDescriptorSets[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
-		writeDescriptorSets[0].pBufferInfo = &descriptorBufferInfo;
-		writeDescriptorSets[0].dstBinding = 0;
+		if (textureImport.valid()) {
+			importedTexture = textureImport.get();
+			texture = importedTexture.get();
+		}
+		material = Material(texture);
 
 		VkSampler textureSampler = createSampler(float(texture->getMipLevels()), true, true);
 
-		VkDescriptorImageInfo descriptorImageInfo = texture->getDescriptorImageInfo(textureSampler);
-		writeDescriptorSets[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		writeDescriptorSets[1].dstSet = descriptorSet;
-		writeDescriptorSets[1].descriptorCount = 1;
-		writeDescriptorSets[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		writeDescriptorSets[1].pBufferInfo = nullptr;
-		writeDescriptorSets[1].pImageInfo = &descriptorImageInfo;
-		writeDescriptorSets[1].dstBinding = 1;
-		vkUpdateDescriptorSets(device, ARRAY_SIZE(writeDescriptorSets), writeDescriptorSets, 0, nullptr);
+		uploadBatch.submit();
 
-		auto vertexStagingBuffer = StagingBuffer(sizeof(CubeData::vertexPositions));
-		vertexStagingBuffer.uploadMemory(0, CubeData::vertexPositions, sizeof(CubeData::vertexPositions));
+		auto postProcess = [&](VkCommandBuffer commandBuffer, int frame) {
+			VkDescriptorImageInfo postProcessRenderTargetImageInfo = {};
+			postProcessRenderTargetImageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+			postProcessRenderTargetImageInfo.imageView = postProcessRenderTargets[frame]->getImageView();
 
-		auto vertexBuffer = Buffer(sizeof(CubeData::vertexPositions), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-		vertexBuffer.uploadFromStagingBuffer(vertexStagingBuffer, 0, 0, sizeof(CubeData::vertexPositions));
+			VkDescriptorImageInfo colorRenderTargetImageInfo = {};
+			colorRenderTargetImageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			colorRenderTargetImageInfo.imageView = colorRenderTargets[frame]->getImageView();
+			colorRenderTargetImageInfo.sampler = textureSampler;
 
-		auto indexBuffer = Buffer(sizeof(CubeData::vertexIndices), VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
-		indexBuffer.uploadMemory(0, CubeData::vertexIndices, sizeof(CubeData::vertexIndices));
+			auto postProcessDescriptorSet = frameContexts[frame]->getDescriptorAllocator().allocate(postProcessShaderProgram);
+			postProcessDescriptorUpdateTemplate.update(postProcessDescriptorSet, { postProcessRenderTargetImageInfo, colorRenderTargetImageInfo });
 
-		auto postProcessShaderProgram = ShaderProgram({
-			ShaderStage(VK_SHADER_STAGE_COMPUTE_BIT, loadShaderModule("data/shaders/postprocess.comp.spv"))
-		}, {
-			ShaderDescriptor(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT),
-			ShaderDescriptor(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT),
-		});
-		auto postProcessPipeline = createComputePipeline(postProcessShaderProgram);
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, postProcessPipeline.get());
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, postProcessShaderProgram.getPipelineLayout(), 0, 1, &postProcessDescriptorSet, 0, nullptr);
 
-		auto postProcessDescriptorPool = createDescriptorPool({
-			{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 },
-			{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 },
-		}, imageViews.size());
+			imageBarrier(
+				commandBuffer,
+				postProcessRenderTargets[frame]->getImage(),
+				VK_IMAGE_ASPECT_COLOR_BIT,
+				VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+				0, VK_ACCESS_SHADER_WRITE_BIT,
+				VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
 
-		auto postProcessDescriptorSet = allocateDescriptorSet(postProcessDescriptorPool, postProcessShaderProgram.getDescriptorSetLayout());
-		{
-			VkDescriptorImageInfo postProcessRenderTargetImageInfo = {};
-			postProcessRenderTargetImageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
-			postProcessRenderTargetImageInfo.imageView = postProcessRenderTarget.getImageView();
-
-			VkWriteDescriptorSet writeDescriptorSets[2] = {};
-			writeDescriptorSets[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-			writeDescriptorSets[0].dstSet = postProcessDescriptorSet;
-			writeDescriptorSets[0].dstBinding = 0;
-			writeDescriptorSets[0].descriptorCount = 1;
-			writeDescriptorSets[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-			writeDescriptorSets[0].pImageInfo = &postProcessRenderTargetImageInfo;
-
-			VkDescriptorImageInfo descriptorImageInfo = {};
-			descriptorImageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-			descriptorImageInfo.imageView = colorRenderTarget.getImageView();
-			descriptorImageInfo.sampler = textureSampler;
-
-			writeDescriptorSets[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-			writeDescriptorSets[1].dstSet = postProcessDescriptorSet;
-			writeDescriptorSets[1].dstBinding = 1;
-			writeDescriptorSets[1].descriptorCount = 1;
-			writeDescriptorSets[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-			writeDescriptorSets[1].pImageInfo = &descriptorImageInfo;
-
-			vkUpdateDescriptorSets(device, ARRAY_SIZE(writeDescriptorSets), writeDescriptorSets, 0, nullptr);
-		}
+			vkCmdDispatch(commandBuffer, width / 16, height / 16, 1);
+		};
+
+		auto blitToSwapImage = [&](VkCommandBuffer commandBuffer, int frame, uint32_t swapImage) {
+			imageBarrier(
+				commandBuffer,
+				images[swapImage],
+				VK_IMAGE_ASPECT_COLOR_BIT,
+				VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+				0, VK_ACCESS_TRANSFER_WRITE_BIT,
+				VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+
+			blitImage(commandBuffer,
+				postProcessRenderTargets[frame]->getImage(),
+				images[swapImage],
+				width, height,
+				{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 },
+				{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 });
+
+			imageBarrier(
+				commandBuffer,
+				images[swapImage],
+				VK_IMAGE_ASPECT_COLOR_BIT,
+				VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+				VK_ACCESS_TRANSFER_WRITE_BIT, 0,
+				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, swapChain->getPresentLayout());
+		};
 
+		// timestamps are cheap enough to always have around; statistics and traces are opt-in
+		Profiler profiler(framesInFlight, profile, traceFilename != nullptr);
 
-		auto backBufferSemaphore = createSemaphore(),
-		     presentCompleteSemaphore = createSemaphore();
+		auto presentedFrames = 0;
 
-		VkCommandPool commandPool = createCommandPool(graphicsQueueIndex);
-		auto commandBuffers = allocateCommandBuffers(commandPool, imageViews.size());
+		/*
+		 * With async compute, a frame is finished by a graphics submit that
+		 * blits and presents its post-processed result. Only this submit
+		 * signals the frame's fence, so every frame has to go through here,
+		 * including the last one.
+		 */
+		auto presentAsyncFrame = [&](int frame) {
+			VkCommandBufferBeginInfo commandBufferBeginInfo = {};
+			commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+			commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
-		auto commandBufferFences = new VkFence[imageViews.size()];
-		for (auto i = 0u; i < imageViews.size(); ++i)
-			commandBufferFences[i] = createFence(VK_FENCE_CREATE_SIGNALED_BIT);
+			auto &frameContext = *frameContexts[frame];
+			auto presentCommandBuffer = frameContext.getPresentCommandBuffer();
 
-		err = vkQueueWaitIdle(graphicsQueue);
-		assert(err == VK_SUCCESS);
+			err = vkBeginCommandBuffer(presentCommandBuffer, &commandBufferBeginInfo);
+			assert(err == VK_SUCCESS);
 
-		auto startTime = glfwGetTime();
-		while (!glfwWindowShouldClose(win)) {
-			auto time = glfwGetTime() - startTime;
+			imageBarrier(
+				presentCommandBuffer,
+				postProcessRenderTargets[frame]->getImage(),
+				VK_IMAGE_ASPECT_COLOR_BIT,
+				VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+				0, VK_ACCESS_TRANSFER_READ_BIT,
+				VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+				computeQueueIndex, graphicsQueueIndex);
 
-			auto currentSwapImage = swapChain.aquireNextImage(backBufferSemaphore);
+			auto presentReadySemaphore = frameContext.getPresentReadySemaphore();
+			auto currentSwapImage = swapChain->aquireNextImage(frameContext.getImageAvailableSemaphore());
+			profiler.beginScope(frame, presentCommandBuffer, "blit");
+			blitToSwapImage(presentCommandBuffer, frame, currentSwapImage);
+			profiler.endScope(frame, presentCommandBuffer);
 
-			err = vkWaitForFences(device, 1, &commandBufferFences[currentSwapImage], VK_TRUE, UINT64_MAX);
+			err = vkEndCommandBuffer(presentCommandBuffer);
 			assert(err == VK_SUCCESS);
 
-			err = vkResetFences(device, 1, &commandBufferFences[currentSwapImage]);
+			VkSemaphore presentWaitSemaphores[] = { frameContext.getImageAvailableSemaphore(), frameContext.getPostProcessCompleteSemaphore() };
+			VkPipelineStageFlags presentWaitDstStageMasks[] = { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT };
+
+			VkSubmitInfo presentSubmitInfo = {};
+			presentSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+			presentSubmitInfo.waitSemaphoreCount = ARRAY_SIZE(presentWaitSemaphores);
+			presentSubmitInfo.pWaitSemaphores = presentWaitSemaphores;
+			presentSubmitInfo.pWaitDstStageMask = presentWaitDstStageMasks;
+			presentSubmitInfo.signalSemaphoreCount = 1;
+			presentSubmitInfo.pSignalSemaphores = &presentReadySemaphore;
+			presentSubmitInfo.commandBufferCount = 1;
+			presentSubmitInfo.pCommandBuffers = &presentCommandBuffer;
+
+			err = vkQueueSubmit(graphicsQueue, 1, &presentSubmitInfo, frameContext.getFence());
 			assert(err == VK_SUCCESS);
 
-			auto commandBuffer = commandBuffers[currentSwapImage];
+			swapChain->queuePresent(currentSwapImage, &presentReadySemaphore, 1);
+			++presentedFrames;
+		};
+
+		err = vkQueueWaitIdle(graphicsQueue);
+		assert(err == VK_SUCCESS);
+
+#ifndef NDEBUG
+		dumpMemoryStats(stderr);
+		textureResidency.dumpStats(stderr);
+#endif
+
+		auto benchmarkStart = std::chrono::steady_clock::now();
+		auto startTime = headless ? 0.0 : glfwGetTime();
+		auto frameIndex = 0;
+		for (; headless ? frameIndex < headlessFrames : !glfwWindowShouldClose(win); ++frameIndex) {
+			// fixed time-steps when headless, so runs are reproducible
+			auto time = headless ? frameIndex / 60.0 : glfwGetTime() - startTime;
+			auto frame = frameIndex % framesInFlight;
+			auto &frameContext = *frameContexts[frame];
+
+			frameContext.begin();
+			if (textureHeap)
+				textureHeap->beginFrame();
+			asyncUploader.update();
+			textureResidency.update();
+			if (textureStreamer)
+				textureStreamer->update();
+
+			auto commandBuffer = frameContext.getCommandBuffer();
 			VkCommandBufferBeginInfo commandBufferBeginInfo = {};
 			commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 			commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
@@ -533,6 +637,8 @@ int main(int argc, char *argv[])
 			err = vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo);
 			assert(err == VK_SUCCESS);
 
+			profiler.beginFrame(frame, commandBuffer);
+
 			VkClearValue clearValues[2];
 			clearValues[0].depthStencil = { 1.0f, 0 };
 			clearValues[1].color = {
@@ -551,8 +657,9 @@ int main(int argc, char *argv[])
 			renderPassBeginInfo.renderArea.extent.height = height;
 			renderPassBeginInfo.clearValueCount = ARRAY_SIZE(clearValues);
 			renderPassBeginInfo.pClearValues = clearValues;
-			renderPassBeginInfo.framebuffer = framebuffer;
+			renderPassBeginInfo.framebuffer = framebuffers[frame];
 
+			profiler.beginScope(frame, commandBuffer, "geometry");
 			vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
 			setViewport(commandBuffer, 0, 0, float(width), float(height));
@@ -573,119 +680,211 @@ int main(int argc, char *argv[])
 			auto projectionMatrix = glm::perspective(fov * float(M_PI / 180.0f), aspect, znear, zfar);
 			auto viewProjectionMatrix = projectionMatrix * viewMatrix;
 
-			auto offset = 0u;
-			map<const Transform*, unsigned int> offsetMap;
-			auto transforms = scene.getTransforms();
-			auto ptr = uniformBuffer.map(0, uniformBufferSpacing * transforms.size());
-			for (auto transform : transforms) {
-				auto modelMatrix = transform->getAbsoluteMatrix();
-				auto modelViewProjectionMatrix = viewProjectionMatrix * modelMatrix;
-				perObjectUniforms.modelViewProjectionMatrix = modelViewProjectionMatrix;
-				memcpy(static_cast<uint8_t *>(ptr) + offset, &perObjectUniforms, sizeof(perObjectUniforms));
-				offsetMap[transform] = offset;
-				offset += uniformBufferSpacing;
-			}
-			uniformBuffer.unmap();
+			profiler.beginScope(frame, VK_NULL_HANDLE, "transforms");
+			scene.updateTransforms();
+
+			// one matrix per transform, in the scene's order, so draws index them with Transform::getIndex()
+			auto objectMatrices = frameContext.getRingBuffer().allocateStorage(objectMatricesSize);
+			auto &absoluteMatrices = scene.getAbsoluteMatrices();
+			for (size_t i = 0; i < absoluteMatrices.size(); ++i)
+				static_cast<mat4 *>(objectMatrices.data)[i] = viewProjectionMatrix * absoluteMatrices[i];
+			profiler.endScope(frame, VK_NULL_HANDLE);
 
 			VkDeviceSize vertexBufferOffsets[1] = { 0 };
 			VkBuffer vertexBuffers[1] = { vertexBuffer.getBuffer() };
 			vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, vertexBufferOffsets);
 			vkCmdBindIndexBuffer(commandBuffer, indexBuffer.getBuffer(), 0, VK_INDEX_TYPE_UINT16);
-			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.get());
 
-			for (auto object : scene.getObjects()) {
-				assert(offsetMap.count(object->getTransform()) > 0);
+			auto objectMatricesInfo = frameContext.getRingBuffer().getDescriptorBufferInfo(objectMatricesSize);
+			uint32_t dynamicOffsets[] = { uint32_t(objectMatrices.offset) };
+
+			// with the heap, sets are bound once per frame, and draws only differ in their push-constants
+			if (textureHeap) {
+				auto descriptorSet = frameContext.getDescriptorAllocator().allocate(shaderProgram);
+				descriptorUpdateTemplate.update(descriptorSet, { objectMatricesInfo });
 
-				auto offset = offsetMap[&object->getTransform()];
-				assert(offset <= uniformBufferSize - uniformSize);
-				uint32_t dynamicOffsets[] = { (uint32_t)offset };
-				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 1, dynamicOffsets);
+				VkDescriptorSet frameDescriptorSets[] = { descriptorSet, textureHeap->getDescriptorSet() };
+				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, ARRAY_SIZE(frameDescriptorSets), frameDescriptorSets, ARRAY_SIZE(dynamicOffsets), dynamicOffsets);
+			}
+
+			for (auto object : scene.getObjects()) {
+				auto albedoMap = object->getModel().getMaterial().getAlbedoMap();
+				perDrawConstants.objectIndex = object->getTransform().getIndex();
+				perDrawConstants.textureIndex = albedoMap != nullptr ? albedoMap->getHeapIndex() : 0;
+				if (albedoMap != nullptr)
+					albedoMap->markUsed();
+
+				if (!textureHeap) {
+					auto drawTexture = albedoMap != nullptr ? albedoMap : texture;
+					auto descriptorSet = frameContext.getDescriptorAllocator().allocate(shaderProgram);
+					descriptorUpdateTemplate.update(descriptorSet, { objectMatricesInfo, drawTexture->getDescriptorImageInfo(textureSampler) });
+					vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, ARRAY_SIZE(dynamicOffsets), dynamicOffsets);
+				}
+
+				vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(perDrawConstants), &perDrawConstants);
 				// vkCmdDraw(commandBuffer, ARRAY_SIZE(vertexPositions), 1, 0, 0);
 				vkCmdDrawIndexed(commandBuffer, ARRAY_SIZE(CubeData::vertexIndices), 1, 0, 0, 0);
 			}
 
 			vkCmdEndRenderPass(commandBuffer);
+			profiler.endScope(frame, commandBuffer);
+
+			if (!asyncCompute) {
+				profiler.beginScope(frame, commandBuffer, "post-process");
+				postProcess(commandBuffer, frame);
+				profiler.endScope(frame, commandBuffer);
+
+				imageBarrier(
+					commandBuffer,
+					postProcessRenderTargets[frame]->getImage(),
+					VK_IMAGE_ASPECT_COLOR_BIT,
+					VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+					VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+					VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+
+				auto imageAvailableSemaphore = frameContext.getImageAvailableSemaphore(),
+				     presentReadySemaphore = frameContext.getPresentReadySemaphore();
+
+				auto currentSwapImage = swapChain->aquireNextImage(imageAvailableSemaphore);
+				profiler.beginScope(frame, commandBuffer, "blit");
+				blitToSwapImage(commandBuffer, frame, currentSwapImage);
+				profiler.endScope(frame, commandBuffer);
+
+				err = vkEndCommandBuffer(commandBuffer);
+				assert(err == VK_SUCCESS);
+
+				VkPipelineStageFlags waitDstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+
+				VkSubmitInfo submitInfo = {};
+				submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+				submitInfo.waitSemaphoreCount = 1;
+				submitInfo.pWaitSemaphores = &imageAvailableSemaphore;
+				submitInfo.signalSemaphoreCount = 1;
+				submitInfo.pSignalSemaphores = &presentReadySemaphore;
+				submitInfo.pWaitDstStageMask = &waitDstStageMask;
+				submitInfo.commandBufferCount = 1;
+				submitInfo.pCommandBuffers = &commandBuffer;
+
+				// Submit draw command buffer
+				err = vkQueueSubmit(graphicsQueue, 1, &submitInfo, frameContext.getFence());
+				assert(err == VK_SUCCESS);
+
+				swapChain->queuePresent(currentSwapImage, &presentReadySemaphore, 1);
+				++presentedFrames;
+			} else {
+				// hand the color target over to the compute queue
+				imageBarrier(
+					commandBuffer,
+					colorRenderTargets[frame]->getImage(),
+					VK_IMAGE_ASPECT_COLOR_BIT,
+					VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+					VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, 0,
+					VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+					graphicsQueueIndex, computeQueueIndex);
+
+				err = vkEndCommandBuffer(commandBuffer);
+				assert(err == VK_SUCCESS);
+
+				VkSubmitInfo submitInfo = {};
+				submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+				submitInfo.signalSemaphoreCount = 1;
+				auto renderCompleteSemaphore = frameContext.getRenderCompleteSemaphore();
+				submitInfo.pSignalSemaphores = &renderCompleteSemaphore;
+				submitInfo.commandBufferCount = 1;
+				submitInfo.pCommandBuffers = &commandBuffer;
+
+				err = vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
+				assert(err == VK_SUCCESS);
+
+				auto computeCommandBuffer = frameContext.getComputeCommandBuffer();
+				err = vkBeginCommandBuffer(computeCommandBuffer, &commandBufferBeginInfo);
+				assert(err == VK_SUCCESS);
+
+				imageBarrier(
+					computeCommandBuffer,
+					colorRenderTargets[frame]->getImage(),
+					VK_IMAGE_ASPECT_COLOR_BIT,
+					VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+					0, VK_ACCESS_SHADER_READ_BIT,
+					VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+					graphicsQueueIndex, computeQueueIndex);
+
+				profiler.beginScope(frame, computeCommandBuffer, "post-process", computeQueueIndex);
+				postProcess(computeCommandBuffer, frame);
+				profiler.endScope(frame, computeCommandBuffer);
+
+				// ...and the result back to graphics for the blit
+				imageBarrier(
+					computeCommandBuffer,
+					postProcessRenderTargets[frame]->getImage(),
+					VK_IMAGE_ASPECT_COLOR_BIT,
+					VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+					VK_ACCESS_SHADER_WRITE_BIT, 0,
+					VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+					computeQueueIndex, graphicsQueueIndex);
+
+				err = vkEndCommandBuffer(computeCommandBuffer);
+				assert(err == VK_SUCCESS);
+
+				VkPipelineStageFlags computeWaitDstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
+				VkSubmitInfo computeSubmitInfo = {};
+				computeSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+				computeSubmitInfo.waitSemaphoreCount = 1;
+				computeSubmitInfo.pWaitSemaphores = &renderCompleteSemaphore;
+				computeSubmitInfo.pWaitDstStageMask = &computeWaitDstStageMask;
+				computeSubmitInfo.signalSemaphoreCount = 1;
+				auto postProcessCompleteSemaphore = frameContext.getPostProcessCompleteSemaphore();
+				computeSubmitInfo.pSignalSemaphores = &postProcessCompleteSemaphore;
+				computeSubmitInfo.commandBufferCount = 1;
+				computeSubmitInfo.pCommandBuffers = &computeCommandBuffer;
+
+				err = vkQueueSubmit(computeQueue, 1, &computeSubmitInfo, VK_NULL_HANDLE);
+				assert(err == VK_SUCCESS);
+
+				// the previous frame's post-processing got to overlap with the geometry pass we just submitted
+				if (frameIndex > 0)
+					presentAsyncFrame((frameIndex - 1) % framesInFlight);
+			}
 
-			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, postProcessPipeline);
-			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, postProcessShaderProgram.getPipelineLayout(), 0, 1, &postProcessDescriptorSet, 0, nullptr);
-
-			imageBarrier(
-				commandBuffer,
-				postProcessRenderTarget.getImage(),
-				VK_IMAGE_ASPECT_COLOR_BIT,
-				VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-				0, VK_ACCESS_SHADER_WRITE_BIT,
-				VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
-
-			vkCmdDispatch(commandBuffer, width / 16, height / 16, 1);
-
-			imageBarrier(
-				commandBuffer,
-				postProcessRenderTarget.getImage(),
-				VK_IMAGE_ASPECT_COLOR_BIT,
-				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
-				VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT,
-				VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
-
-			imageBarrier(
-				commandBuffer,
-				images[currentSwapImage],
-				VK_IMAGE_ASPECT_COLOR_BIT,
-				VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
-				0, VK_ACCESS_TRANSFER_WRITE_BIT,
-				VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-
-			blitImage(commandBuffer,
-				postProcessRenderTarget.getImage(),
-				images[currentSwapImage],
-				width, height,
-				{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 },
-				{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 });
-
-			imageBarrier(
-				commandBuffer,
-				images[currentSwapImage],
-				VK_IMAGE_ASPECT_COLOR_BIT,
-				VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-				VK_ACCESS_TRANSFER_WRITE_BIT, 0,
-				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
-
-			err = vkEndCommandBuffer(commandBuffer);
-			assert(err == VK_SUCCESS);
-
-			VkPipelineStageFlags waitDstStageMask = VK_PIPELINE_BIND_POINT_COMPUTE;
+			if (!headless)
+				glfwPollEvents();
+		}
 
-			VkSubmitInfo submitInfo = {};
-			submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-			submitInfo.waitSemaphoreCount = 1;
-			submitInfo.pWaitSemaphores = &backBufferSemaphore;
-			submitInfo.signalSemaphoreCount = 1;
-			submitInfo.pSignalSemaphores = &presentCompleteSemaphore;
-			submitInfo.pWaitDstStageMask = &waitDstStageMask;
-			submitInfo.commandBufferCount = 1;
-			submitInfo.pCommandBuffers = &commandBuffer;
+		// nothing follows the last frame to finish it
+		if (asyncCompute && frameIndex > 0)
+			presentAsyncFrame((frameIndex - 1) % framesInFlight);
 
-			// Submit draw command buffer
-			err = vkQueueSubmit(graphicsQueue, 1, &submitInfo, commandBufferFences[currentSwapImage]);
-			assert(err == VK_SUCCESS);
+		err = vkDeviceWaitIdle(device);
+		assert(err == VK_SUCCESS);
 
-			swapChain.queuePresent(currentSwapImage, &presentCompleteSemaphore, 1);
+		pipelineRegistry.finish();
+		pipelineCacheShutdown(pipelineCachePath);
 
-			glfwPollEvents();
+		if (headless) {
+			auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - benchmarkStart).count();
+			printf("%d frames in %.3f s: %.1f fps, %.3f ms/frame\n",
+			       presentedFrames, seconds, presentedFrames / seconds, seconds * 1000.0 / presentedFrames);
 		}
 
-		err = vkDeviceWaitIdle(device);
-		assert(err == VK_SUCCESS);
+		if (profile) {
+			profiler.printSummary(stdout);
+			textureResidency.dumpStats(stdout);
+			if (traceFilename != nullptr)
+				profiler.writeChromeTrace(traceFilename);
+		}
 
 	} catch (const exception &e) {
 		if (win != nullptr)
 			glfwDestroyWindow(win);
 
 #ifdef WIN32
-		MessageBox(nullptr, e.what(), nullptr, MB_OK);
-#else
-		fprintf(stderr, "FATAL ERROR: %s\n", e.what());
+		if (!headless)
+			MessageBox(nullptr, e.what(), nullptr, MB_OK);
+		else
 #endif
+			fprintf(stderr, "FATAL ERROR: %s\n", e.what());
 	}
 
 	glfwTerminate();
@@ -0,0 +1,335 @@
+#include "memoryallocator.h"
+
+#include <map>
+#include <mutex>
+#include <stdexcept>
+
+using namespace vulkan;
+
+using std::map;
+using std::vector;
+using std::mutex;
+using std::lock_guard;
+using std::runtime_error;
+
+struct vulkan::MemoryBlock {
+	VkDeviceMemory deviceMemory;
+	VkDeviceSize size;
+	uint32_t memoryTypeIndex;
+	bool linear;
+	bool dedicated;
+	void *mappedData;
+
+	map<VkDeviceSize, VkDeviceSize> freeRanges; // offset -> size
+	VkDeviceSize usedSize;
+	uint32_t allocationCount;
+};
+
+static const VkDeviceSize defaultBlockSize = 64 * 1024 * 1024;
+
+static mutex allocatorMutex;
+static vector<MemoryBlock *> blocks[VK_MAX_MEMORY_TYPES];
+static uint32_t deviceMemoryCount = 0;
+
+static bool isHostVisible(uint32_t memoryTypeIndex)
+{
+	return (deviceMemoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0;
+}
+
+static bool isHostCoherent(uint32_t memoryTypeIndex)
+{
+	return (deviceMemoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+}
+
+// the first memory-type with all of propertyFlags, or UINT32_MAX
+static uint32_t findMemoryTypeIndex(uint32_t memoryTypeBits, VkMemoryPropertyFlags propertyFlags)
+{
+	for (auto i = 0u; i < deviceMemoryProperties.memoryTypeCount; ++i) {
+		if (((memoryTypeBits >> i) & 1) && (deviceMemoryProperties.memoryTypes[i].propertyFlags & propertyFlags) == propertyFlags)
+			return i;
+	}
+	return UINT32_MAX;
+}
+
+static VkDeviceSize getBlockSize(uint32_t memoryTypeIndex)
+{
+	// don't let a single block eat more than an eighth of a small heap
+	auto heapIndex = deviceMemoryProperties.memoryTypes[memoryTypeIndex].heapIndex;
+	auto heapSize = deviceMemoryProperties.memoryHeaps[heapIndex].size;
+	return std::min(defaultBlockSize, alignSize(heapSize / 8, 4096));
+}
+
+static MemoryBlock *createBlock(VkDeviceSize size, uint32_t memoryTypeIndex, bool linear, bool dedicated)
+{
+	if (deviceMemoryCount >= deviceProperties.limits.maxMemoryAllocationCount)
+		throw runtime_error("out of device-memory allocations!");
+
+	VkMemoryAllocateInfo memoryAllocateInfo = {};
+	memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	memoryAllocateInfo.allocationSize = size;
+	memoryAllocateInfo.memoryTypeIndex = memoryTypeIndex;
+
+	VkDeviceMemory deviceMemory;
+	VkResult err = vkAllocateMemory(device, &memoryAllocateInfo, nullptr, &deviceMemory);
+	if (err == VK_ERROR_OUT_OF_DEVICE_MEMORY || err == VK_ERROR_OUT_OF_HOST_MEMORY)
+		throw runtime_error("out of device-memory!");
+	assert(err == VK_SUCCESS);
+
+	deviceMemoryCount++;
+
+	auto block = new MemoryBlock;
+	block->deviceMemory = deviceMemory;
+	block->size = size;
+	block->memoryTypeIndex = memoryTypeIndex;
+	block->linear = linear;
+	block->dedicated = dedicated;
+	block->mappedData = nullptr;
+	block->usedSize = 0;
+	block->allocationCount = 0;
+	block->freeRanges[0] = size;
+
+	if (isHostVisible(memoryTypeIndex)) {
+		err = vkMapMemory(device, deviceMemory, 0, VK_WHOLE_SIZE, 0, &block->mappedData);
+		assert(err == VK_SUCCESS);
+	}
+
+	return block;
+}
+
+static void destroyBlock(MemoryBlock *block)
+{
+	assert(block->allocationCount == 0);
+
+	if (block->mappedData != nullptr)
+		vkUnmapMemory(device, block->deviceMemory);
+
+	vkFreeMemory(device, block->deviceMemory, nullptr);
+	deviceMemoryCount--;
+	delete block;
+}
+
+static bool allocateFromBlock(MemoryBlock *block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize *offset)
+{
+	// best fit: pick the free range that leaves the least behind
+	auto best = block->freeRanges.end();
+	VkDeviceSize bestOffset = 0, bestWaste = ~VkDeviceSize(0);
+	for (auto it = block->freeRanges.begin(); it != block->freeRanges.end(); ++it) {
+		auto alignedOffset = alignSize(it->first, alignment);
+		auto end = it->first + it->second;
+		if (alignedOffset + size > end)
+			continue;
+
+		auto waste = it->second - size;
+		if (waste < bestWaste) {
+			best = it;
+			bestOffset = alignedOffset;
+			bestWaste = waste;
+		}
+	}
+
+	if (best == block->freeRanges.end())
+		return false;
+
+	auto rangeOffset = best->first,
+	     rangeEnd = best->first + best->second;
+	block->freeRanges.erase(best);
+
+	if (bestOffset > rangeOffset)
+		block->freeRanges[rangeOffset] = bestOffset - rangeOffset;
+	if (bestOffset + size < rangeEnd)
+		block->freeRanges[bestOffset + size] = rangeEnd - (bestOffset + size);
+
+	block->usedSize += size;
+	block->allocationCount++;
+	*offset = bestOffset;
+	return true;
+}
+
+static void freeToBlock(MemoryBlock *block, VkDeviceSize offset, VkDeviceSize size)
+{
+	assert(block->allocationCount > 0);
+	assert(block->usedSize >= size);
+
+	block->usedSize -= size;
+	block->allocationCount--;
+
+	auto next = block->freeRanges.lower_bound(offset);
+	assert(next == block->freeRanges.end() || next->first >= offset + size);
+
+	// merge with the following range
+	if (next != block->freeRanges.end() && next->first == offset + size) {
+		size += next->second;
+		next = block->freeRanges.erase(next);
+	}
+
+	// merge with the preceding range
+	if (next != block->freeRanges.begin()) {
+		auto prev = std::prev(next);
+		assert(prev->first + prev->second <= offset);
+		if (prev->first + prev->second == offset) {
+			prev->second += size;
+			size = 0;
+		}
+	}
+
+	if (size > 0)
+		block->freeRanges[offset] = size;
+}
+
+DeviceMemoryAllocation vulkan::allocateDeviceMemory(const VkMemoryRequirements &memoryRequirements, VkMemoryPropertyFlags propertyFlags, bool linear, VkMemoryPropertyFlags preferredFlags)
+{
+	auto memoryTypeIndex = findMemoryTypeIndex(memoryRequirements.memoryTypeBits, propertyFlags | preferredFlags);
+	if (memoryTypeIndex == UINT32_MAX)
+		memoryTypeIndex = getMemoryTypeIndex(memoryRequirements, propertyFlags);
+
+	auto size = memoryRequirements.size;
+	auto alignment = std::max(memoryRequirements.alignment, VkDeviceSize(1));
+
+	// keep mapped ranges of non-coherent memory flushable without touching neighbours
+	if (isHostVisible(memoryTypeIndex) && !isHostCoherent(memoryTypeIndex)) {
+		auto atomSize = std::max(deviceProperties.limits.nonCoherentAtomSize, VkDeviceSize(1));
+		alignment = std::max(alignment, atomSize);
+		size = alignSize(size, atomSize);
+	}
+
+	// linear and optimal resources may only share a block if there's no granularity to respect
+	if (deviceProperties.limits.bufferImageGranularity <= 1)
+		linear = true;
+
+	DeviceMemoryAllocation allocation = {};
+	allocation.memoryTypeIndex = memoryTypeIndex;
+	allocation.size = size;
+
+	lock_guard<mutex> lock(allocatorMutex);
+
+	auto blockSize = getBlockSize(memoryTypeIndex);
+	if (size > blockSize / 2) {
+		// too big to be worth sub-allocating; give it its own memory
+		auto block = createBlock(size, memoryTypeIndex, linear, true);
+		auto success = allocateFromBlock(block, size, 1, &allocation.offset);
+		assert(success);
+		blocks[memoryTypeIndex].push_back(block);
+		allocation.block = block;
+	} else {
+		allocation.block = nullptr;
+		for (auto block : blocks[memoryTypeIndex]) {
+			if (block->dedicated || block->linear != linear)
+				continue;
+
+			if (allocateFromBlock(block, size, alignment, &allocation.offset)) {
+				allocation.block = block;
+				break;
+			}
+		}
+
+		if (allocation.block == nullptr) {
+			auto block = createBlock(blockSize, memoryTypeIndex, linear, false);
+			auto success = allocateFromBlock(block, size, alignment, &allocation.offset);
+			assert(success);
+			blocks[memoryTypeIndex].push_back(block);
+			allocation.block = block;
+		}
+	}
+
+	allocation.deviceMemory = allocation.block->deviceMemory;
+	allocation.mappedData = nullptr;
+	if (allocation.block->mappedData != nullptr)
+		allocation.mappedData = static_cast<uint8_t *>(allocation.block->mappedData) + allocation.offset;
+
+	return allocation;
+}
+
+void vulkan::freeDeviceMemory(const DeviceMemoryAllocation &allocation)
+{
+	auto block = allocation.block;
+	assert(block != nullptr);
+
+	lock_guard<mutex> lock(allocatorMutex);
+
+	freeToBlock(block, allocation.offset, allocation.size);
+	if (block->allocationCount > 0)
+		return;
+
+	// keep one empty block around per memory-type, so we don't thrash
+	auto &typeBlocks = blocks[block->memoryTypeIndex];
+	if (!block->dedicated) {
+		auto emptyBlocks = std::count_if(typeBlocks.begin(), typeBlocks.end(), [](const MemoryBlock *b) {
+			return !b->dedicated && b->allocationCount == 0;
+		});
+		if (emptyBlocks <= 1)
+			return;
+	}
+
+	typeBlocks.erase(std::find(typeBlocks.begin(), typeBlocks.end(), block));
+	destroyBlock(block);
+}
+
+void vulkan::flushDeviceMemory(const DeviceMemoryAllocation &allocation)
+{
+	if (isHostCoherent(allocation.memoryTypeIndex))
+		return;
+
+	VkMappedMemoryRange mappedMemoryRange = {};
+	mappedMemoryRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+	mappedMemoryRange.memory = allocation.deviceMemory;
+	mappedMemoryRange.offset = allocation.offset;
+	mappedMemoryRange.size = allocation.size;
+
+	VkResult err = vkFlushMappedMemoryRanges(device, 1, &mappedMemoryRange);
+	assert(err == VK_SUCCESS);
+}
+
+MemoryStats vulkan::getMemoryStats()
+{
+	MemoryStats stats = {};
+
+	lock_guard<mutex> lock(allocatorMutex);
+
+	stats.deviceMemoryCount = deviceMemoryCount;
+	for (auto i = 0u; i < deviceMemoryProperties.memoryTypeCount; ++i) {
+		auto &typeStats = stats.memoryTypes[i];
+		for (auto block : blocks[i]) {
+			if (block->dedicated)
+				typeStats.dedicatedCount++;
+			else
+				typeStats.blockCount++;
+
+			typeStats.allocationCount += block->allocationCount;
+			typeStats.freeRangeCount += uint32_t(block->freeRanges.size());
+			typeStats.blockBytes += block->size;
+			typeStats.usedBytes += block->usedSize;
+
+			for (auto &range : block->freeRanges)
+				typeStats.largestFreeRange = std::max(typeStats.largestFreeRange, range.second);
+		}
+
+		stats.blockBytes += typeStats.blockBytes;
+		stats.usedBytes += typeStats.usedBytes;
+	}
+
+	return stats;
+}
+
+void vulkan::dumpMemoryStats(FILE *fp)
+{
+	auto stats = getMemoryStats();
+
+	fprintf(fp, "device-memory: %u allocations, %llu KiB reserved, %llu KiB used\n",
+	        stats.deviceMemoryCount,
+	        (unsigned long long)(stats.blockBytes / 1024),
+	        (unsigned long long)(stats.usedBytes / 1024));
+
+	for (auto i = 0u; i < deviceMemoryProperties.memoryTypeCount; ++i) {
+		auto &typeStats = stats.memoryTypes[i];
+		if (typeStats.blockCount == 0 && typeStats.dedicatedCount == 0)
+			continue;
+
+		fprintf(fp, "  type %2u (flags 0x%02x, heap %u): %u blocks, %u dedicated, %u allocations, %llu/%llu KiB used, %u free ranges (largest %llu KiB)\n",
+		        i, deviceMemoryProperties.memoryTypes[i].propertyFlags, deviceMemoryProperties.memoryTypes[i].heapIndex,
+		        typeStats.blockCount, typeStats.dedicatedCount, typeStats.allocationCount,
+		        (unsigned long long)(typeStats.usedBytes / 1024),
+		        (unsigned long long)(typeStats.blockBytes / 1024),
+		        typeStats.freeRangeCount,
+		        (unsigned long long)(typeStats.largestFreeRange / 1024));
+	}
+}
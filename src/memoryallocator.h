@@ -0,0 +1,84 @@
+#ifndef MEMORYALLOCATOR_H
+#define MEMORYALLOCATOR_H
+
+#include "vulkan.h"
+
+#include <cstdio>
+
+namespace vulkan
+{
+	struct MemoryBlock;
+
+	struct DeviceMemoryAllocation {
+		VkDeviceMemory deviceMemory;
+		VkDeviceSize offset;
+		VkDeviceSize size;
+		uint32_t memoryTypeIndex;
+		void *mappedData; // nullptr unless the memory-type is host-visible
+		MemoryBlock *block;
+	};
+
+	/*
+	 * Sub-allocates from large per-memory-type blocks instead of doing
+	 * one vkAllocateMemory per resource. Linear resources (buffers and
+	 * linear images) and optimal images are kept in separate blocks
+	 * whenever bufferImageGranularity requires it. Host-visible blocks
+	 * are persistently mapped.
+	 *
+	 * preferredFlags are on top of propertyFlags, and only used if some
+	 * memory-type has them all; like host-visible device-local memory.
+	 */
+	DeviceMemoryAllocation allocateDeviceMemory(const VkMemoryRequirements &memoryRequirements, VkMemoryPropertyFlags propertyFlags, bool linear, VkMemoryPropertyFlags preferredFlags = 0);
+	void freeDeviceMemory(const DeviceMemoryAllocation &allocation);
+
+	// no-op on coherent memory-types
+	void flushDeviceMemory(const DeviceMemoryAllocation &allocation);
+
+	inline DeviceMemoryAllocation allocateBufferMemory(VkBuffer buffer, VkMemoryPropertyFlags propertyFlags, VkMemoryPropertyFlags preferredFlags = 0)
+	{
+		VkMemoryRequirements memoryRequirements;
+		vkGetBufferMemoryRequirements(device, buffer, &memoryRequirements);
+
+		auto allocation = allocateDeviceMemory(memoryRequirements, propertyFlags, true, preferredFlags);
+
+		VkResult err = vkBindBufferMemory(device, buffer, allocation.deviceMemory, allocation.offset);
+		assert(err == VK_SUCCESS);
+
+		return allocation;
+	}
+
+	inline DeviceMemoryAllocation allocateImageMemory(VkImage image, VkMemoryPropertyFlags propertyFlags, bool linear, VkMemoryPropertyFlags preferredFlags = 0)
+	{
+		VkMemoryRequirements memoryRequirements;
+		vkGetImageMemoryRequirements(device, image, &memoryRequirements);
+
+		auto allocation = allocateDeviceMemory(memoryRequirements, propertyFlags, linear, preferredFlags);
+
+		VkResult err = vkBindImageMemory(device, image, allocation.deviceMemory, allocation.offset);
+		assert(err == VK_SUCCESS);
+
+		return allocation;
+	}
+
+	struct MemoryTypeStats {
+		uint32_t blockCount;
+		uint32_t dedicatedCount;
+		uint32_t allocationCount;
+		uint32_t freeRangeCount;
+		VkDeviceSize blockBytes;
+		VkDeviceSize usedBytes;
+		VkDeviceSize largestFreeRange;
+	};
+
+	struct MemoryStats {
+		MemoryTypeStats memoryTypes[VK_MAX_MEMORY_TYPES];
+		uint32_t deviceMemoryCount;
+		VkDeviceSize blockBytes;
+		VkDeviceSize usedBytes;
+	};
+
+	MemoryStats getMemoryStats();
+	void dumpMemoryStats(FILE *fp);
+};
+
+#endif // MEMORYALLOCATOR_H
@@ -0,0 +1,228 @@
+#include "pipeline.h"
+#include "pipelinecache.h"
+
+#include <cstring>
+
+using namespace vulkan;
+
+using std::lock_guard;
+using std::mutex;
+using std::shared_future;
+using std::vector;
+
+PipelineDescription::PipelineDescription(const ShaderProgram &shaderProgram, VkRenderPass renderPass, uint32_t subpass) :
+	shaderProgram(&shaderProgram),
+	renderPass(renderPass),
+	subpass(subpass),
+	topology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST),
+	polygonMode(VK_POLYGON_MODE_FILL),
+	cullMode(VK_CULL_MODE_BACK_BIT),
+	frontFace(VK_FRONT_FACE_CLOCKWISE),
+	depthTestEnable(true),
+	depthWriteEnable(true),
+	depthCompareOp(VK_COMPARE_OP_LESS_OR_EQUAL)
+{
+	if (!isCompute()) {
+		VkPipelineColorBlendAttachmentState blendAttachment = {};
+		blendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+		blendAttachment.blendEnable = VK_FALSE;
+		blendAttachments.push_back(blendAttachment);
+	}
+}
+
+static void hashCombine(size_t &seed, size_t value)
+{
+	seed ^= value + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
+
+// the Vulkan structs we hash this way are all 32-bit fields, so there's no padding to worry about
+template <typename T>
+static void hashCombine(size_t &seed, const vector<T> &values)
+{
+	hashCombine(seed, values.size());
+	auto bytes = reinterpret_cast<const uint8_t *>(values.data());
+	for (size_t i = 0; i < values.size() * sizeof(T); ++i)
+		hashCombine(seed, bytes[i]);
+}
+
+template <typename T>
+static bool equal(const vector<T> &a, const vector<T> &b)
+{
+	return a.size() == b.size() && (a.empty() || !memcmp(a.data(), b.data(), a.size() * sizeof(T)));
+}
+
+size_t PipelineDescription::hash() const
+{
+	size_t seed = 0;
+	hashCombine(seed, std::hash<const void *>()(shaderProgram));
+	hashCombine(seed, std::hash<const void *>()(reinterpret_cast<const void *>(renderPass)));
+	hashCombine(seed, subpass);
+	if (isCompute())
+		return seed;
+
+	hashCombine(seed, vertexBindings);
+	hashCombine(seed, vertexAttributes);
+	hashCombine(seed, topology);
+	hashCombine(seed, polygonMode);
+	hashCombine(seed, cullMode);
+	hashCombine(seed, frontFace);
+	hashCombine(seed, (depthTestEnable ? 1 : 0) | (depthWriteEnable ? 2 : 0));
+	hashCombine(seed, depthCompareOp);
+	hashCombine(seed, blendAttachments);
+	return seed;
+}
+
+bool PipelineDescription::operator==(const PipelineDescription &other) const
+{
+	if (shaderProgram != other.shaderProgram ||
+	    renderPass != other.renderPass ||
+	    subpass != other.subpass)
+		return false;
+
+	if (isCompute())
+		return true;
+
+	return equal(vertexBindings, other.vertexBindings) &&
+	       equal(vertexAttributes, other.vertexAttributes) &&
+	       topology == other.topology &&
+	       polygonMode == other.polygonMode &&
+	       cullMode == other.cullMode &&
+	       frontFace == other.frontFace &&
+	       depthTestEnable == other.depthTestEnable &&
+	       depthWriteEnable == other.depthWriteEnable &&
+	       depthCompareOp == other.depthCompareOp &&
+	       equal(blendAttachments, other.blendAttachments);
+}
+
+static VkPipeline createComputePipeline(const PipelineDescription &description)
+{
+	VkComputePipelineCreateInfo computePipelineCreateInfo = {};
+	computePipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+
+	auto stages = description.shaderProgram->getPipelineShaderStageCreateInfos();
+	assert(stages.size() == 1);
+	assert(stages[0].stage == VK_SHADER_STAGE_COMPUTE_BIT);
+
+	computePipelineCreateInfo.stage = stages[0];
+	computePipelineCreateInfo.layout = description.shaderProgram->getPipelineLayout();
+
+	VkPipeline computePipeline;
+	auto err = vkCreateComputePipelines(device, pipelineCache, 1, &computePipelineCreateInfo, nullptr, &computePipeline);
+	assert(err == VK_SUCCESS);
+	return computePipeline;
+}
+
+static VkPipeline createGraphicsPipeline(const PipelineDescription &description)
+{
+	VkPipelineVertexInputStateCreateInfo pipelineVertexInputStateCreateInfo = {};
+	pipelineVertexInputStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+	pipelineVertexInputStateCreateInfo.vertexBindingDescriptionCount = uint32_t(description.vertexBindings.size());
+	pipelineVertexInputStateCreateInfo.pVertexBindingDescriptions = description.vertexBindings.data();
+	pipelineVertexInputStateCreateInfo.vertexAttributeDescriptionCount = uint32_t(description.vertexAttributes.size());
+	pipelineVertexInputStateCreateInfo.pVertexAttributeDescriptions = description.vertexAttributes.data();
+
+	VkPipelineInputAssemblyStateCreateInfo pipelineInputAssemblyStateCreateInfo = {};
+	pipelineInputAssemblyStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	pipelineInputAssemblyStateCreateInfo.topology = description.topology;
+	pipelineInputAssemblyStateCreateInfo.primitiveRestartEnable = VK_FALSE;
+
+	VkPipelineRasterizationStateCreateInfo pipelineRasterizationStateCreateInfo = {};
+	pipelineRasterizationStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	pipelineRasterizationStateCreateInfo.polygonMode = description.polygonMode;
+	pipelineRasterizationStateCreateInfo.cullMode = description.cullMode;
+	pipelineRasterizationStateCreateInfo.frontFace = description.frontFace;
+	pipelineRasterizationStateCreateInfo.lineWidth = 1.0f;
+
+	VkPipelineColorBlendStateCreateInfo pipelineColorBlendStateCreateInfo = {};
+	pipelineColorBlendStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	pipelineColorBlendStateCreateInfo.attachmentCount = uint32_t(description.blendAttachments.size());
+	pipelineColorBlendStateCreateInfo.pAttachments = description.blendAttachments.data();
+
+	VkPipelineMultisampleStateCreateInfo pipelineMultisampleStateCreateInfo = {};
+	pipelineMultisampleStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	pipelineMultisampleStateCreateInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+	VkPipelineViewportStateCreateInfo pipelineViewportStateCreateInfo = {};
+	pipelineViewportStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	pipelineViewportStateCreateInfo.viewportCount = 1;
+	pipelineViewportStateCreateInfo.pViewports = nullptr;
+	pipelineViewportStateCreateInfo.scissorCount = 1;
+	pipelineViewportStateCreateInfo.pScissors = nullptr;
+
+	VkPipelineDepthStencilStateCreateInfo pipelineDepthStencilStateCreateInfo = {};
+	pipelineDepthStencilStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	pipelineDepthStencilStateCreateInfo.depthTestEnable = description.depthTestEnable ? VK_TRUE : VK_FALSE;
+	pipelineDepthStencilStateCreateInfo.depthWriteEnable = description.depthWriteEnable ? VK_TRUE : VK_FALSE;
+	pipelineDepthStencilStateCreateInfo.depthCompareOp = description.depthCompareOp;
+
+	VkDynamicState dynamicStateEnables[] = {
+		VK_DYNAMIC_STATE_VIEWPORT,
+		VK_DYNAMIC_STATE_SCISSOR
+	};
+
+	VkPipelineDynamicStateCreateInfo pipelineDynamicStateCreateInfo = {};
+	pipelineDynamicStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	pipelineDynamicStateCreateInfo.pDynamicStates = dynamicStateEnables;
+	pipelineDynamicStateCreateInfo.dynamicStateCount = ARRAY_SIZE(dynamicStateEnables);
+
+	VkGraphicsPipelineCreateInfo pipelineCreateInfo = {};
+	pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipelineCreateInfo.layout = description.shaderProgram->getPipelineLayout();
+	pipelineCreateInfo.renderPass = description.renderPass;
+	pipelineCreateInfo.subpass = description.subpass;
+	pipelineCreateInfo.pVertexInputState = &pipelineVertexInputStateCreateInfo;
+	pipelineCreateInfo.pInputAssemblyState = &pipelineInputAssemblyStateCreateInfo;
+	pipelineCreateInfo.pRasterizationState = &pipelineRasterizationStateCreateInfo;
+	pipelineCreateInfo.pColorBlendState = &pipelineColorBlendStateCreateInfo;
+	pipelineCreateInfo.pMultisampleState = &pipelineMultisampleStateCreateInfo;
+	pipelineCreateInfo.pViewportState = &pipelineViewportStateCreateInfo;
+	pipelineCreateInfo.pDepthStencilState = &pipelineDepthStencilStateCreateInfo;
+	pipelineCreateInfo.pDynamicState = &pipelineDynamicStateCreateInfo;
+
+	auto shaderStages = description.shaderProgram->getPipelineShaderStageCreateInfos();
+	pipelineCreateInfo.stageCount = uint32_t(shaderStages.size());
+	pipelineCreateInfo.pStages = shaderStages.data();
+
+	VkPipeline pipeline;
+	auto err = vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipeline);
+	assert(err == VK_SUCCESS);
+
+	return pipeline;
+}
+
+PipelineRegistry::PipelineRegistry(ThreadPool &threadPool) :
+	threadPool(threadPool)
+{
+}
+
+PipelineRegistry::~PipelineRegistry()
+{
+	finish();
+
+	for (auto &entry : pipelines)
+		vkDestroyPipeline(device, entry.second.get(), nullptr);
+}
+
+shared_future<VkPipeline> PipelineRegistry::request(const PipelineDescription &description)
+{
+	lock_guard<mutex> lock(pipelinesMutex);
+
+	auto it = pipelines.find(description);
+	if (it != pipelines.end())
+		return it->second;
+
+	// the task gets its own copy, as the caller's may be gone by the time it runs
+	shared_future<VkPipeline> pipeline = threadPool.enqueue([description]() {
+		return description.isCompute() ? createComputePipeline(description) : createGraphicsPipeline(description);
+	});
+
+	pipelines.emplace(description, pipeline);
+	return pipeline;
+}
+
+void PipelineRegistry::finish()
+{
+	lock_guard<mutex> lock(pipelinesMutex);
+	for (auto &entry : pipelines)
+		entry.second.wait();
+}
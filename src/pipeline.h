@@ -0,0 +1,87 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "vulkan.h"
+#include "shader.h"
+#include "core/threadpool.h"
+
+#include <future>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * Everything that goes into a pipeline, as a value that can be hashed
+ * and compared. Without a render pass, it describes a compute pipeline,
+ * and only the shader program matters.
+ *
+ * The shader program and render pass are compared by identity, and must
+ * outlive any pipeline created from the description.
+ */
+struct PipelineDescription {
+	PipelineDescription(const ShaderProgram &shaderProgram, VkRenderPass renderPass = VK_NULL_HANDLE, uint32_t subpass = 0);
+
+	bool isCompute() const { return renderPass == VK_NULL_HANDLE; }
+
+	size_t hash() const;
+	bool operator==(const PipelineDescription &other) const;
+
+	const ShaderProgram *shaderProgram;
+	VkRenderPass renderPass;
+	uint32_t subpass;
+
+	std::vector<VkVertexInputBindingDescription> vertexBindings;
+	std::vector<VkVertexInputAttributeDescription> vertexAttributes;
+	VkPrimitiveTopology topology;
+
+	VkPolygonMode polygonMode;
+	VkCullModeFlags cullMode;
+	VkFrontFace frontFace;
+
+	bool depthTestEnable, depthWriteEnable;
+	VkCompareOp depthCompareOp;
+
+	// one per color attachment of the subpass
+	std::vector<VkPipelineColorBlendAttachmentState> blendAttachments;
+
+	struct Hasher {
+		size_t operator()(const PipelineDescription &description) const
+		{
+			return description.hash();
+		}
+	};
+};
+
+/*
+ * Creates pipelines on worker threads, once per distinct description.
+ * request() never blocks; the pipeline is ready once the returned future
+ * is, so request early, and get() when it's first bound.
+ *
+ * Pipelines are created through vulkan::pipelineCache when there is one,
+ * and live as long as the registry.
+ */
+class PipelineRegistry {
+public:
+	explicit PipelineRegistry(ThreadPool &threadPool);
+	~PipelineRegistry();
+
+	PipelineRegistry(const PipelineRegistry &) = delete;
+	PipelineRegistry &operator=(const PipelineRegistry &) = delete;
+
+	std::shared_future<VkPipeline> request(const PipelineDescription &description);
+
+	static bool isReady(const std::shared_future<VkPipeline> &pipeline)
+	{
+		return pipeline.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+	}
+
+	// blocks until every requested pipeline has been created
+	void finish();
+
+private:
+	ThreadPool &threadPool;
+	std::mutex pipelinesMutex;
+	std::unordered_map<PipelineDescription, std::shared_future<VkPipeline>, PipelineDescription::Hasher> pipelines;
+};
+
+#endif // PIPELINE_H
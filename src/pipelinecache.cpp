@@ -0,0 +1,176 @@
+#include "pipelinecache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#ifdef WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+using std::string;
+using std::vector;
+
+VkPipelineCache vulkan::pipelineCache = VK_NULL_HANDLE;
+
+/*
+ * The blob from vkGetPipelineCacheData() starts with the vendor, device
+ * and pipelineCacheUUID, but not the driver version; drivers are supposed
+ * to reject stale data themselves, but not all of them do a good job of
+ * it. So we wrap it in our own header, and check that first.
+ */
+struct PipelineCacheFileHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t vendorID;
+	uint32_t deviceID;
+	uint32_t driverVersion;
+	uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+	uint64_t dataSize;
+	uint64_t dataHash;
+};
+
+static const char pipelineCacheMagic[4] = { 'E', 'L', 'P', 'C' };
+static const uint32_t pipelineCacheVersion = 1;
+
+// FNV-1a, to catch truncated or otherwise damaged files
+static uint64_t hashData(const uint8_t *data, size_t size)
+{
+	auto hash = uint64_t(14695981039346656037ull);
+	for (size_t i = 0; i < size; ++i) {
+		hash ^= data[i];
+		hash *= uint64_t(1099511628211ull);
+	}
+	return hash;
+}
+
+static PipelineCacheFileHeader getExpectedHeader()
+{
+	PipelineCacheFileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, pipelineCacheMagic, sizeof(header.magic));
+	header.version = pipelineCacheVersion;
+	header.vendorID = vulkan::deviceProperties.vendorID;
+	header.deviceID = vulkan::deviceProperties.deviceID;
+	header.driverVersion = vulkan::deviceProperties.driverVersion;
+	memcpy(header.pipelineCacheUUID, vulkan::deviceProperties.pipelineCacheUUID, VK_UUID_SIZE);
+	return header;
+}
+
+static vector<uint8_t> readPipelineCacheFile(const string &path)
+{
+	vector<uint8_t> data;
+
+	auto fp = fopen(path.c_str(), "rb");
+	if (!fp)
+		return data;
+
+	PipelineCacheFileHeader header;
+	auto expected = getExpectedHeader();
+	if (fread(&header, sizeof(header), 1, fp) == 1 &&
+	    !memcmp(header.magic, expected.magic, sizeof(header.magic)) &&
+	    header.version == expected.version &&
+	    header.vendorID == expected.vendorID &&
+	    header.deviceID == expected.deviceID &&
+	    header.driverVersion == expected.driverVersion &&
+	    !memcmp(header.pipelineCacheUUID, expected.pipelineCacheUUID, VK_UUID_SIZE)) {
+		// a damaged size must not get as far as allocating, so it has to match what's left of the file
+		auto dataStart = ftell(fp);
+		auto dataEnd = fseek(fp, 0, SEEK_END) == 0 ? ftell(fp) : -1L;
+		if (dataStart >= 0 && dataEnd >= dataStart &&
+		    header.dataSize == uint64_t(dataEnd - dataStart) &&
+		    fseek(fp, dataStart, SEEK_SET) == 0) {
+			data.resize(size_t(header.dataSize));
+			if (fread(data.data(), 1, data.size(), fp) != data.size() ||
+			    hashData(data.data(), data.size()) != header.dataHash)
+				data.clear();
+		}
+	}
+
+	fclose(fp);
+	return data;
+}
+
+static bool replaceFile(const string &src, const string &dst)
+{
+#ifdef WIN32
+	return MoveFileExA(src.c_str(), dst.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+	return rename(src.c_str(), dst.c_str()) == 0;
+#endif
+}
+
+static void writePipelineCacheFile(const string &path, const vector<uint8_t> &data)
+{
+	auto header = getExpectedHeader();
+	header.dataSize = data.size();
+	header.dataHash = hashData(data.data(), data.size());
+
+	auto tempPath = path + ".tmp";
+	auto fp = fopen(tempPath.c_str(), "wb");
+	if (!fp)
+		return;
+
+	auto ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+	          fwrite(data.data(), 1, data.size(), fp) == data.size() &&
+	          fflush(fp) == 0;
+
+	// make sure the data hits the disk before the rename does
+#ifdef WIN32
+	ok = ok && _commit(_fileno(fp)) == 0;
+#else
+	ok = ok && fsync(fileno(fp)) == 0;
+#endif
+
+	ok = fclose(fp) == 0 && ok;
+
+	// a missing cache only costs some startup-time, so don't make a fuss
+	if (!ok || !replaceFile(tempPath, path))
+		remove(tempPath.c_str());
+}
+
+void vulkan::pipelineCacheInit(const string &path)
+{
+	assert(pipelineCache == VK_NULL_HANDLE);
+
+	auto initialData = readPipelineCacheFile(path);
+
+	VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {};
+	pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	pipelineCacheCreateInfo.initialDataSize = initialData.size();
+	pipelineCacheCreateInfo.pInitialData = initialData.data();
+
+	VkResult err = vkCreatePipelineCache(device, &pipelineCacheCreateInfo, nullptr, &pipelineCache);
+	if (err != VK_SUCCESS && !initialData.empty()) {
+		// the driver didn't like it after all
+		pipelineCacheCreateInfo.initialDataSize = 0;
+		pipelineCacheCreateInfo.pInitialData = nullptr;
+		err = vkCreatePipelineCache(device, &pipelineCacheCreateInfo, nullptr, &pipelineCache);
+	}
+	assert(err == VK_SUCCESS);
+}
+
+void vulkan::pipelineCacheShutdown(const string &path)
+{
+	if (pipelineCache == VK_NULL_HANDLE)
+		return;
+
+	size_t dataSize = 0;
+	VkResult err = vkGetPipelineCacheData(device, pipelineCache, &dataSize, nullptr);
+	assert(err == VK_SUCCESS);
+
+	vector<uint8_t> data(dataSize);
+	err = vkGetPipelineCacheData(device, pipelineCache, &dataSize, data.data());
+	assert(err == VK_SUCCESS || err == VK_INCOMPLETE);
+	data.resize(dataSize);
+
+	if (err == VK_SUCCESS && !data.empty())
+		writePipelineCacheFile(path, data);
+
+	vkDestroyPipelineCache(device, pipelineCache, nullptr);
+	pipelineCache = VK_NULL_HANDLE;
+}
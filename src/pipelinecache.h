@@ -0,0 +1,28 @@
+#ifndef PIPELINECACHE_H
+#define PIPELINECACHE_H
+
+#include "vulkan.h"
+
+#include <string>
+
+namespace vulkan
+{
+	// pass to vkCreate*Pipelines; VK_NULL_HANDLE until pipelineCacheInit()
+	extern VkPipelineCache pipelineCache;
+
+	/*
+	 * Creates the process-wide pipeline cache, seeded from path if that
+	 * holds a cache written by the same device and driver. Anything else
+	 * is ignored, and we start out empty.
+	 */
+	void pipelineCacheInit(const std::string &path);
+
+	/*
+	 * Writes the cache to path, through a temporary file that's renamed
+	 * into place, so a crash never leaves a truncated cache behind. Then
+	 * destroys it.
+	 */
+	void pipelineCacheShutdown(const std::string &path);
+};
+
+#endif // PIPELINECACHE_H
@@ -0,0 +1,324 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+
+using namespace vulkan;
+
+using std::string;
+using std::vector;
+using std::runtime_error;
+
+static const size_t historySize = 256;
+static const size_t maxTraceEvents = 1 << 20;
+
+static const char *statisticNames[] = {
+	"vertices", "primitives", "vs", "clipped", "fs", "cs"
+};
+
+static VkQueryPool createQueryPool(VkQueryType queryType, uint32_t queryCount, VkQueryPipelineStatisticFlags pipelineStatistics = 0)
+{
+	VkQueryPoolCreateInfo queryPoolCreateInfo = {};
+	queryPoolCreateInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	queryPoolCreateInfo.queryType = queryType;
+	queryPoolCreateInfo.queryCount = queryCount;
+	queryPoolCreateInfo.pipelineStatistics = pipelineStatistics;
+
+	VkQueryPool queryPool;
+	VkResult err = vkCreateQueryPool(device, &queryPoolCreateInfo, nullptr, &queryPool);
+	assert(err == VK_SUCCESS);
+	return queryPool;
+}
+
+Profiler::Profiler(int framesInFlight, bool pipelineStatistics, bool captureTrace, uint32_t maxScopes) :
+	frames(framesInFlight),
+	maxScopes(maxScopes),
+	frameCounter(0),
+	statisticFlags(0),
+	statisticCount(0),
+	epoch(std::chrono::steady_clock::now()),
+	haveGpuOffset(false),
+	gpuOffset(0.0),
+	captureTrace(captureTrace)
+{
+	if (pipelineStatistics && enabledFeatures.pipelineStatisticsQuery) {
+		// the results come back in bit-order, which is also the order of statisticNames
+		statisticFlags = VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+		                 VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+		                 VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+		                 VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+		                 VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT |
+		                 VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+		statisticCount = ARRAY_SIZE(statisticNames);
+	}
+
+	uint32_t queueCount;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueCount, nullptr);
+	vector<VkQueueFamilyProperties> props(queueCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueCount, props.data());
+	for (auto &queueFamilyProperties : props) {
+		timestampValidBits.push_back(queueFamilyProperties.timestampValidBits);
+		graphicsCapable.push_back((queueFamilyProperties.queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0);
+	}
+
+	for (auto &frameData : frames) {
+		frameData.timestampPool = createQueryPool(VK_QUERY_TYPE_TIMESTAMP, maxScopes * 2);
+		frameData.statisticsPool = statisticFlags ? createQueryPool(VK_QUERY_TYPE_PIPELINE_STATISTICS, maxScopes, statisticFlags) : VK_NULL_HANDLE;
+		frameData.timestampCount = 0;
+		frameData.statisticsCount = 0;
+		frameData.frameIndex = -1;
+		frameData.statisticsScope = SIZE_MAX;
+	}
+}
+
+Profiler::~Profiler()
+{
+	for (auto &frameData : frames) {
+		vkDestroyQueryPool(device, frameData.timestampPool, nullptr);
+		if (frameData.statisticsPool != VK_NULL_HANDLE)
+			vkDestroyQueryPool(device, frameData.statisticsPool, nullptr);
+	}
+}
+
+double Profiler::cpuTime() const
+{
+	return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void Profiler::beginFrame(int frame, VkCommandBuffer commandBuffer)
+{
+	auto &frameData = frames[frame];
+	assert(frameData.stack.empty());
+
+	resolve(frameData);
+
+	frameData.frameIndex = frameCounter++;
+	frameData.scopes.clear();
+	frameData.timestampCount = 0;
+	frameData.statisticsCount = 0;
+	frameData.statisticsScope = SIZE_MAX;
+
+	vkCmdResetQueryPool(commandBuffer, frameData.timestampPool, 0, maxScopes * 2);
+	if (frameData.statisticsPool != VK_NULL_HANDLE)
+		vkCmdResetQueryPool(commandBuffer, frameData.statisticsPool, 0, maxScopes);
+}
+
+void Profiler::beginScope(int frame, VkCommandBuffer commandBuffer, const char *name, uint32_t queueFamilyIndex)
+{
+	auto &frameData = frames[frame];
+
+	Scope scope;
+	scope.name = frameData.stack.empty() ? name : frameData.scopes[frameData.stack.back()].name + "/" + name;
+	scope.queueFamilyIndex = queueFamilyIndex;
+	scope.timestampQuery = UINT32_MAX;
+	scope.statisticsQuery = UINT32_MAX;
+
+	if (commandBuffer != VK_NULL_HANDLE) {
+		// out of queries or no timestamps on this queue: fall back to CPU-only
+		if (timestampValidBits[queueFamilyIndex] != 0 && frameData.timestampCount + 2 <= maxScopes * 2) {
+			scope.timestampQuery = frameData.timestampCount;
+			frameData.timestampCount += 2;
+			vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, frameData.timestampPool, scope.timestampQuery);
+		}
+
+		// only one statistics query can be active at a time, so nested scopes go without
+		if (frameData.statisticsPool != VK_NULL_HANDLE &&
+		    graphicsCapable[queueFamilyIndex] &&
+		    frameData.statisticsScope == SIZE_MAX &&
+		    frameData.statisticsCount < maxScopes) {
+			scope.statisticsQuery = frameData.statisticsCount++;
+			frameData.statisticsScope = frameData.scopes.size();
+			vkCmdBeginQuery(commandBuffer, frameData.statisticsPool, scope.statisticsQuery, 0);
+		}
+	}
+
+	scope.cpuBegin = cpuTime();
+	scope.cpuEnd = scope.cpuBegin;
+
+	frameData.stack.push_back(frameData.scopes.size());
+	frameData.scopes.push_back(scope);
+}
+
+void Profiler::endScope(int frame, VkCommandBuffer commandBuffer)
+{
+	auto &frameData = frames[frame];
+	assert(!frameData.stack.empty());
+
+	auto index = frameData.stack.back();
+	frameData.stack.pop_back();
+
+	auto &scope = frameData.scopes[index];
+	scope.cpuEnd = cpuTime();
+
+	if (scope.statisticsQuery != UINT32_MAX) {
+		vkCmdEndQuery(commandBuffer, frameData.statisticsPool, scope.statisticsQuery);
+		frameData.statisticsScope = SIZE_MAX;
+	}
+
+	if (scope.timestampQuery != UINT32_MAX)
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, frameData.timestampPool, scope.timestampQuery + 1);
+}
+
+static void pushHistory(vector<double> &samples, size_t &next, double value)
+{
+	if (samples.size() < historySize)
+		samples.push_back(value);
+	else
+		samples[next] = value;
+	next = (next + 1) % historySize;
+}
+
+void Profiler::resolve(FrameData &frameData)
+{
+	if (frameData.frameIndex < 0 || frameData.scopes.empty())
+		return;
+
+	/*
+	 * No WAIT_BIT: the fence has been waited for, so anything that isn't
+	 * available by now was never submitted, and we'd rather drop the
+	 * frame's GPU timings than hang.
+	 */
+	vector<uint64_t> timestamps(frameData.timestampCount);
+	auto haveTimestamps = frameData.timestampCount > 0 &&
+		vkGetQueryPoolResults(device, frameData.timestampPool,
+			0, frameData.timestampCount,
+			timestamps.size() * sizeof(uint64_t), timestamps.data(), sizeof(uint64_t),
+			VK_QUERY_RESULT_64_BIT) == VK_SUCCESS;
+
+	vector<uint64_t> statistics(frameData.statisticsCount * statisticCount);
+	auto haveStatistics = frameData.statisticsCount > 0 &&
+		vkGetQueryPoolResults(device, frameData.statisticsPool,
+			0, frameData.statisticsCount,
+			statistics.size() * sizeof(uint64_t), statistics.data(), statisticCount * sizeof(uint64_t),
+			VK_QUERY_RESULT_64_BIT) == VK_SUCCESS;
+
+	auto timestampPeriod = double(deviceProperties.limits.timestampPeriod) / 1000.0; // microseconds per tick
+
+	if (haveTimestamps && !haveGpuOffset) {
+		/*
+		 * Anchor the GPU clock so the frame's first timestamp lines up with
+		 * when recording finished, which is roughly when it got submitted.
+		 * That's only an estimate, but good enough to line up the tracks.
+		 */
+		auto firstGpu = UINT64_MAX;
+		auto lastCpu = 0.0;
+		for (auto &scope : frameData.scopes) {
+			if (scope.timestampQuery != UINT32_MAX)
+				firstGpu = std::min(firstGpu, timestamps[scope.timestampQuery]);
+			lastCpu = std::max(lastCpu, scope.cpuEnd);
+		}
+
+		if (firstGpu != UINT64_MAX) {
+			gpuOffset = lastCpu - firstGpu * timestampPeriod;
+			haveGpuOffset = true;
+		}
+	}
+
+	for (auto &scope : frameData.scopes) {
+		auto &scopeHistory = history[scope.name];
+		if (scopeHistory.gpu.empty() && scopeHistory.cpu.empty()) {
+			scopeHistory.gpuNext = 0;
+			scopeHistory.cpuNext = 0;
+		}
+
+		pushHistory(scopeHistory.cpu, scopeHistory.cpuNext, (scope.cpuEnd - scope.cpuBegin) / 1000.0);
+
+		vector<uint64_t> scopeStatistics;
+		if (haveStatistics && scope.statisticsQuery != UINT32_MAX) {
+			auto first = statistics.begin() + scope.statisticsQuery * statisticCount;
+			scopeStatistics.assign(first, first + statisticCount);
+			scopeHistory.statistics = scopeStatistics;
+		}
+
+		if (captureTrace && traceEvents.size() < maxTraceEvents) {
+			TraceEvent event = { scope.name, frameData.frameIndex, 0, scope.cpuBegin, scope.cpuEnd - scope.cpuBegin };
+			traceEvents.push_back(event);
+		}
+
+		if (!haveTimestamps || scope.timestampQuery == UINT32_MAX)
+			continue;
+
+		auto validBits = timestampValidBits[scope.queueFamilyIndex];
+		auto mask = validBits >= 64 ? UINT64_MAX : (uint64_t(1) << validBits) - 1;
+		auto begin = timestamps[scope.timestampQuery];
+		auto ticks = (timestamps[scope.timestampQuery + 1] - begin) & mask;
+		auto duration = ticks * timestampPeriod;
+
+		pushHistory(scopeHistory.gpu, scopeHistory.gpuNext, duration / 1000.0);
+
+		if (captureTrace && traceEvents.size() < maxTraceEvents) {
+			TraceEvent event = { scope.name, frameData.frameIndex, 1 + scope.queueFamilyIndex, gpuOffset + begin * timestampPeriod, duration, scopeStatistics };
+			traceEvents.push_back(event);
+		}
+	}
+
+	frameData.scopes.clear();
+}
+
+static void summarize(vector<double> samples, double &min, double &avg, double &p99)
+{
+	std::sort(samples.begin(), samples.end());
+	min = samples.front();
+	avg = std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size();
+	p99 = samples[std::min(samples.size() - 1, samples.size() * 99 / 100)];
+}
+
+void Profiler::printSummary(FILE *fp) const
+{
+	fprintf(fp, "%-32s %26s %26s\n", "scope", "gpu min/avg/p99 (ms)", "cpu min/avg/p99 (ms)");
+	for (auto &entry : history) {
+		auto &scopeHistory = entry.second;
+		fprintf(fp, "%-32s", entry.first.c_str());
+
+		double min, avg, p99;
+		if (!scopeHistory.gpu.empty()) {
+			summarize(scopeHistory.gpu, min, avg, p99);
+			fprintf(fp, "   %7.3f %7.3f %7.3f", min, avg, p99);
+		} else
+			fprintf(fp, " %26s", "-");
+
+		summarize(scopeHistory.cpu, min, avg, p99);
+		fprintf(fp, "   %7.3f %7.3f %7.3f", min, avg, p99);
+
+		for (size_t i = 0; i < scopeHistory.statistics.size(); ++i)
+			fprintf(fp, " %s=%llu", statisticNames[i], (unsigned long long)scopeHistory.statistics[i]);
+
+		fprintf(fp, "\n");
+	}
+}
+
+static void writeJsonString(FILE *fp, const string &str)
+{
+	fputc('"', fp);
+	for (auto c : str) {
+		if (c == '"' || c == '\\')
+			fputc('\\', fp);
+		fputc(c, fp);
+	}
+	fputc('"', fp);
+}
+
+void Profiler::writeChromeTrace(const string &filename) const
+{
+	auto fp = fopen(filename.c_str(), "w");
+	if (!fp)
+		throw runtime_error("failed to open trace file!");
+
+	fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	fprintf(fp, "{\"ph\":\"M\",\"pid\":0,\"tid\":0,\"name\":\"thread_name\",\"args\":{\"name\":\"CPU\"}}");
+	for (size_t i = 0; i < timestampValidBits.size(); ++i)
+		fprintf(fp, ",\n{\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"name\":\"thread_name\",\"args\":{\"name\":\"GPU queue-family %u\"}}", unsigned(i + 1), unsigned(i));
+
+	for (auto &event : traceEvents) {
+		fprintf(fp, ",\n{\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"name\":", event.tid);
+		writeJsonString(fp, event.name);
+		fprintf(fp, ",\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%d", event.begin, event.duration, event.frameIndex);
+		for (size_t i = 0; i < event.statistics.size(); ++i)
+			fprintf(fp, ",\"%s\":%llu", statisticNames[i], (unsigned long long)event.statistics[i]);
+		fprintf(fp, "}}");
+	}
+
+	fprintf(fp, "\n]}\n");
+	fclose(fp);
+}
@@ -0,0 +1,95 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "vulkan.h"
+
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+/*
+ * Times nested scopes of command-buffer recording, both on the CPU and
+ * on the GPU, with one timestamp query pool per frame in flight. Scopes
+ * on graphics-capable queues can also collect pipeline statistics.
+ *
+ * Call beginFrame() once the frame's fence has been waited for, with a
+ * command buffer that's submitted before any of the frame's scopes; it
+ * picks up the results from the previous use of the slot. Scopes may be
+ * spread over several command buffers and queues, as long as each scope
+ * begins and ends in the same one. Passing a null command buffer gives
+ * a CPU-only scope.
+ */
+class Profiler {
+public:
+	Profiler(int framesInFlight, bool pipelineStatistics, bool captureTrace, uint32_t maxScopes = 64);
+	~Profiler();
+
+	Profiler(const Profiler &) = delete;
+	Profiler &operator=(const Profiler &) = delete;
+
+	void beginFrame(int frame, VkCommandBuffer commandBuffer);
+
+	void beginScope(int frame, VkCommandBuffer commandBuffer, const char *name, uint32_t queueFamilyIndex = vulkan::graphicsQueueIndex);
+	void endScope(int frame, VkCommandBuffer commandBuffer);
+
+	// min/avg/p99 over the last frames, per scope
+	void printSummary(FILE *fp) const;
+
+	// Chrome trace-event JSON, for chrome://tracing or Perfetto
+	void writeChromeTrace(const std::string &filename) const;
+
+private:
+	struct Scope {
+		std::string name;
+		uint32_t queueFamilyIndex;
+		uint32_t timestampQuery, statisticsQuery; // UINT32_MAX if none
+		double cpuBegin, cpuEnd;
+	};
+
+	struct FrameData {
+		VkQueryPool timestampPool, statisticsPool;
+		uint32_t timestampCount, statisticsCount;
+		int frameIndex;
+		std::vector<Scope> scopes;
+		std::vector<size_t> stack;
+		size_t statisticsScope;
+	};
+
+	struct History {
+		std::vector<double> gpu, cpu; // milliseconds
+		size_t gpuNext, cpuNext;
+		std::vector<uint64_t> statistics; // from the latest frame
+	};
+
+	struct TraceEvent {
+		std::string name;
+		int frameIndex;
+		uint32_t tid;
+		double begin, duration; // microseconds
+		std::vector<uint64_t> statistics;
+	};
+
+	void resolve(FrameData &frameData);
+	double cpuTime() const;
+
+	std::vector<FrameData> frames;
+	uint32_t maxScopes;
+	int frameCounter;
+	VkQueryPipelineStatisticFlags statisticFlags;
+	uint32_t statisticCount;
+	std::vector<uint32_t> timestampValidBits;
+	std::vector<bool> graphicsCapable;
+
+	std::chrono::steady_clock::time_point epoch;
+	bool haveGpuOffset;
+	double gpuOffset;
+
+	std::map<std::string, History> history;
+
+	bool captureTrace;
+	std::vector<TraceEvent> traceEvents;
+};
+
+#endif // PROFILER_H
@@ -0,0 +1,99 @@
+#ifndef ASSETPACK_FORMAT_H
+#define ASSETPACK_FORMAT_H
+
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+
+/*
+ * On-disk layout of an asset pack, shared between the runtime and the
+ * baker. All fields are little-endian.
+ *
+ *   AssetPackHeader
+ *   AssetPackTexture[textureCount], sorted by name
+ *   string table: NUL-terminated names
+ *   texel data, each texture starting on an ASSETPACK_DATA_ALIGNMENT boundary
+ *
+ * A texture's data holds every subresource in upload order; array layer
+ * by array layer (cube faces in +X, -X, +Y, -Y, +Z, -Z order), and mip
+ * level by mip level within each layer. Subresources are tightly packed
+ * in their final format, each starting on an ASSETPACK_DATA_ALIGNMENT
+ * boundary, so they can be copied into staging memory as-is.
+ */
+
+#define ASSETPACK_MAGIC "ELAP"
+#define ASSETPACK_VERSION 1
+#define ASSETPACK_DATA_ALIGNMENT 16
+
+struct AssetPackHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t textureCount;
+	uint32_t stringTableSize;
+};
+
+struct AssetPackTexture {
+	uint32_t nameOffset; // into the string table
+	uint32_t format; // VkFormat
+	uint32_t viewType; // VkImageViewType; 2D, 2D_ARRAY or CUBE
+	uint32_t width, height;
+	uint16_t mipLevels, arrayLayers;
+	uint64_t dataOffset; // from the start of the file
+	uint64_t dataSize;
+};
+
+static_assert(sizeof(AssetPackHeader) == 16, "unexpected padding");
+static_assert(sizeof(AssetPackTexture) == 40, "unexpected padding");
+
+inline uint64_t assetPackAlign(uint64_t offset)
+{
+	return (offset + ASSETPACK_DATA_ALIGNMENT - 1) & ~uint64_t(ASSETPACK_DATA_ALIGNMENT - 1);
+}
+
+// size of a texel block, in texels and bytes; returns false for formats packs can't hold
+inline bool assetPackFormatBlock(VkFormat format, uint32_t *blockWidth, uint32_t *blockHeight, uint32_t *blockSize)
+{
+	*blockWidth = *blockHeight = 1;
+	switch (format) {
+	case VK_FORMAT_R8G8B8A8_UNORM:
+	case VK_FORMAT_R8G8B8A8_SRGB:
+	case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
+	case VK_FORMAT_E5B9G9R9_UFLOAT_PACK32:
+		*blockSize = 4;
+		return true;
+
+	case VK_FORMAT_R16G16B16A16_SFLOAT:
+		*blockSize = 8;
+		return true;
+
+	case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+	case VK_FORMAT_BC4_UNORM_BLOCK:
+		*blockWidth = *blockHeight = 4;
+		*blockSize = 8;
+		return true;
+
+	case VK_FORMAT_BC3_UNORM_BLOCK:
+	case VK_FORMAT_BC5_UNORM_BLOCK:
+	case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+	case VK_FORMAT_BC7_UNORM_BLOCK:
+		*blockWidth = *blockHeight = 4;
+		*blockSize = 16;
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+// tightly packed size of one subresource; partial blocks at the edges count as whole ones
+inline uint64_t assetPackSubresourceSize(VkFormat format, uint32_t width, uint32_t height)
+{
+	uint32_t blockWidth, blockHeight, blockSize;
+	if (!assetPackFormatBlock(format, &blockWidth, &blockHeight, &blockSize))
+		return 0;
+
+	uint64_t blocksX = (width + blockWidth - 1) / blockWidth;
+	uint64_t blocksY = (height + blockHeight - 1) / blockHeight;
+	return blocksX * blocksY * blockSize;
+}
+
+#endif // ASSETPACK_FORMAT_H
@@ -0,0 +1,201 @@
+#include "assetpack.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+using std::max;
+using std::make_unique;
+using std::runtime_error;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+// total size of a texture's data, including the padding between subresources
+static uint64_t getDataSize(const AssetPackTexture &entry)
+{
+	auto format = VkFormat(entry.format);
+	uint64_t size = 0;
+	for (auto arrayLayer = 0; arrayLayer < entry.arrayLayers; ++arrayLayer) {
+		for (auto mipLevel = 0; mipLevel < entry.mipLevels; ++mipLevel) {
+			size = assetPackAlign(size);
+			size += assetPackSubresourceSize(format,
+			    TextureBase::mipSize(entry.width, mipLevel),
+			    TextureBase::mipSize(entry.height, mipLevel));
+		}
+	}
+	return size;
+}
+
+static void validateTexture(const AssetPackTexture &entry, uint32_t stringTableSize, uint64_t fileSize)
+{
+	uint32_t blockWidth, blockHeight, blockSize;
+	if (!assetPackFormatBlock(VkFormat(entry.format), &blockWidth, &blockHeight, &blockSize))
+		throw runtime_error("asset pack: unsupported texture format");
+
+	if (entry.nameOffset >= stringTableSize ||
+	    entry.width == 0 || entry.width > INT_MAX ||
+	    entry.height == 0 || entry.height > INT_MAX ||
+	    entry.mipLevels == 0 || entry.mipLevels > TextureBase::maxMipLevels(max(entry.width, entry.height)) ||
+	    entry.arrayLayers == 0)
+		throw runtime_error("asset pack: malformed texture entry");
+
+	switch (VkImageViewType(entry.viewType)) {
+	case VK_IMAGE_VIEW_TYPE_2D:
+		if (entry.arrayLayers != 1)
+			throw runtime_error("asset pack: malformed texture entry");
+		break;
+
+	case VK_IMAGE_VIEW_TYPE_2D_ARRAY:
+		break;
+
+	case VK_IMAGE_VIEW_TYPE_CUBE:
+		if (entry.arrayLayers != 6 || entry.width != entry.height)
+			throw runtime_error("asset pack: malformed texture entry");
+		break;
+
+	default:
+		throw runtime_error("asset pack: unsupported texture type");
+	}
+
+	if (entry.dataOffset % ASSETPACK_DATA_ALIGNMENT != 0 ||
+	    entry.dataOffset > fileSize ||
+	    entry.dataSize > fileSize - entry.dataOffset ||
+	    entry.dataSize != getDataSize(entry))
+		throw runtime_error("asset pack: texture data out of bounds");
+}
+
+AssetPack::AssetPack(const string &path) :
+	file(path, 0, MemoryMappedFile::WHOLE_FILE, MemoryMappedFile::AccessPattern::RANDOM)
+{
+	auto data = static_cast<const uint8_t *>(file.getData());
+	auto size = file.getSize();
+
+	AssetPackHeader header;
+	if (size < sizeof(header))
+		throw runtime_error("asset pack: truncated file");
+	memcpy(&header, data, sizeof(header));
+
+	if (memcmp(header.magic, ASSETPACK_MAGIC, sizeof(header.magic)))
+		throw runtime_error("asset pack: bad magic");
+	if (header.version != ASSETPACK_VERSION)
+		throw runtime_error("asset pack: unsupported version");
+
+	auto tocSize = uint64_t(header.textureCount) * sizeof(AssetPackTexture);
+	if (sizeof(header) + tocSize + header.stringTableSize > size)
+		throw runtime_error("asset pack: truncated file");
+
+	textures = reinterpret_cast<const AssetPackTexture *>(data + sizeof(header));
+	textureCount = header.textureCount;
+	stringTable = reinterpret_cast<const char *>(data + sizeof(header) + tocSize);
+
+	if (textureCount > 0 &&
+	    (header.stringTableSize == 0 || stringTable[header.stringTableSize - 1] != '\0'))
+		throw runtime_error("asset pack: malformed string table");
+
+	for (uint32_t i = 0; i < textureCount; ++i) {
+		validateTexture(textures[i], header.stringTableSize, size);
+
+		// findTexture() relies on this
+		if (i > 0 && strcmp(getName(textures[i - 1]), getName(textures[i])) >= 0)
+			throw runtime_error("asset pack: table of contents isn't sorted");
+	}
+}
+
+const AssetPackTexture *AssetPack::findTexture(const string &name) const
+{
+	auto end = textures + textureCount;
+	auto it = std::lower_bound(textures, end, name.c_str(),
+		[this](const AssetPackTexture &entry, const char *name) {
+			return strcmp(getName(entry), name) < 0;
+		});
+
+	if (it == end || strcmp(getName(*it), name.c_str()) != 0)
+		return nullptr;
+
+	return it;
+}
+
+bool AssetPack::isTextureSupported(const string &name) const
+{
+	auto entry = findTexture(name);
+	return entry && vulkan::formatSupported(VkFormat(entry->format), VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT);
+}
+
+const AssetPackTexture &AssetPack::getTexture(const string &name, VkImageViewType viewType) const
+{
+	auto entry = findTexture(name);
+	if (!entry)
+		throw runtime_error("asset pack: no such texture: " + name);
+
+	if (VkImageViewType(entry->viewType) != viewType)
+		throw runtime_error("asset pack: unexpected texture type: " + name);
+
+	return *entry;
+}
+
+void AssetPack::stageTexture(UploadBatch &uploadBatch, TextureBase &texture, const AssetPackTexture &entry, int firstMipLevel) const
+{
+	assert(0 <= firstMipLevel && firstMipLevel < entry.mipLevels);
+	assert(texture.getMipLevels() == entry.mipLevels - firstMipLevel);
+	assert(texture.getWidth() == TextureBase::mipSize(entry.width, firstMipLevel));
+	assert(texture.getHeight() == TextureBase::mipSize(entry.height, firstMipLevel));
+
+	struct Subresource {
+		int mipLevel, arrayLayer;
+		uint64_t offset, size;
+	};
+
+	vector<Subresource> subresources;
+	uint64_t offset = 0;
+	for (auto arrayLayer = 0; arrayLayer < entry.arrayLayers; ++arrayLayer) {
+		for (auto mipLevel = 0; mipLevel < entry.mipLevels; ++mipLevel) {
+			auto size = assetPackSubresourceSize(VkFormat(entry.format),
+			    TextureBase::mipSize(entry.width, mipLevel),
+			    TextureBase::mipSize(entry.height, mipLevel));
+
+			offset = assetPackAlign(offset);
+			if (mipLevel >= firstMipLevel)
+				subresources.push_back({ mipLevel, arrayLayer, offset, size });
+			offset += size;
+		}
+	}
+	assert(offset == entry.dataSize);
+
+	// start paging in everything from the first subresource on, rather than faulting in one page at a time
+	auto start = subresources.front().offset;
+	file.prefetch(size_t(entry.dataOffset + start), size_t(entry.dataSize - start));
+
+	auto data = static_cast<const uint8_t *>(file.getData()) + entry.dataOffset;
+	for (auto &subresource : subresources)
+		memcpy(uploadBatch.stageImage(texture, subresource.mipLevel - firstMipLevel, subresource.arrayLayer, subresource.size), data + subresource.offset, size_t(subresource.size));
+}
+
+unique_ptr<Texture2D> AssetPack::loadTexture2D(UploadBatch &uploadBatch, const string &name) const
+{
+	auto &entry = getTexture(name, VK_IMAGE_VIEW_TYPE_2D);
+	auto texture = make_unique<Texture2D>(VkFormat(entry.format), entry.width, entry.height, entry.mipLevels, 1, true);
+	texture->setResidencyCategory(TEXTURE_CATEGORY_ASSET_PACK);
+	stageTexture(uploadBatch, *texture, entry);
+	return texture;
+}
+
+unique_ptr<Texture2DArray> AssetPack::loadTexture2DArray(UploadBatch &uploadBatch, const string &name) const
+{
+	auto &entry = getTexture(name, VK_IMAGE_VIEW_TYPE_2D_ARRAY);
+	auto texture = make_unique<Texture2DArray>(VkFormat(entry.format), entry.width, entry.height, entry.arrayLayers, entry.mipLevels, true);
+	texture->setResidencyCategory(TEXTURE_CATEGORY_ASSET_PACK);
+	stageTexture(uploadBatch, *texture, entry);
+	return texture;
+}
+
+unique_ptr<TextureCube> AssetPack::loadTextureCube(UploadBatch &uploadBatch, const string &name) const
+{
+	auto &entry = getTexture(name, VK_IMAGE_VIEW_TYPE_CUBE);
+	auto texture = make_unique<TextureCube>(VkFormat(entry.format), entry.width, entry.mipLevels);
+	texture->setResidencyCategory(TEXTURE_CATEGORY_ASSET_PACK);
+	stageTexture(uploadBatch, *texture, entry);
+	return texture;
+}
@@ -0,0 +1,60 @@
+#ifndef ASSETPACK_H
+#define ASSETPACK_H
+
+#include "assetpack-format.h"
+#include "texture.h"
+#include "uploadbatch.h"
+#include "../core/memorymappedfile.h"
+
+#include <memory>
+#include <string>
+
+/*
+ * Read-only view of a baked asset pack. The file is memory-mapped, and
+ * texel data is copied straight from the mapping into staging memory;
+ * there's no decoding, flipping or swizzling at load-time. Only the
+ * pages of the textures that are actually loaded get read from disk.
+ *
+ * Like the importers, the loaders stage the texel data in uploadBatch;
+ * the texture is ready for use once it has been submitted.
+ */
+class AssetPack {
+public:
+	explicit AssetPack(const std::string &path);
+
+	AssetPack(const AssetPack &) = delete;
+	AssetPack &operator=(const AssetPack &) = delete;
+
+	bool hasTexture(const std::string &name) const
+	{
+		return findTexture(name) != nullptr;
+	}
+
+	// block-compressed formats are optional, so packs can have textures the device can't sample
+	bool isTextureSupported(const std::string &name) const;
+
+	std::unique_ptr<Texture2D> loadTexture2D(UploadBatch &uploadBatch, const std::string &name) const;
+	std::unique_ptr<Texture2DArray> loadTexture2DArray(UploadBatch &uploadBatch, const std::string &name) const;
+	std::unique_ptr<TextureCube> loadTextureCube(UploadBatch &uploadBatch, const std::string &name) const;
+
+	// throws unless there's a texture by that name, of that type
+	const AssetPackTexture &getTexture(const std::string &name, VkImageViewType viewType) const;
+
+	// stages mip-levels firstMipLevel and up into levels 0 and up of texture, which must be sized to match
+	void stageTexture(UploadBatch &uploadBatch, TextureBase &texture, const AssetPackTexture &entry, int firstMipLevel = 0) const;
+
+private:
+	const AssetPackTexture *findTexture(const std::string &name) const;
+
+	const char *getName(const AssetPackTexture &entry) const
+	{
+		return stringTable + entry.nameOffset;
+	}
+
+	MemoryMappedFile file;
+	const AssetPackTexture *textures;
+	uint32_t textureCount;
+	const char *stringTable;
+};
+
+#endif // ASSETPACK_H
@@ -0,0 +1,149 @@
+#include "asyncuploader.h"
+
+using namespace vulkan;
+
+using std::vector;
+
+AsyncUploader::AsyncUploader() :
+	batch(transferQueue, transferQueueIndex, graphicsQueueIndex),
+	readyTicket(0)
+{
+	commandPool = createCommandPool(graphicsQueueIndex);
+}
+
+AsyncUploader::~AsyncUploader()
+{
+	finish();
+
+	for (auto semaphore : freeSemaphores)
+		vkDestroySemaphore(device, semaphore, nullptr);
+	for (auto fence : freeFences)
+		vkDestroyFence(device, fence, nullptr);
+
+	vkDestroyCommandPool(device, commandPool, nullptr);
+}
+
+uint64_t AsyncUploader::submit()
+{
+	if (!batch.transfersOwnership()) {
+		// same queue as rendering, so submission order is all we need
+		readyTicket = batch.submit();
+		return readyTicket;
+	}
+
+	if (batch.empty())
+		return pendingTransfers.empty() ? readyTicket : pendingTransfers.back().serial;
+
+	PendingTransfer transfer;
+	if (!freeSemaphores.empty()) {
+		transfer.semaphore = freeSemaphores.back();
+		freeSemaphores.pop_back();
+	} else
+		transfer.semaphore = createSemaphore();
+
+	transfer.serial = batch.submit(transfer.semaphore, &transfer.acquireBarriers);
+	pendingTransfers.push_back(std::move(transfer));
+	return pendingTransfers.back().serial;
+}
+
+void AsyncUploader::update()
+{
+	collectAcquires(false);
+
+	// only acquire what has already landed, so the graphics queue never waits on the transfer
+	vector<VkSemaphore> waitSemaphores;
+	AcquireBarriers acquireBarriers;
+	uint64_t serial = readyTicket;
+	while (!pendingTransfers.empty() && batch.isComplete(pendingTransfers.front().serial)) {
+		auto &transfer = pendingTransfers.front();
+		waitSemaphores.push_back(transfer.semaphore);
+		acquireBarriers.bufferBarriers.insert(acquireBarriers.bufferBarriers.end(), transfer.acquireBarriers.bufferBarriers.begin(), transfer.acquireBarriers.bufferBarriers.end());
+		acquireBarriers.imageBarriers.insert(acquireBarriers.imageBarriers.end(), transfer.acquireBarriers.imageBarriers.begin(), transfer.acquireBarriers.imageBarriers.end());
+		serial = transfer.serial;
+		pendingTransfers.pop_front();
+	}
+
+	if (waitSemaphores.empty())
+		return;
+
+	PendingAcquire acquire;
+	if (!freeCommandBuffers.empty()) {
+		acquire.commandBuffer = freeCommandBuffers.back();
+		freeCommandBuffers.pop_back();
+	} else {
+		auto commandBuffers = allocateCommandBuffers(commandPool, 1);
+		acquire.commandBuffer = commandBuffers[0];
+		delete[] commandBuffers;
+	}
+
+	if (!freeFences.empty()) {
+		acquire.fence = freeFences.back();
+		freeFences.pop_back();
+	} else
+		acquire.fence = createFence(0);
+
+	VkCommandBufferBeginInfo commandBufferBeginInfo = {};
+	commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	VkResult err = vkBeginCommandBuffer(acquire.commandBuffer, &commandBufferBeginInfo);
+	assert(err == VK_SUCCESS);
+
+	acquireBarriers.record(acquire.commandBuffer);
+
+	err = vkEndCommandBuffer(acquire.commandBuffer);
+	assert(err == VK_SUCCESS);
+
+	vector<VkPipelineStageFlags> waitStages(waitSemaphores.size(), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.waitSemaphoreCount = uint32_t(waitSemaphores.size());
+	submitInfo.pWaitSemaphores = waitSemaphores.data();
+	submitInfo.pWaitDstStageMask = waitStages.data();
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &acquire.commandBuffer;
+
+	err = vkQueueSubmit(graphicsQueue, 1, &submitInfo, acquire.fence);
+	assert(err == VK_SUCCESS);
+
+	acquire.semaphores = std::move(waitSemaphores);
+	pendingAcquires.push_back(std::move(acquire));
+	readyTicket = serial;
+}
+
+void AsyncUploader::finish()
+{
+	submit();
+
+	while (!pendingTransfers.empty()) {
+		batch.flush();
+		update();
+	}
+
+	collectAcquires(true);
+}
+
+void AsyncUploader::collectAcquires(bool wait)
+{
+	while (!pendingAcquires.empty()) {
+		auto &acquire = pendingAcquires.front();
+		if (wait) {
+			VkResult err = vkWaitForFences(device, 1, &acquire.fence, VK_TRUE, UINT64_MAX);
+			assert(err == VK_SUCCESS);
+		} else if (vkGetFenceStatus(device, acquire.fence) != VK_SUCCESS)
+			break;
+
+		VkResult err = vkResetFences(device, 1, &acquire.fence);
+		assert(err == VK_SUCCESS);
+		freeFences.push_back(acquire.fence);
+
+		err = vkResetCommandBuffer(acquire.commandBuffer, 0);
+		assert(err == VK_SUCCESS);
+		freeCommandBuffers.push_back(acquire.commandBuffer);
+
+		// the waits have completed, so the semaphores are unsignaled again
+		freeSemaphores.insert(freeSemaphores.end(), acquire.semaphores.begin(), acquire.semaphores.end());
+		pendingAcquires.pop_front();
+	}
+}
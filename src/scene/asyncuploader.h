@@ -0,0 +1,75 @@
+#ifndef ASYNCUPLOADER_H
+#define ASYNCUPLOADER_H
+
+#include "uploadbatch.h"
+
+#include <deque>
+#include <vector>
+
+/*
+ * Uploads on the transfer queue, so streaming data in doesn't hold up
+ * rendering. Stage into getBatch() and submit(); then call update()
+ * once per frame from the thread that submits to the graphics queue.
+ *
+ * When a transfer completes, update() submits the acquiring half of
+ * the ownership transfer to the graphics queue, waiting on a semaphore
+ * signaled by the transfer. Anything submitted to the graphics queue
+ * after that may use the uploaded resources.
+ *
+ * Without a dedicated transfer queue, this degrades to plain uploads
+ * on the graphics queue, which are usable right after submit().
+ */
+class AsyncUploader {
+public:
+	AsyncUploader();
+	~AsyncUploader();
+
+	AsyncUploader(const AsyncUploader &) = delete;
+	AsyncUploader &operator=(const AsyncUploader &) = delete;
+
+	UploadBatch &getBatch()
+	{
+		return batch;
+	}
+
+	// returns a ticket for isReady()
+	uint64_t submit();
+
+	void update();
+
+	bool isReady(uint64_t ticket) const
+	{
+		return ticket <= readyTicket;
+	}
+
+	// blocks until every submitted upload is ready
+	void finish();
+
+private:
+	struct PendingTransfer {
+		uint64_t serial;
+		VkSemaphore semaphore;
+		AcquireBarriers acquireBarriers;
+	};
+
+	struct PendingAcquire {
+		VkFence fence;
+		VkCommandBuffer commandBuffer;
+		std::vector<VkSemaphore> semaphores;
+	};
+
+	void collectAcquires(bool wait);
+
+	UploadBatch batch;
+	VkCommandPool commandPool;
+
+	uint64_t readyTicket;
+	std::deque<PendingTransfer> pendingTransfers;
+	std::deque<PendingAcquire> pendingAcquires;
+
+	std::vector<VkSemaphore> freeSemaphores;
+	std::vector<VkCommandBuffer> freeCommandBuffers;
+	std::vector<VkFence> freeFences;
+};
+
+#endif // ASYNCUPLOADER_H
@@ -0,0 +1,573 @@
+#include "block-compress.h"
+#include "../core/core.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+using std::max;
+using std::min;
+
+// interpolation weights for 4-bit indices, in 64ths; BC6H and BC7 share them
+static const int weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// packs fields LSB-first, the way BC6H and BC7 blocks are laid out
+struct BitWriter {
+	explicit BitWriter(uint8_t *dst) : dst(dst), position(0)
+	{
+		memset(dst, 0, 16);
+	}
+
+	void write(uint32_t value, int bits)
+	{
+		for (auto i = 0; i < bits; ++i, ++position) {
+			if ((value >> i) & 1)
+				dst[position >> 3] |= uint8_t(1 << (position & 7));
+		}
+	}
+
+	uint8_t *dst;
+	int position;
+};
+
+static int clampInt(int value, int lo, int hi)
+{
+	return min(max(value, lo), hi);
+}
+
+// the line through the texels that they're spread out the most along, by power-iteration on their covariance
+template <int N>
+static void fitLine(const float (*texels)[N], float *mean, float *axis)
+{
+	for (auto c = 0; c < N; ++c) {
+		mean[c] = 0.0f;
+		for (auto i = 0; i < 16; ++i)
+			mean[c] += texels[i][c];
+		mean[c] /= 16;
+	}
+
+	float covariance[N][N] = {};
+	for (auto i = 0; i < 16; ++i) {
+		for (auto a = 0; a < N; ++a)
+			for (auto b = 0; b < N; ++b)
+				covariance[a][b] += (texels[i][a] - mean[a]) * (texels[i][b] - mean[b]);
+	}
+
+	// starting out along the channel that varies the most converges quicker than any fixed guess
+	auto widest = 0;
+	for (auto c = 1; c < N; ++c) {
+		if (covariance[c][c] > covariance[widest][widest])
+			widest = c;
+	}
+
+	for (auto c = 0; c < N; ++c)
+		axis[c] = c == widest ? 1.0f : 0.0f;
+
+	for (auto iteration = 0; iteration < 8; ++iteration) {
+		float next[N] = {};
+		for (auto a = 0; a < N; ++a)
+			for (auto b = 0; b < N; ++b)
+				next[a] += covariance[a][b] * axis[b];
+
+		auto length = 0.0f;
+		for (auto c = 0; c < N; ++c)
+			length += next[c] * next[c];
+		length = sqrtf(length);
+
+		// all the same, so any axis does
+		if (length < 1e-6f)
+			break;
+
+		for (auto c = 0; c < N; ++c)
+			axis[c] = next[c] / length;
+	}
+}
+
+// the ends of the fitted line, as far out as the texels go
+template <int N>
+static void fitEndpoints(const float (*texels)[N], float *e0, float *e1)
+{
+	float mean[N], axis[N];
+	fitLine<N>(texels, mean, axis);
+
+	auto lo = FLT_MAX, hi = -FLT_MAX;
+	for (auto i = 0; i < 16; ++i) {
+		auto t = 0.0f;
+		for (auto c = 0; c < N; ++c)
+			t += (texels[i][c] - mean[c]) * axis[c];
+		lo = min(lo, t);
+		hi = max(hi, t);
+	}
+
+	for (auto c = 0; c < N; ++c) {
+		e0[c] = mean[c] + axis[c] * lo;
+		e1[c] = mean[c] + axis[c] * hi;
+	}
+}
+
+// the endpoints that reproduce the texels best with these weights towards e1, by least-squares; false if that's ambiguous
+template <int N>
+static bool solveEndpoints(const float (*texels)[N], const float *weights, float *e0, float *e1)
+{
+	float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+	float ax[N] = {}, bx[N] = {};
+	for (auto i = 0; i < 16; ++i) {
+		auto a = 1.0f - weights[i], b = weights[i];
+		aa += a * a;
+		ab += a * b;
+		bb += b * b;
+		for (auto c = 0; c < N; ++c) {
+			ax[c] += a * texels[i][c];
+			bx[c] += b * texels[i][c];
+		}
+	}
+
+	auto determinant = aa * bb - ab * ab;
+	if (fabsf(determinant) < 1e-6f)
+		return false;
+
+	for (auto c = 0; c < N; ++c) {
+		e0[c] = (bb * ax[c] - ab * bx[c]) / determinant;
+		e1[c] = (aa * bx[c] - ab * ax[c]) / determinant;
+	}
+	return true;
+}
+
+// picks the closest palette entry for each texel, and returns the total squared error
+template <int N>
+static float chooseIndices(const float (*texels)[N], const int (*palette)[N], int paletteSize, uint8_t *indices)
+{
+	auto error = 0.0f;
+	for (auto i = 0; i < 16; ++i) {
+		auto bestError = FLT_MAX;
+		for (auto j = 0; j < paletteSize; ++j) {
+			auto e = 0.0f;
+			for (auto c = 0; c < N; ++c) {
+				auto d = texels[i][c] - palette[j][c];
+				e += d * d;
+			}
+
+			if (e < bestError) {
+				bestError = e;
+				indices[i] = uint8_t(j);
+			}
+		}
+		error += bestError;
+	}
+	return error;
+}
+
+static uint16_t quantizeRGB565(const float *color)
+{
+	auto r = clampInt(int(color[0] * 31.0f / 255.0f + 0.5f), 0, 31);
+	auto g = clampInt(int(color[1] * 63.0f / 255.0f + 0.5f), 0, 63);
+	auto b = clampInt(int(color[2] * 31.0f / 255.0f + 0.5f), 0, 31);
+	return uint16_t(r << 11 | g << 5 | b);
+}
+
+static void unpackRGB565(uint16_t color, int *rgb)
+{
+	auto r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+	rgb[0] = (r << 3) | (r >> 2);
+	rgb[1] = (g << 2) | (g >> 4);
+	rgb[2] = (b << 3) | (b >> 2);
+}
+
+// the four-color mode; it's the only one BC3 has, and the three-color one is for punch-through alpha
+static void getBC1Palette(uint16_t color0, uint16_t color1, int (*palette)[3])
+{
+	unpackRGB565(color0, palette[0]);
+	unpackRGB565(color1, palette[1]);
+	for (auto c = 0; c < 3; ++c) {
+		palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+		palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+	}
+}
+
+void encodeBC1Block(uint8_t *dst, const uint8_t *rgba)
+{
+	float texels[16][3];
+	for (auto i = 0; i < 16; ++i)
+		for (auto c = 0; c < 3; ++c)
+			texels[i][c] = rgba[i * 4 + c];
+
+	uint16_t color0 = 0, color1 = 0;
+	uint8_t indices[16];
+	auto error = FLT_MAX;
+	auto tryEndpoints = [&](const float *e0, const float *e1) {
+		uint16_t c0 = quantizeRGB565(e0), c1 = quantizeRGB565(e1);
+		int palette[4][3];
+		getBC1Palette(c0, c1, palette);
+
+		uint8_t candidate[16];
+		auto e = chooseIndices<3>(texels, palette, 4, candidate);
+		if (e < error) {
+			error = e;
+			color0 = c0;
+			color1 = c1;
+			memcpy(indices, candidate, sizeof(indices));
+		}
+	};
+
+	float e0[3], e1[3];
+	fitEndpoints<3>(texels, e0, e1);
+	tryEndpoints(e0, e1);
+
+	// the extremes are rarely the best endpoints, as the palette doesn't have to reach all the way
+	static const float paletteWeights[4] = { 0.0f, 1.0f, 1.0f / 3, 2.0f / 3 };
+	for (auto iteration = 0; iteration < 2 && error > 0.0f; ++iteration) {
+		float weights[16];
+		for (auto i = 0; i < 16; ++i)
+			weights[i] = paletteWeights[indices[i]];
+
+		if (!solveEndpoints<3>(texels, weights, e0, e1))
+			break;
+		tryEndpoints(e0, e1);
+	}
+
+	// color0 > color1 selects the four-color mode; with equal colors, every entry is the same anyway
+	if (color0 < color1) {
+		std::swap(color0, color1);
+		for (auto &index : indices)
+			index ^= 1;
+	} else if (color0 == color1)
+		memset(indices, 0, sizeof(indices));
+
+	uint32_t bits = 0;
+	for (auto i = 0; i < 16; ++i)
+		bits |= uint32_t(indices[i]) << (i * 2);
+
+	dst[0] = uint8_t(color0);
+	dst[1] = uint8_t(color0 >> 8);
+	dst[2] = uint8_t(color1);
+	dst[3] = uint8_t(color1 >> 8);
+	for (auto i = 0; i < 4; ++i)
+		dst[4 + i] = uint8_t(bits >> (i * 8));
+}
+
+// one channel, as in BC4, BC5 and the alpha of BC3; always in the eight-value mode
+static void encodeBC4Channel(uint8_t *dst, const uint8_t *rgba, int channel)
+{
+	uint8_t values[16];
+	for (auto i = 0; i < 16; ++i)
+		values[i] = rgba[i * 4 + channel];
+
+	auto lo = *std::min_element(values, values + 16),
+	     hi = *std::max_element(values, values + 16);
+
+	dst[0] = hi;
+	dst[1] = lo;
+
+	uint64_t bits = 0;
+	if (hi > lo) {
+		int palette[8] = { hi, lo };
+		for (auto j = 2; j < 8; ++j)
+			palette[j] = ((8 - j) * hi + (j - 1) * lo + 3) / 7;
+
+		for (auto i = 0; i < 16; ++i) {
+			auto best = 0;
+			for (auto j = 1; j < 8; ++j) {
+				if (abs(values[i] - palette[j]) < abs(values[i] - palette[best]))
+					best = j;
+			}
+			bits |= uint64_t(best) << (i * 3);
+		}
+	}
+
+	for (auto i = 0; i < 6; ++i)
+		dst[2 + i] = uint8_t(bits >> (i * 8));
+}
+
+void encodeBC3Block(uint8_t *dst, const uint8_t *rgba)
+{
+	encodeBC4Channel(dst, rgba, 3);
+	encodeBC1Block(dst + 8, rgba);
+}
+
+void encodeBC4Block(uint8_t *dst, const uint8_t *rgba)
+{
+	encodeBC4Channel(dst, rgba, 0);
+}
+
+void encodeBC5Block(uint8_t *dst, const uint8_t *rgba)
+{
+	encodeBC4Channel(dst, rgba, 0);
+	encodeBC4Channel(dst + 8, rgba, 1);
+}
+
+// the index of the first texel has an implied zero top bit, so the endpoints may have to trade places
+template <typename T>
+static void fixAnchorIndex(T &endpoint0, T &endpoint1, uint8_t *indices)
+{
+	if (indices[0] < 8)
+		return;
+
+	std::swap(endpoint0, endpoint1);
+	for (auto i = 0; i < 16; ++i)
+		indices[i] = uint8_t(15 - indices[i]);
+}
+
+static void writeIndices4(BitWriter &writer, const uint8_t *indices)
+{
+	writer.write(indices[0], 3);
+	for (auto i = 1; i < 16; ++i)
+		writer.write(indices[i], 4);
+}
+
+// 16-bit half-float pattern -> what BC6H_UFLOAT interpolates; negatives and NaNs become zero, infinities the largest finite value
+static int bc6hValue(uint16_t half)
+{
+	if (half & 0x8000)
+		return 0;
+	if ((half & 0x7c00) == 0x7c00)
+		return (half & 0x3ff) ? 0 : 0x7bff;
+	return half;
+}
+
+static int unquantizeBC6H(int value)
+{
+	if (value == 0)
+		return 0;
+	if (value == 1023)
+		return 0xffff;
+	return ((value << 16) + 0x8000) >> 10;
+}
+
+// what the decoder turns an interpolated value into
+static int finishBC6H(int value)
+{
+	return (value * 31) >> 6;
+}
+
+static int quantizeBC6H(float value)
+{
+	auto guess = int(value * 1024.0f / 31744.0f);
+
+	auto best = 0;
+	auto bestError = FLT_MAX;
+	for (auto candidate = max(guess - 1, 0); candidate <= min(guess + 2, 1023); ++candidate) {
+		auto error = fabsf(finishBC6H(unquantizeBC6H(candidate)) - value);
+		if (error < bestError) {
+			bestError = error;
+			best = candidate;
+		}
+	}
+	return best;
+}
+
+struct BC6HEndpoint {
+	int rgb[3];
+};
+
+void encodeBC6HBlock(uint8_t *dst, const uint16_t *rgba)
+{
+	float texels[16][3];
+	for (auto i = 0; i < 16; ++i)
+		for (auto c = 0; c < 3; ++c)
+			texels[i][c] = float(bc6hValue(rgba[i * 4 + c]));
+
+	BC6HEndpoint endpoint0 = {}, endpoint1 = {};
+	uint8_t indices[16];
+	auto error = FLT_MAX;
+	auto tryEndpoints = [&](const float *e0, const float *e1) {
+		BC6HEndpoint q0, q1;
+		int palette[16][3];
+		for (auto c = 0; c < 3; ++c) {
+			q0.rgb[c] = quantizeBC6H(e0[c]);
+			q1.rgb[c] = quantizeBC6H(e1[c]);
+
+			auto a = unquantizeBC6H(q0.rgb[c]), b = unquantizeBC6H(q1.rgb[c]);
+			for (auto j = 0; j < 16; ++j)
+				palette[j][c] = finishBC6H((a * (64 - weights4[j]) + b * weights4[j] + 32) >> 6);
+		}
+
+		uint8_t candidate[16];
+		auto e = chooseIndices<3>(texels, palette, 16, candidate);
+		if (e < error) {
+			error = e;
+			endpoint0 = q0;
+			endpoint1 = q1;
+			memcpy(indices, candidate, sizeof(indices));
+		}
+	};
+
+	float e0[3], e1[3];
+	fitEndpoints<3>(texels, e0, e1);
+	tryEndpoints(e0, e1);
+
+	for (auto iteration = 0; iteration < 2 && error > 0.0f; ++iteration) {
+		float weights[16];
+		for (auto i = 0; i < 16; ++i)
+			weights[i] = weights4[indices[i]] / 64.0f;
+
+		if (!solveEndpoints<3>(texels, weights, e0, e1))
+			break;
+		tryEndpoints(e0, e1);
+	}
+
+	fixAnchorIndex(endpoint0, endpoint1, indices);
+
+	// mode 11: untransformed 10-bit endpoints, a single region
+	BitWriter writer(dst);
+	writer.write(0x03, 5);
+	for (auto c = 0; c < 3; ++c)
+		writer.write(endpoint0.rgb[c], 10);
+	for (auto c = 0; c < 3; ++c)
+		writer.write(endpoint1.rgb[c], 10);
+	writeIndices4(writer, indices);
+	assert(writer.position == 128);
+}
+
+struct BC7Endpoint {
+	int rgba[4]; // 7 bits each
+	int pbit;
+
+	int expand(int channel) const
+	{
+		return (rgba[channel] << 1) | pbit;
+	}
+};
+
+// the p-bit is shared by all channels of an endpoint, so both get tried
+static BC7Endpoint quantizeBC7(const float *color)
+{
+	BC7Endpoint best = {};
+	auto bestError = FLT_MAX;
+	for (auto pbit = 0; pbit < 2; ++pbit) {
+		BC7Endpoint candidate;
+		candidate.pbit = pbit;
+
+		auto error = 0.0f;
+		for (auto c = 0; c < 4; ++c) {
+			candidate.rgba[c] = clampInt(int((color[c] - pbit) / 2 + 0.5f), 0, 127);
+			auto d = candidate.expand(c) - color[c];
+			error += d * d;
+		}
+
+		if (error < bestError) {
+			bestError = error;
+			best = candidate;
+		}
+	}
+	return best;
+}
+
+void encodeBC7Block(uint8_t *dst, const uint8_t *rgba)
+{
+	float texels[16][4];
+	for (auto i = 0; i < 16; ++i)
+		for (auto c = 0; c < 4; ++c)
+			texels[i][c] = rgba[i * 4 + c];
+
+	BC7Endpoint endpoint0 = {}, endpoint1 = {};
+	uint8_t indices[16];
+	auto error = FLT_MAX;
+	auto tryEndpoints = [&](const float *e0, const float *e1) {
+		auto q0 = quantizeBC7(e0), q1 = quantizeBC7(e1);
+
+		int palette[16][4];
+		for (auto c = 0; c < 4; ++c) {
+			auto a = q0.expand(c), b = q1.expand(c);
+			for (auto j = 0; j < 16; ++j)
+				palette[j][c] = (a * (64 - weights4[j]) + b * weights4[j] + 32) >> 6;
+		}
+
+		uint8_t candidate[16];
+		auto e = chooseIndices<4>(texels, palette, 16, candidate);
+		if (e < error) {
+			error = e;
+			endpoint0 = q0;
+			endpoint1 = q1;
+			memcpy(indices, candidate, sizeof(indices));
+		}
+	};
+
+	float e0[4], e1[4];
+	fitEndpoints<4>(texels, e0, e1);
+	tryEndpoints(e0, e1);
+
+	for (auto iteration = 0; iteration < 2 && error > 0.0f; ++iteration) {
+		float weights[16];
+		for (auto i = 0; i < 16; ++i)
+			weights[i] = weights4[indices[i]] / 64.0f;
+
+		if (!solveEndpoints<4>(texels, weights, e0, e1))
+			break;
+		tryEndpoints(e0, e1);
+	}
+
+	fixAnchorIndex(endpoint0, endpoint1, indices);
+
+	// mode 6: a single subset, 7-bit endpoints with a p-bit each, 4-bit indices
+	BitWriter writer(dst);
+	writer.write(1 << 6, 7);
+	for (auto c = 0; c < 4; ++c) {
+		writer.write(endpoint0.rgba[c], 7);
+		writer.write(endpoint1.rgba[c], 7);
+	}
+	writer.write(endpoint0.pbit, 1);
+	writer.write(endpoint1.pbit, 1);
+	writeIndices4(writer, indices);
+	assert(writer.position == 128);
+}
+
+bool canCompressImage(VkFormat format)
+{
+	switch (format) {
+	case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+	case VK_FORMAT_BC3_UNORM_BLOCK:
+	case VK_FORMAT_BC4_UNORM_BLOCK:
+	case VK_FORMAT_BC5_UNORM_BLOCK:
+	case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+	case VK_FORMAT_BC7_UNORM_BLOCK:
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+// a 4x4 block starting at x, y, with whatever is outside the image clamped to the edges
+template <typename T>
+static void loadBlock(T *block, const T *src, int width, int height, int x, int y)
+{
+	for (auto by = 0; by < 4; ++by) {
+		auto row = src + size_t(min(y + by, height - 1)) * width * 4;
+		for (auto bx = 0; bx < 4; ++bx)
+			memcpy(block + (by * 4 + bx) * 4, row + min(x + bx, width - 1) * 4, sizeof(T) * 4);
+	}
+}
+
+void compressImage(VkFormat format, void *dst, const void *src, int width, int height)
+{
+	assert(canCompressImage(format));
+	assert(width > 0 && height > 0);
+
+	auto blockSize = format == VK_FORMAT_BC1_RGB_UNORM_BLOCK || format == VK_FORMAT_BC4_UNORM_BLOCK ? 8 : 16;
+	auto out = static_cast<uint8_t *>(dst);
+
+	for (auto y = 0; y < height; y += 4) {
+		for (auto x = 0; x < width; x += 4, out += blockSize) {
+			if (format == VK_FORMAT_BC6H_UFLOAT_BLOCK) {
+				uint16_t block[64];
+				loadBlock(block, static_cast<const uint16_t *>(src), width, height, x, y);
+				encodeBC6HBlock(out, block);
+				continue;
+			}
+
+			uint8_t block[64];
+			loadBlock(block, static_cast<const uint8_t *>(src), width, height, x, y);
+			switch (format) {
+			case VK_FORMAT_BC1_RGB_UNORM_BLOCK: encodeBC1Block(out, block); break;
+			case VK_FORMAT_BC3_UNORM_BLOCK: encodeBC3Block(out, block); break;
+			case VK_FORMAT_BC4_UNORM_BLOCK: encodeBC4Block(out, block); break;
+			case VK_FORMAT_BC5_UNORM_BLOCK: encodeBC5Block(out, block); break;
+			case VK_FORMAT_BC7_UNORM_BLOCK: encodeBC7Block(out, block); break;
+			default:
+				unreachable("unexpected format");
+			}
+		}
+	}
+}
@@ -0,0 +1,38 @@
+#ifndef BLOCK_COMPRESS_H
+#define BLOCK_COMPRESS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+
+/*
+ * CPU encoders for the BC formats. Each takes a 4x4 block of texels,
+ * row by row, as RGBA; 8-bit for all but BC6H, which takes half-floats
+ * like VK_FORMAT_R16G16B16A16_SFLOAT. They go for decent quality at
+ * import-time speeds, rather than for the best possible result:
+ *
+ *   BC1   RGB; endpoints along the principal axis, refined by least-squares
+ *   BC3   BC1 for RGB, BC4 for alpha
+ *   BC4   red only
+ *   BC5   red and green, as two BC4 blocks
+ *   BC6H  unsigned RGB half-floats; the single-region mode with 10-bit endpoints
+ *   BC7   RGBA; mode 6, with a single subset and 4-bit indices
+ */
+void encodeBC1Block(uint8_t *dst, const uint8_t *rgba);
+void encodeBC3Block(uint8_t *dst, const uint8_t *rgba);
+void encodeBC4Block(uint8_t *dst, const uint8_t *rgba);
+void encodeBC5Block(uint8_t *dst, const uint8_t *rgba);
+void encodeBC6HBlock(uint8_t *dst, const uint16_t *rgba);
+void encodeBC7Block(uint8_t *dst, const uint8_t *rgba);
+
+// whether compressImage() can produce format
+bool canCompressImage(VkFormat format);
+
+/*
+ * Compresses a tightly packed RGBA image, half-float for BC6H and 8-bit
+ * otherwise, into rows of blocks. Blocks sticking out past the edges
+ * repeat the last row and column.
+ */
+void compressImage(VkFormat format, void *dst, const void *src, int width, int height);
+
+#endif // BLOCK_COMPRESS_H
@@ -2,27 +2,31 @@
 #define BUFFER_H
 
 #include "../vulkan.h"
+#include "../memoryallocator.h"
 
 #include <cstring>
 
-class StagingBuffer;
-
 class Buffer {
 public:
-	Buffer(VkDeviceSize size, VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags);
+	Buffer(VkDeviceSize size, VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, VkMemoryPropertyFlags preferredMemoryPropertyFlags = 0);
 	~Buffer();
 
+	// whether the memory ended up host-visible, so map() works
+	bool isMappable() const
+	{
+		return memory.mappedData != nullptr;
+	}
+
 	void *map(VkDeviceSize offset, VkDeviceSize size)
 	{
-		void *ret;
-		VkResult err = vkMapMemory(vulkan::device, deviceMemory, offset, size, 0, &ret);
-		assert(err == VK_SUCCESS);
-		return ret;
+		assert(memory.mappedData != nullptr);
+		assert(offset + size <= memory.size);
+		return static_cast<uint8_t *>(memory.mappedData) + offset;
 	}
 
 	void unmap()
 	{
-		vkUnmapMemory(vulkan::device, deviceMemory);
+		vulkan::flushDeviceMemory(memory);
 	}
 
 	void uploadMemory(VkDeviceSize offset, void *data, VkDeviceSize size)
@@ -46,11 +50,9 @@ public:
 		return descriptorBufferInfo;
 	}
 
-	void uploadFromStagingBuffer(const StagingBuffer &stagingBuffer, VkDeviceSize srcOffset, VkDeviceSize dstOffset, VkDeviceSize size);
-
 private:
 	VkBuffer buffer;
-	VkDeviceMemory deviceMemory;
+	vulkan::DeviceMemoryAllocation memory;
 };
 
 class StagingBuffer : public Buffer {
@@ -1,271 +1,97 @@
 #include "import-texture.h"
 
 #include <string>
-#include <stdexcept>
-#include <algorithm>
-#include <vector>
-
-#include <sys/stat.h>
 
 using std::string;
-using std::runtime_error;
+using std::future;
 using std::make_unique;
-using std::max;
-using std::vector;
 using std::unique_ptr;
+using std::vector;
 
-#include <FreeImage.h>
-#include <immintrin.h>
-
-static FIBITMAP *loadBitmap(string filename, VkFormat *format)
+// block-compressed formats are optional, so fall back on the uncompressed ones
+static VkFormat chooseFormat(const vector<VkFormat> &candidates)
 {
-	FREE_IMAGE_FORMAT fif = FreeImage_GetFileType(filename.c_str(), 0);
-	if (fif == FIF_UNKNOWN) {
-		fif = FreeImage_GetFIFFromFilename(filename.c_str());
-		if (fif == FIF_UNKNOWN)
-			throw runtime_error("unknown image type");
-	}
-
-	if (!FreeImage_FIFSupportsReading(fif))
-		throw runtime_error(string("file format can't be read: ") + FreeImage_GetFIFDescription(fif));
-
-	FIBITMAP *dib = FreeImage_Load(fif, filename.c_str());
-	if (!dib)
-		throw runtime_error("failed to load image");
-
-	auto imageType = FreeImage_GetImageType(dib);
-	FIBITMAP *temp;
-	switch (imageType) {
-	case FIT_BITMAP:
-		temp = dib;
-		dib = FreeImage_ConvertTo32Bits(dib);
-		FreeImage_Unload(temp);
-		if (!dib)
-			throw runtime_error("failed to convert to 32bits!");
-		*format = VK_FORMAT_R8G8B8A8_UNORM;
-		break;
-
-	case FIT_RGBF:
-		*format = VK_FORMAT_R16G16B16A16_SFLOAT;
-		break;
-
-	default:
-		throw runtime_error("unsupported image-type!");
-	}
-
-	// FreeImage uses bottom-left origin, we use top-left
-	FreeImage_FlipVertical(dib);
-	return dib;
+	return vulkan::findBestFormat(candidates, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT);
 }
 
-static int getBpp(FIBITMAP *dib)
+/*
+ * On unified memory, single-level 2D textures can be sampled right from
+ * where the host writes them, which saves the staging copy. Mip-chains
+ * and arrays stay optimal, as linear images rarely support them.
+ */
+static bool useLinearTiling(const TextureSource &source)
 {
-	switch (FreeImage_GetImageType(dib)) {
-	case FIT_BITMAP: return FreeImage_GetBPP(dib);
-	case FIT_RGBF: return sizeof(uint16_t) * 8 * 4; // expand to RGBA, which is always supported
-	default:
-		unreachable("unsupported type!");
-	}
-}
+	if (!vulkan::unifiedMemory || source.getMipLevels() > 1 || source.getArrayLayers() > 1)
+		return false;
 
-inline uint16_t float_to_half(float input)
-{
-	__m128 single = _mm_set_ss(input);
-	__m128i half = _mm_cvtps_ph(single, 0);
-	return static_cast<uint16_t>(_mm_cvtsi128_si32(half));
+	if (!vulkan::formatSupported(source.getFormat(), VK_IMAGE_TILING_LINEAR, VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT))
+		return false;
+
+	VkImageFormatProperties imageFormatProperties;
+	VkResult err = vkGetPhysicalDeviceImageFormatProperties(vulkan::physicalDevice, source.getFormat(), VK_IMAGE_TYPE_2D, VK_IMAGE_TILING_LINEAR, VK_IMAGE_USAGE_SAMPLED_BIT, 0, &imageFormatProperties);
+	return err == VK_SUCCESS &&
+	       uint32_t(source.getWidth()) <= imageFormatProperties.maxExtent.width &&
+	       uint32_t(source.getHeight()) <= imageFormatProperties.maxExtent.height;
 }
 
-static StagingBuffer *copyToStagingBuffer(FIBITMAP *dib)
+// staging memory is handed out on this thread; only the texel-data gets written in parallel
+static void stageTexture(UploadBatch &uploadBatch, TextureBase &texture, const TextureSource &source, ThreadPool *threadPool)
 {
-	auto imageType = FreeImage_GetImageType(dib);
-	auto width = FreeImage_GetWidth(dib);
-	auto height = FreeImage_GetHeight(dib);
+	texture.setResidencyCategory(TEXTURE_CATEGORY_IMPORTED);
 
-	auto bpp = getBpp(dib);
-	assert(bpp % 8 == 0);
-	auto pixelSize = bpp / 8;
-
-	auto pitch = width * pixelSize;
-	auto size = pitch * height;
-
-	auto stagingBuffer = new StagingBuffer(size);
-	void *ptr = stagingBuffer->map(0, size);
-
-	for (auto y = 0u; y < height; ++y) {
-		auto srcRow = FreeImage_GetScanLine(dib, y);
-		auto dstRow = static_cast<uint8_t *>(ptr) + pitch * y;
-		FIRGBF *srcRowRGBf;
-		uint16_t *dstRowHalf = (uint16_t *)dstRow;
+	auto writer = [&](int mipLevel, int arrayLayer, size_t size) {
+		return uploadBatch.stageImage(texture, mipLevel, arrayLayer, size);
+	};
 
-		switch (imageType) {
-		case FIT_BITMAP:
-			for (auto x = 0u; x < width; ++x) {
-				dstRow[x * 4 + 0] = srcRow[x * 4 + FI_RGBA_RED];
-				dstRow[x * 4 + 1] = srcRow[x * 4 + FI_RGBA_GREEN];
-				dstRow[x * 4 + 2] = srcRow[x * 4 + FI_RGBA_BLUE];
-				dstRow[x * 4 + 3] = srcRow[x * 4 + FI_RGBA_ALPHA];
-			}
-			break;
-		case FIT_RGBF:
-			srcRowRGBf = (FIRGBF *)srcRow;
-			for (auto x = 0u; x < width; ++x) {
-				dstRowHalf[x * 4 + 0] = float_to_half(srcRowRGBf[x].red);
-				dstRowHalf[x * 4 + 1] = float_to_half(srcRowRGBf[x].green);
-				dstRowHalf[x * 4 + 2] = float_to_half(srcRowRGBf[x].blue);
-				dstRowHalf[x * 4 + 3] = float_to_half(1.0f);
-			}
-			break;
-		default:
-			unreachable("unsupported type!");
-		}
-	}
-	stagingBuffer->unmap();
-	return stagingBuffer;
+	// blitting the mip-chain beats rescaling and uploading it, when the queue and format allow
+	if (texture.getMipLevels() > 1 && uploadBatch.canGenerateMipmaps(source.getFormat())) {
+		source.writeBaseLevel(writer, threadPool);
+		uploadBatch.generateMipmaps(texture);
+	} else
+		source.write(writer, threadPool);
 }
 
-static void uploadMipChain(TextureBase &texture, FIBITMAP *dib, int mipLevels, int arrayLayer = 0)
+unique_ptr<Texture2D> importTexture2D(UploadBatch &uploadBatch, string filename, TextureImportFlags flags, ThreadPool *threadPool)
 {
-	auto baseWidth = FreeImage_GetWidth(dib);
-	auto baseHeight = FreeImage_GetHeight(dib);
-
-	for (auto mipLevel = 0; mipLevel < mipLevels; ++mipLevel) {
-		auto mipWidth = TextureBase::mipSize(baseWidth, mipLevel),
-		     mipHeight = TextureBase::mipSize(baseHeight, mipLevel);
-
-		if (mipLevel > 0) {
-			auto temp = dib;
-			dib = FreeImage_Rescale(dib, mipWidth, mipHeight, FILTER_BOX);
-			assert(dib != nullptr);
-			FreeImage_Unload(temp);
-		}
-
-		assert(FreeImage_GetWidth(dib) == mipWidth);
-		assert(FreeImage_GetHeight(dib) == mipHeight);
-
-		auto stagingBuffer = copyToStagingBuffer(dib);
-		texture.uploadFromStagingBuffer(stagingBuffer, mipLevel, arrayLayer);
-		// TODO: delete staging buffer
-	}
-
-	FreeImage_Unload(dib);
+	auto source = TextureSource::load2D(filename, flags, chooseFormat);
+	auto texture = make_unique<Texture2D>(source->getFormat(), source->getWidth(), source->getHeight(), source->getMipLevels(), 1, !useLinearTiling(*source));
+	stageTexture(uploadBatch, *texture, *source, threadPool);
+	return texture;
 }
 
-std::unique_ptr<Texture2D> importTexture2D(string filename, TextureImportFlags flags)
+unique_ptr<Texture2DArray> importTexture2DArray(UploadBatch &uploadBatch, string folder, TextureImportFlags flags, ThreadPool *threadPool)
 {
-	VkFormat format = VK_FORMAT_UNDEFINED;
-	auto dib = loadBitmap(filename, &format);
-	assert(format != VK_FORMAT_UNDEFINED);
-
-	if (flags & TextureImportFlags::PREMULTIPLY_ALPHA)
-		FreeImage_PreMultiplyWithAlpha(dib);
-
-	auto baseWidth = FreeImage_GetWidth(dib);
-	auto baseHeight = FreeImage_GetHeight(dib);
-
-	auto mipLevels = 1;
-	if (flags & TextureImportFlags::GENERATE_MIPMAPS)
-		mipLevels = TextureBase::maxMipLevels(max(baseWidth, baseHeight));
-
-	auto texture = make_unique<Texture2D>(format, baseWidth, baseHeight, mipLevels, 1, true);
-	uploadMipChain(*texture, dib, mipLevels);
+	auto source = TextureSource::load2DArray(folder, flags, threadPool, chooseFormat);
+	auto texture = make_unique<Texture2DArray>(source->getFormat(), source->getWidth(), source->getHeight(), source->getArrayLayers(), source->getMipLevels(), true);
+	stageTexture(uploadBatch, *texture, *source, threadPool);
 	return texture;
 }
 
-unique_ptr<Texture2DArray> importTexture2DArray(string folder, TextureImportFlags flags)
+unique_ptr<TextureCube> importTextureCube(UploadBatch &uploadBatch, string filename, TextureImportFlags flags, ThreadPool *threadPool)
 {
-	VkFormat firstFormat = VK_FORMAT_UNDEFINED;
-	unsigned int firstWidth, firstHeight;
-
-	vector<FIBITMAP *> bitmaps;
-	for (int i = 0; true; ++i) {
-		char path[256];
-		snprintf(path, sizeof(path), "%s/%04d.png", folder.c_str(), i);
-
-		struct stat st;
-		if ((stat(path, &st) < 0) ||
-		    (st.st_mode & S_IFMT) != S_IFREG)
-			break;
-
-		VkFormat format = VK_FORMAT_UNDEFINED;
-		auto dib = loadBitmap(path, &format);
-
-		auto width = FreeImage_GetWidth(dib);
-		auto height = FreeImage_GetHeight(dib);
-
-		if (i == 0) {
-			firstFormat = format;
-			firstWidth = width;
-			firstHeight = height;
-		} else if (firstFormat != format ||
-		           firstWidth != width ||
-		           firstHeight != height)
-			throw runtime_error("inconsistent format or size!");
-
-		if (flags & TextureImportFlags::PREMULTIPLY_ALPHA)
-			FreeImage_PreMultiplyWithAlpha(dib);
-
-		bitmaps.push_back(dib);
-	}
-
-	if (bitmaps.size() == 0)
-		throw runtime_error("empty texture-array!");
-
-	auto mipLevels = 1;
-	if (flags & TextureImportFlags::GENERATE_MIPMAPS)
-		mipLevels = TextureBase::maxMipLevels(max(firstWidth, firstHeight));
-
-	assert(bitmaps.size() < INT_MAX);
-	auto texture = make_unique<Texture2DArray>(firstFormat, firstWidth, firstHeight, int(bitmaps.size()), mipLevels, true);
-	for (int i = 0; i < texture->getArrayLayers(); ++i)
-		uploadMipChain(*texture, bitmaps[i], mipLevels, i);
-
+	auto source = TextureSource::loadCube(filename, flags, threadPool, chooseFormat);
+	auto texture = make_unique<TextureCube>(source->getFormat(), source->getWidth(), source->getMipLevels());
+	stageTexture(uploadBatch, *texture, *source, threadPool);
 	return texture;
 }
 
-unique_ptr<TextureCube> importTextureCube(string filename, TextureImportFlags flags)
+future<unique_ptr<Texture2D>> importTexture2DAsync(ThreadPool &threadPool, UploadBatch &uploadBatch, string filename, TextureImportFlags flags)
 {
-	VkFormat format = VK_FORMAT_UNDEFINED;
-	auto dib = loadBitmap(filename, &format);
-	assert(format != VK_FORMAT_UNDEFINED);
-
-	auto imageWidth = FreeImage_GetWidth(dib);
-	auto imageHeight = FreeImage_GetHeight(dib);
-	auto baseSize = imageWidth / 3;
-
-	if (imageWidth % 3 != 0 ||
-		imageHeight != baseSize * 4)
-		throw runtime_error("unexpected image size!");
-
-	if (flags & TextureImportFlags::PREMULTIPLY_ALPHA)
-		FreeImage_PreMultiplyWithAlpha(dib);
-
-	auto mipLevels = 1;
-	if (flags & TextureImportFlags::GENERATE_MIPMAPS)
-		mipLevels = TextureBase::maxMipLevels(baseSize);
-
-	auto texture = make_unique<TextureCube>(format, baseSize, mipLevels);
-
-	static const int offsets[6][2] = {
-		{ 2, 2 }, // -X
-		{ 0, 2 }, // +X
-		{ 1, 3 }, // +Y
-		{ 1, 1 }, // -Y
-		{ 1, 2 }, // +Z
-		{ 1, 0 }, // -Z - this one is upside down :(
-	};
-	for (auto face = 0; face < 6; ++face) {
-		auto left = offsets[face][0] * baseSize,
-		     top  = offsets[face][1] * baseSize;
-		auto faceDib = FreeImage_Copy(dib, left, top, left + baseSize, top + baseSize);
-
-		if (face == 5) {
-			FreeImage_FlipVertical(faceDib);
-			FreeImage_FlipHorizontal(faceDib);
-		}
+	return threadPool.enqueue([&threadPool, &uploadBatch, filename, flags] {
+		return importTexture2D(uploadBatch, filename, flags, &threadPool);
+	});
+}
 
-		uploadMipChain(*texture, faceDib, mipLevels, face);
-	}
+future<unique_ptr<TextureCube>> importTextureCubeAsync(ThreadPool &threadPool, UploadBatch &uploadBatch, string filename, TextureImportFlags flags)
+{
+	return threadPool.enqueue([&threadPool, &uploadBatch, filename, flags] {
+		return importTextureCube(uploadBatch, filename, flags, &threadPool);
+	});
+}
 
-	FreeImage_Unload(dib);
-	return texture;
+future<unique_ptr<Texture2DArray>> importTexture2DArrayAsync(ThreadPool &threadPool, UploadBatch &uploadBatch, string folder, TextureImportFlags flags)
+{
+	return threadPool.enqueue([&threadPool, &uploadBatch, folder, flags] {
+		return importTexture2DArray(uploadBatch, folder, flags, &threadPool);
+	});
 }
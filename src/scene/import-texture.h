@@ -2,27 +2,25 @@
 #define IMPORT_TEXTURE_H
 
 #include "texture.h"
+#include "texture-source.h"
+#include "uploadbatch.h"
+#include "../core/threadpool.h"
+#include <future>
 #include <string>
 #include <memory>
 
-enum TextureImportFlags {
-	NONE = 0,
-	GENERATE_MIPMAPS = 1 << 0,
-	PREMULTIPLY_ALPHA = 1 << 1,
-};
+// the texel-data is staged in uploadBatch; the texture is ready for use once it has been submitted
+std::unique_ptr<Texture2D> importTexture2D(UploadBatch &uploadBatch, std::string filename, TextureImportFlags flags, ThreadPool *threadPool = nullptr);
+std::unique_ptr<TextureCube> importTextureCube(UploadBatch &uploadBatch, std::string filename, TextureImportFlags flags, ThreadPool *threadPool = nullptr);
+std::unique_ptr<Texture2DArray> importTexture2DArray(UploadBatch &uploadBatch, std::string filename, TextureImportFlags flags, ThreadPool *threadPool = nullptr);
 
-inline TextureImportFlags operator|(const TextureImportFlags &a, const TextureImportFlags &b)
-{
-	return static_cast<TextureImportFlags>(static_cast<int>(a) | static_cast<int>(b));
-}
-
-inline TextureImportFlags operator |= (TextureImportFlags &a, const TextureImportFlags &b)
-{
-	return static_cast<TextureImportFlags>(static_cast<int>(a) | static_cast<int>(b));
-}
-
-std::unique_ptr<Texture2D> importTexture2D(std::string filename, TextureImportFlags flags);
-std::unique_ptr<TextureCube> importTextureCube(std::string filename, TextureImportFlags flags);
-std::unique_ptr<Texture2DArray> importTexture2DArray(std::string filename, TextureImportFlags flags);
+/*
+ * The same, but on threadPool; the calling thread may go on staging
+ * other things into uploadBatch, but must not submit it before the
+ * future is ready.
+ */
+std::future<std::unique_ptr<Texture2D>> importTexture2DAsync(ThreadPool &threadPool, UploadBatch &uploadBatch, std::string filename, TextureImportFlags flags);
+std::future<std::unique_ptr<TextureCube>> importTextureCubeAsync(ThreadPool &threadPool, UploadBatch &uploadBatch, std::string filename, TextureImportFlags flags);
+std::future<std::unique_ptr<Texture2DArray>> importTexture2DArrayAsync(ThreadPool &threadPool, UploadBatch &uploadBatch, std::string filename, TextureImportFlags flags);
 
 #endif // IMPORT_TEXTURE_H
@@ -0,0 +1,37 @@
+#ifndef LINEAR_IMAGE_H
+#define LINEAR_IMAGE_H
+
+#include "../vulkan.h"
+
+/*
+ * How tightly packed texel data lines up with a subresource of a linear
+ * image, whose rows may be padded out to the layout's rowPitch. For
+ * block-compressed formats, a row is a whole row of blocks.
+ */
+struct LinearImageRows {
+	size_t rowSize;
+	uint32_t rowCount;
+};
+
+inline LinearImageRows getLinearImageRows(VkFormat format, uint32_t height, VkDeviceSize size)
+{
+	auto blockHeight = vulkan::getFormatBlockHeight(format);
+
+	LinearImageRows rows;
+	rows.rowCount = (height + blockHeight - 1) / blockHeight;
+	assert(size % rows.rowCount == 0);
+	rows.rowSize = size_t(size / rows.rowCount);
+	return rows;
+}
+
+// copies packed rows into a subresource mapped at dst, which starts at layout.offset
+inline void spreadLinearImageRows(void *dst, const VkSubresourceLayout &layout, const void *src, const LinearImageRows &rows)
+{
+	assert(rows.rowSize <= layout.rowPitch);
+	assert(layout.rowPitch * (rows.rowCount - 1) + rows.rowSize <= layout.size);
+
+	for (uint32_t row = 0; row < rows.rowCount; ++row)
+		memcpy(static_cast<uint8_t *>(dst) + layout.rowPitch * row, static_cast<const uint8_t *>(src) + rows.rowSize * row, rows.rowSize);
+}
+
+#endif // LINEAR_IMAGE_H
@@ -0,0 +1,726 @@
+#include "pixel-kernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define PIXEL_KERNELS_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+// lets GCC and Clang emit instructions beyond the baseline in single functions; MSVC always can
+#if defined(__GNUC__)
+#define TARGET(x) __attribute__((target(x)))
+#else
+#define TARGET(x)
+#endif
+
+/*
+ * Scalar versions; the fallback, and the reference the others have to
+ * match. Rows that don't fill a whole vector end up here as well.
+ */
+
+static void swizzleBGRA8ToRGBA8Scalar(uint8_t *dst, const uint8_t *src, size_t count)
+{
+	for (size_t i = 0; i < count; ++i) {
+		uint8_t b = src[i * 4 + 0], g = src[i * 4 + 1], r = src[i * 4 + 2], a = src[i * 4 + 3];
+		dst[i * 4 + 0] = r;
+		dst[i * 4 + 1] = g;
+		dst[i * 4 + 2] = b;
+		dst[i * 4 + 3] = a;
+	}
+}
+
+static void expandBGR8ToRGBA8Scalar(uint8_t *dst, const uint8_t *src, size_t count)
+{
+	for (size_t i = 0; i < count; ++i) {
+		dst[i * 4 + 0] = src[i * 3 + 2];
+		dst[i * 4 + 1] = src[i * 3 + 1];
+		dst[i * 4 + 2] = src[i * 3 + 0];
+		dst[i * 4 + 3] = 0xff;
+	}
+}
+
+// round-to-nearest-even, like F16C with rounding-mode 0
+static uint16_t floatToHalf(float value)
+{
+	uint32_t x;
+	memcpy(&x, &value, sizeof(x));
+
+	auto sign = x & 0x80000000u;
+	x ^= sign;
+
+	uint16_t half;
+	if (x >= (127 + 16) << 23) {
+		// too large, infinite or NaN
+		half = x > (255u << 23) ? 0x7e00 : 0x7c00;
+	} else if (x < (127 - 14) << 23) {
+		// denormal or zero; let the FPU do the rounding
+		const uint32_t magicBits = ((127 - 15) + (23 - 10) + 1) << 23;
+		float magic, sum;
+		memcpy(&magic, &magicBits, sizeof(magic));
+		memcpy(&sum, &x, sizeof(sum));
+		sum += magic;
+
+		uint32_t sumBits;
+		memcpy(&sumBits, &sum, sizeof(sumBits));
+		half = uint16_t(sumBits - magicBits);
+	} else {
+		auto mantissaOdd = (x >> 13) & 1;
+		x += (uint32_t(15 - 127) << 23) + 0xfff + mantissaOdd;
+		half = uint16_t(x >> 13);
+	}
+
+	return half | uint16_t(sign >> 16);
+}
+
+static void convertRGB32FToRGBA16FScalar(uint16_t *dst, const float *src, size_t count)
+{
+	for (size_t i = 0; i < count; ++i) {
+		dst[i * 4 + 0] = floatToHalf(src[i * 3 + 0]);
+		dst[i * 4 + 1] = floatToHalf(src[i * 3 + 1]);
+		dst[i * 4 + 2] = floatToHalf(src[i * 3 + 2]);
+		dst[i * 4 + 3] = 0x3c00; // 1.0
+	}
+}
+
+/*
+ * Unsigned floats with a 5-bit exponent, like halves without the sign
+ * and with fewer mantissa bits; 6 for the 11-bit ones, 5 for 10-bit.
+ */
+static uint32_t floatToPackedFloat(float value, int mantissaBits)
+{
+	// also takes care of NaN
+	if (!(value > 0.0f))
+		return 0;
+
+	uint32_t x;
+	memcpy(&x, &value, sizeof(x));
+
+	auto shift = 23 - mantissaBits;
+	auto maxBits = ((127u + 15) << 23) | (((1u << mantissaBits) - 1) << shift);
+	x = std::min(x, maxBits);
+
+	if (x < (127 - 14) << 23) {
+		// denormal or zero; let the FPU do the rounding, like floatToHalf()
+		const uint32_t magicBits = ((127 - 15) + shift + 1) << 23;
+		float magic, sum;
+		memcpy(&magic, &magicBits, sizeof(magic));
+		memcpy(&sum, &x, sizeof(sum));
+		sum += magic;
+
+		uint32_t sumBits;
+		memcpy(&sumBits, &sum, sizeof(sumBits));
+		return sumBits - magicBits;
+	}
+
+	auto mantissaOdd = (x >> shift) & 1;
+	x += (uint32_t(15 - 127) << 23) + (1u << (shift - 1)) - 1 + mantissaOdd;
+	return x >> shift;
+}
+
+static void convertRGB32FToB10G11R11Scalar(uint32_t *dst, const float *src, size_t count)
+{
+	for (size_t i = 0; i < count; ++i) {
+		dst[i] = floatToPackedFloat(src[i * 3 + 0], 6) |
+		         floatToPackedFloat(src[i * 3 + 1], 6) << 11 |
+		         floatToPackedFloat(src[i * 3 + 2], 5) << 22;
+	}
+}
+
+// the largest shared-exponent value; 511/512 * 2^16
+static const float maxSharedExponentValue = 65408.0f;
+
+static float clampSharedExponent(float value)
+{
+	// NaN ends up as 0, just like with max/min in SSE
+	return value > 0.0f ? std::min(value, maxSharedExponentValue) : 0.0f;
+}
+
+// 2^(24 - exponent), which takes a channel to its 9-bit mantissa
+static float sharedExponentScale(int exponent)
+{
+	uint32_t bits = uint32_t(127 + 24 - exponent) << 23;
+	float scale;
+	memcpy(&scale, &bits, sizeof(scale));
+	return scale;
+}
+
+static void convertRGB32FToE5B9G9R9Scalar(uint32_t *dst, const float *src, size_t count)
+{
+	for (size_t i = 0; i < count; ++i) {
+		auto r = clampSharedExponent(src[i * 3 + 0]);
+		auto g = clampSharedExponent(src[i * 3 + 1]);
+		auto b = clampSharedExponent(src[i * 3 + 2]);
+
+		// the exponent of the largest channel, which might round up to the next one
+		auto maxChannel = std::max(r, std::max(g, b));
+		uint32_t maxBits;
+		memcpy(&maxBits, &maxChannel, sizeof(maxBits));
+		auto exponent = std::max(int(maxBits >> 23) - 127, -16) + 16;
+		if (uint32_t(maxChannel * sharedExponentScale(exponent) + 0.5f) == 512)
+			++exponent;
+
+		auto scale = sharedExponentScale(exponent);
+		dst[i] = uint32_t(r * scale + 0.5f) |
+		         uint32_t(g * scale + 0.5f) << 9 |
+		         uint32_t(b * scale + 0.5f) << 18 |
+		         uint32_t(exponent) << 27;
+	}
+}
+
+static void premultiplyAlpha8Scalar(uint8_t *dst, const uint8_t *src, size_t count)
+{
+	for (size_t i = 0; i < count; ++i) {
+		unsigned a = src[i * 4 + 3];
+		for (int c = 0; c < 3; ++c)
+			dst[i * 4 + c] = uint8_t((src[i * 4 + c] * a + 127) / 255);
+		dst[i * 4 + 3] = uint8_t(a);
+	}
+}
+
+static void encodeSRGB8Scalar(uint8_t *dst, const float *src, size_t count)
+{
+	for (size_t i = 0; i < count; ++i) {
+		// NaN ends up as 1.0, just like with min/max in SSE
+		auto x = src[i];
+		if (!(x < 1.0f))
+			x = 1.0f;
+		if (!(x > 0.0f))
+			x = 0.0f;
+
+		auto s = x <= 0.0031308f ? x * 12.92f : 1.055f * powf(x, 1.0f / 2.4f) - 0.055f;
+		dst[i] = uint8_t(s * 255.0f + 0.5f);
+	}
+}
+
+struct SRGBDecodeTable {
+	float values[256];
+
+	SRGBDecodeTable()
+	{
+		for (int i = 0; i < 256; ++i) {
+			auto s = i / 255.0;
+			values[i] = float(s <= 0.04045 ? s / 12.92 : pow((s + 0.055) / 1.055, 2.4));
+		}
+	}
+};
+
+static const float *getSRGBDecodeTable()
+{
+	static const SRGBDecodeTable table;
+	return table.values;
+}
+
+static void decodeSRGB8Scalar(float *dst, const uint8_t *src, size_t count)
+{
+	auto table = getSRGBDecodeTable();
+	for (size_t i = 0; i < count; ++i)
+		dst[i] = table[src[i]];
+}
+
+#ifdef PIXEL_KERNELS_X86
+
+TARGET("sse2")
+static void swizzleBGRA8ToRGBA8SSE2(uint8_t *dst, const uint8_t *src, size_t count)
+{
+	// no byte-shuffles in SSE2, but rotating each pixel's R and B past each other works
+	auto agMask = _mm_set1_epi32(0xff00ff00u);
+	auto rbMask = _mm_set1_epi32(0x00ff00ff);
+
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		auto pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 4));
+		auto ag = _mm_and_si128(pixels, agMask);
+		auto rb = _mm_and_si128(pixels, rbMask);
+		rb = _mm_or_si128(_mm_slli_epi32(rb, 16), _mm_srli_epi32(rb, 16));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 4), _mm_or_si128(ag, rb));
+	}
+
+	swizzleBGRA8ToRGBA8Scalar(dst + i * 4, src + i * 4, count - i);
+}
+
+// round(x * a / 255) for 16-bit lanes, exact for 8-bit inputs
+TARGET("sse2")
+static inline __m128i mulDiv255SSE2(__m128i x, __m128i a)
+{
+	auto t = _mm_add_epi16(_mm_mullo_epi16(x, a), _mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+TARGET("sse2")
+static void premultiplyAlpha8SSE2(uint8_t *dst, const uint8_t *src, size_t count)
+{
+	auto zero = _mm_setzero_si128();
+	auto alphaMask = _mm_set1_epi32(0xff000000u);
+
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		auto pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 4));
+
+		auto lo = _mm_unpacklo_epi8(pixels, zero);
+		auto hi = _mm_unpackhi_epi8(pixels, zero);
+		auto loAlpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, 0xff), 0xff);
+		auto hiAlpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, 0xff), 0xff);
+
+		auto result = _mm_packus_epi16(mulDiv255SSE2(lo, loAlpha), mulDiv255SSE2(hi, hiAlpha));
+		result = _mm_or_si128(_mm_andnot_si128(alphaMask, result), _mm_and_si128(alphaMask, pixels));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 4), result);
+	}
+
+	premultiplyAlpha8Scalar(dst + i * 4, src + i * 4, count - i);
+}
+
+// four RGB pixels as a vector per channel; each load reads one float into the next pixel, so stop short of the end
+TARGET("sse2")
+static inline void loadRGB32FSSE2(const float *src, __m128 *r, __m128 *g, __m128 *b)
+{
+	auto p0 = _mm_loadu_ps(src + 0);
+	auto p1 = _mm_loadu_ps(src + 3);
+	auto p2 = _mm_loadu_ps(src + 6);
+	auto p3 = _mm_loadu_ps(src + 9);
+	_MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+	*r = p0;
+	*g = p1;
+	*b = p2;
+}
+
+// integer max/min are SSE4.1, but everything here is non-negative, where float-compares order the bits the same
+TARGET("sse2")
+static inline __m128i floatToPackedFloatSSE2(__m128 value, int mantissaBits)
+{
+	auto shift = 23 - mantissaBits;
+	auto maxBits = int(((127u + 15) << 23) | (((1u << mantissaBits) - 1) << shift));
+	auto x = _mm_castps_si128(_mm_min_ps(_mm_max_ps(value, _mm_setzero_ps()), _mm_castsi128_ps(_mm_set1_epi32(maxBits))));
+
+	auto magicBits = _mm_set1_epi32(((127 - 15) + shift + 1) << 23);
+	auto denormal = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(_mm_castsi128_ps(x), _mm_castsi128_ps(magicBits))), magicBits);
+
+	auto shiftCount = _mm_cvtsi32_si128(shift);
+	auto mantissaOdd = _mm_and_si128(_mm_srl_epi32(x, shiftCount), _mm_set1_epi32(1));
+	auto bias = _mm_set1_epi32(int((uint32_t(15 - 127) << 23) + (1u << (shift - 1)) - 1));
+	auto normal = _mm_srl_epi32(_mm_add_epi32(_mm_add_epi32(x, bias), mantissaOdd), shiftCount);
+
+	auto isDenormal = _mm_cmplt_epi32(x, _mm_set1_epi32((127 - 14) << 23));
+	return _mm_or_si128(_mm_and_si128(isDenormal, denormal), _mm_andnot_si128(isDenormal, normal));
+}
+
+TARGET("sse2")
+static void convertRGB32FToB10G11R11SSE2(uint32_t *dst, const float *src, size_t count)
+{
+	size_t i = 0;
+	for (; i + 5 <= count; i += 4) {
+		__m128 r, g, b;
+		loadRGB32FSSE2(src + i * 3, &r, &g, &b);
+
+		auto packed = _mm_or_si128(floatToPackedFloatSSE2(r, 6),
+		              _mm_or_si128(_mm_slli_epi32(floatToPackedFloatSSE2(g, 6), 11),
+		                           _mm_slli_epi32(floatToPackedFloatSSE2(b, 5), 22)));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), packed);
+	}
+
+	convertRGB32FToB10G11R11Scalar(dst + i, src + i * 3, count - i);
+}
+
+TARGET("sse2")
+static inline __m128 sharedExponentScaleSSE2(__m128i exponent)
+{
+	return _mm_castsi128_ps(_mm_slli_epi32(_mm_sub_epi32(_mm_set1_epi32(127 + 24), exponent), 23));
+}
+
+TARGET("sse2")
+static void convertRGB32FToE5B9G9R9SSE2(uint32_t *dst, const float *src, size_t count)
+{
+	auto zero = _mm_setzero_ps();
+	auto maxValue = _mm_set1_ps(maxSharedExponentValue);
+	auto half = _mm_set1_ps(0.5f);
+
+	size_t i = 0;
+	for (; i + 5 <= count; i += 4) {
+		__m128 r, g, b;
+		loadRGB32FSSE2(src + i * 3, &r, &g, &b);
+
+		// max() with zero second picks zero for NaN
+		r = _mm_min_ps(_mm_max_ps(r, zero), maxValue);
+		g = _mm_min_ps(_mm_max_ps(g, zero), maxValue);
+		b = _mm_min_ps(_mm_max_ps(b, zero), maxValue);
+
+		auto maxChannel = _mm_max_ps(r, _mm_max_ps(g, b));
+		auto exponent = _mm_sub_epi32(_mm_srli_epi32(_mm_castps_si128(maxChannel), 23), _mm_set1_epi32(127 - 16));
+		auto tooSmall = _mm_cmplt_epi32(exponent, _mm_setzero_si128());
+		exponent = _mm_andnot_si128(tooSmall, exponent);
+
+		// the compare gives -1 where the mantissa overflows
+		auto maxMantissa = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(maxChannel, sharedExponentScaleSSE2(exponent)), half));
+		exponent = _mm_sub_epi32(exponent, _mm_cmpeq_epi32(maxMantissa, _mm_set1_epi32(512)));
+
+		auto scale = sharedExponentScaleSSE2(exponent);
+		auto rm = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(r, scale), half));
+		auto gm = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(g, scale), half));
+		auto bm = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(b, scale), half));
+
+		auto packed = _mm_or_si128(_mm_or_si128(rm, _mm_slli_epi32(gm, 9)),
+		                           _mm_or_si128(_mm_slli_epi32(bm, 18), _mm_slli_epi32(exponent, 27)));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), packed);
+	}
+
+	convertRGB32FToE5B9G9R9Scalar(dst + i, src + i * 3, count - i);
+}
+
+/*
+ * x^(1/2.4) as exp2(log2(x) / 2.4), with polynomials fitted over the
+ * mantissa; well within half a step of 8-bit output.
+ */
+
+TARGET("sse2")
+static inline __m128 log2SSE2(__m128 x)
+{
+	auto bits = _mm_castps_si128(x);
+	auto exponent = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127)));
+	auto t = _mm_sub_ps(_mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007fffff)), _mm_set1_epi32(0x3f800000))), _mm_set1_ps(1.0f));
+
+	auto p = _mm_set1_ps(0.0458871838f);
+	p = _mm_add_ps(_mm_mul_ps(p, t), _mm_set1_ps(-0.194426288f));
+	p = _mm_add_ps(_mm_mul_ps(p, t), _mm_set1_ps(0.41542466f));
+	p = _mm_add_ps(_mm_mul_ps(p, t), _mm_set1_ps(-0.708682904f));
+	p = _mm_add_ps(_mm_mul_ps(p, t), _mm_set1_ps(1.44182587f));
+	return _mm_add_ps(exponent, _mm_mul_ps(p, t));
+}
+
+// only for -126 < y <= 0, which is all that's needed here
+TARGET("sse2")
+static inline __m128 exp2SSE2(__m128 y)
+{
+	// truncation rounds towards zero, which is up for negative numbers
+	auto n = _mm_cvttps_epi32(y);
+	auto nf = _mm_cvtepi32_ps(n);
+	auto adjust = _mm_cmpgt_ps(nf, y);
+	n = _mm_add_epi32(n, _mm_castps_si128(adjust)); // -1 where adjusted
+	nf = _mm_sub_ps(nf, _mm_and_ps(adjust, _mm_set1_ps(1.0f)));
+	auto f = _mm_sub_ps(y, nf);
+
+	auto p = _mm_set1_ps(0.00187662645f);
+	p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(0.00898899184f));
+	p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(0.0558281555f));
+	p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(0.2401532f));
+	p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(0.693152745f));
+	p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(1.0f));
+
+	auto scale = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(n, _mm_set1_epi32(127)), 23));
+	return _mm_mul_ps(p, scale);
+}
+
+TARGET("sse2")
+static inline __m128i encodeSRGBSSE2(__m128 x)
+{
+	x = _mm_max_ps(_mm_min_ps(x, _mm_set1_ps(1.0f)), _mm_setzero_ps());
+
+	auto threshold = _mm_set1_ps(0.0031308f);
+	auto linear = _mm_mul_ps(x, _mm_set1_ps(12.92f));
+	auto curve = exp2SSE2(_mm_mul_ps(log2SSE2(_mm_max_ps(x, threshold)), _mm_set1_ps(1.0f / 2.4f)));
+	curve = _mm_sub_ps(_mm_mul_ps(curve, _mm_set1_ps(1.055f)), _mm_set1_ps(0.055f));
+
+	auto isLinear = _mm_cmple_ps(x, threshold);
+	auto s = _mm_or_ps(_mm_and_ps(isLinear, linear), _mm_andnot_ps(isLinear, curve));
+	return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(s, _mm_set1_ps(255.0f)), _mm_set1_ps(0.5f)));
+}
+
+TARGET("sse2")
+static void encodeSRGB8SSE2(uint8_t *dst, const float *src, size_t count)
+{
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		auto a = encodeSRGBSSE2(_mm_loadu_ps(src + i + 0));
+		auto b = encodeSRGBSSE2(_mm_loadu_ps(src + i + 4));
+		auto c = encodeSRGBSSE2(_mm_loadu_ps(src + i + 8));
+		auto d = encodeSRGBSSE2(_mm_loadu_ps(src + i + 12));
+		auto bytes = _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), bytes);
+	}
+
+	encodeSRGB8Scalar(dst + i, src + i, count - i);
+}
+
+TARGET("avx,f16c")
+static void convertRGB32FToRGBA16FF16C(uint16_t *dst, const float *src, size_t count)
+{
+	// xyz of each pixel, and 1.0 in w
+	auto xyzMask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+	auto one = _mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f);
+
+	// each load reads one float into the next pixel, so stop short of the end
+	size_t i = 0;
+	for (; i + 5 <= count; i += 4) {
+		auto p0 = _mm_or_ps(_mm_and_ps(_mm_loadu_ps(src + i * 3 + 0), xyzMask), one);
+		auto p1 = _mm_or_ps(_mm_and_ps(_mm_loadu_ps(src + i * 3 + 3), xyzMask), one);
+		auto p2 = _mm_or_ps(_mm_and_ps(_mm_loadu_ps(src + i * 3 + 6), xyzMask), one);
+		auto p3 = _mm_or_ps(_mm_and_ps(_mm_loadu_ps(src + i * 3 + 9), xyzMask), one);
+
+		auto p01 = _mm256_insertf128_ps(_mm256_castps128_ps256(p0), p1, 1);
+		auto p23 = _mm256_insertf128_ps(_mm256_castps128_ps256(p2), p3, 1);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 4 + 0), _mm256_cvtps_ph(p01, 0));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 4 + 8), _mm256_cvtps_ph(p23, 0));
+	}
+
+	convertRGB32FToRGBA16FScalar(dst + i * 4, src + i * 3, count - i);
+}
+
+TARGET("avx2")
+static void swizzleBGRA8ToRGBA8AVX2(uint8_t *dst, const uint8_t *src, size_t count)
+{
+	auto shuffle = _mm256_setr_epi8(
+		2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+		2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		auto pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i * 4));
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i * 4), _mm256_shuffle_epi8(pixels, shuffle));
+	}
+
+	swizzleBGRA8ToRGBA8Scalar(dst + i * 4, src + i * 4, count - i);
+}
+
+TARGET("avx2")
+static void expandBGR8ToRGBA8AVX2(uint8_t *dst, const uint8_t *src, size_t count)
+{
+	// four pixels per lane; -1 zeroes the byte, for alpha to be or'ed in
+	auto shuffle = _mm256_setr_epi8(
+		2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1,
+		2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+	auto alpha = _mm256_set1_epi32(0xff000000u);
+
+	// the second load reads four bytes past the eight pixels, so stop short of the end
+	size_t i = 0;
+	for (; i + 10 <= count; i += 8) {
+		auto lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 3 + 0));
+		auto hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 3 + 12));
+		auto pixels = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i * 4), _mm256_or_si256(_mm256_shuffle_epi8(pixels, shuffle), alpha));
+	}
+
+	expandBGR8ToRGBA8Scalar(dst + i * 4, src + i * 3, count - i);
+}
+
+TARGET("avx2")
+static inline __m256i mulDiv255AVX2(__m256i x, __m256i a)
+{
+	auto t = _mm256_add_epi16(_mm256_mullo_epi16(x, a), _mm256_set1_epi16(128));
+	return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
+
+TARGET("avx2")
+static void premultiplyAlpha8AVX2(uint8_t *dst, const uint8_t *src, size_t count)
+{
+	auto zero = _mm256_setzero_si256();
+	auto alphaMask = _mm256_set1_epi32(0xff000000u);
+	auto alphaShuffle = _mm256_setr_epi8(
+		6, 7, 6, 7, 6, 7, 6, 7, 14, 15, 14, 15, 14, 15, 14, 15,
+		6, 7, 6, 7, 6, 7, 6, 7, 14, 15, 14, 15, 14, 15, 14, 15);
+
+	// unpacking and packing both stay within lanes, so the pixel order survives
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		auto pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i * 4));
+
+		auto lo = _mm256_unpacklo_epi8(pixels, zero);
+		auto hi = _mm256_unpackhi_epi8(pixels, zero);
+		auto loAlpha = _mm256_shuffle_epi8(lo, alphaShuffle);
+		auto hiAlpha = _mm256_shuffle_epi8(hi, alphaShuffle);
+
+		auto result = _mm256_packus_epi16(mulDiv255AVX2(lo, loAlpha), mulDiv255AVX2(hi, hiAlpha));
+		result = _mm256_or_si256(_mm256_andnot_si256(alphaMask, result), _mm256_and_si256(alphaMask, pixels));
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i * 4), result);
+	}
+
+	premultiplyAlpha8Scalar(dst + i * 4, src + i * 4, count - i);
+}
+
+TARGET("avx2")
+static inline __m256 log2AVX2(__m256 x)
+{
+	auto bits = _mm256_castps_si256(x);
+	auto exponent = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(127)));
+	auto t = _mm256_sub_ps(_mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x007fffff)), _mm256_set1_epi32(0x3f800000))), _mm256_set1_ps(1.0f));
+
+	auto p = _mm256_set1_ps(0.0458871838f);
+	p = _mm256_add_ps(_mm256_mul_ps(p, t), _mm256_set1_ps(-0.194426288f));
+	p = _mm256_add_ps(_mm256_mul_ps(p, t), _mm256_set1_ps(0.41542466f));
+	p = _mm256_add_ps(_mm256_mul_ps(p, t), _mm256_set1_ps(-0.708682904f));
+	p = _mm256_add_ps(_mm256_mul_ps(p, t), _mm256_set1_ps(1.44182587f));
+	return _mm256_add_ps(exponent, _mm256_mul_ps(p, t));
+}
+
+TARGET("avx2")
+static inline __m256 exp2AVX2(__m256 y)
+{
+	auto nf = _mm256_floor_ps(y);
+	auto n = _mm256_cvtps_epi32(nf);
+	auto f = _mm256_sub_ps(y, nf);
+
+	auto p = _mm256_set1_ps(0.00187662645f);
+	p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(0.00898899184f));
+	p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(0.0558281555f));
+	p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(0.2401532f));
+	p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(0.693152745f));
+	p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(1.0f));
+
+	auto scale = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(n, _mm256_set1_epi32(127)), 23));
+	return _mm256_mul_ps(p, scale);
+}
+
+TARGET("avx2")
+static inline __m256i encodeSRGBAVX2(__m256 x)
+{
+	x = _mm256_max_ps(_mm256_min_ps(x, _mm256_set1_ps(1.0f)), _mm256_setzero_ps());
+
+	auto threshold = _mm256_set1_ps(0.0031308f);
+	auto linear = _mm256_mul_ps(x, _mm256_set1_ps(12.92f));
+	auto curve = exp2AVX2(_mm256_mul_ps(log2AVX2(_mm256_max_ps(x, threshold)), _mm256_set1_ps(1.0f / 2.4f)));
+	curve = _mm256_sub_ps(_mm256_mul_ps(curve, _mm256_set1_ps(1.055f)), _mm256_set1_ps(0.055f));
+
+	auto s = _mm256_blendv_ps(curve, linear, _mm256_cmp_ps(x, threshold, _CMP_LE_OQ));
+	return _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(s, _mm256_set1_ps(255.0f)), _mm256_set1_ps(0.5f)));
+}
+
+TARGET("avx2")
+static void encodeSRGB8AVX2(uint8_t *dst, const float *src, size_t count)
+{
+	size_t i = 0;
+	for (; i + 32 <= count; i += 32) {
+		auto a = encodeSRGBAVX2(_mm256_loadu_ps(src + i + 0));
+		auto b = encodeSRGBAVX2(_mm256_loadu_ps(src + i + 8));
+		auto c = encodeSRGBAVX2(_mm256_loadu_ps(src + i + 16));
+		auto d = encodeSRGBAVX2(_mm256_loadu_ps(src + i + 24));
+
+		// packing interleaves the lanes; put them back in order afterwards
+		auto bytes = _mm256_packus_epi16(_mm256_packs_epi32(a, b), _mm256_packs_epi32(c, d));
+		bytes = _mm256_permutevar8x32_epi32(bytes, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), bytes);
+	}
+
+	encodeSRGB8Scalar(dst + i, src + i, count - i);
+}
+
+TARGET("avx2")
+static void decodeSRGB8AVX2(float *dst, const uint8_t *src, size_t count)
+{
+	auto table = getSRGBDecodeTable();
+
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		auto indices = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + i)));
+		_mm256_storeu_ps(dst + i, _mm256_i32gather_ps(table, indices, 4));
+	}
+
+	decodeSRGB8Scalar(dst + i, src + i, count - i);
+}
+
+static void cpuid(int info[4], int leaf, int subleaf)
+{
+#ifdef _MSC_VER
+	__cpuidex(info, leaf, subleaf);
+#else
+	unsigned eax, ebx, ecx, edx;
+	__cpuid_count(leaf, subleaf, eax, ebx, ecx, edx);
+	info[0] = int(eax);
+	info[1] = int(ebx);
+	info[2] = int(ecx);
+	info[3] = int(edx);
+#endif
+}
+
+static uint64_t xgetbv0()
+{
+#ifdef _MSC_VER
+	return _xgetbv(0);
+#else
+	uint32_t eax, edx;
+	__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return (uint64_t(edx) << 32) | eax;
+#endif
+}
+
+#endif // PIXEL_KERNELS_X86
+
+unsigned getPixelKernelFeatures()
+{
+	unsigned features = PIXEL_KERNELS_SCALAR;
+
+#ifdef PIXEL_KERNELS_X86
+	int info[4];
+	cpuid(info, 0, 0);
+	auto maxLeaf = info[0];
+
+	cpuid(info, 1, 0);
+	if (info[3] & (1 << 26))
+		features |= PIXEL_KERNELS_SSE2;
+
+	// the VEX-encoded extensions also need the OS to preserve the YMM registers
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	if (!osxsave || !avx || (xgetbv0() & 6) != 6)
+		return features;
+
+	if (info[2] & (1 << 29))
+		features |= PIXEL_KERNELS_F16C;
+
+	if (maxLeaf >= 7) {
+		cpuid(info, 7, 0);
+		if (info[1] & (1 << 5))
+			features |= PIXEL_KERNELS_AVX2;
+	}
+#endif
+
+	return features;
+}
+
+PixelKernels getPixelKernels(unsigned features)
+{
+	PixelKernels kernels;
+	kernels.swizzleBGRA8ToRGBA8 = swizzleBGRA8ToRGBA8Scalar;
+	kernels.expandBGR8ToRGBA8 = expandBGR8ToRGBA8Scalar;
+	kernels.convertRGB32FToRGBA16F = convertRGB32FToRGBA16FScalar;
+	kernels.convertRGB32FToB10G11R11 = convertRGB32FToB10G11R11Scalar;
+	kernels.convertRGB32FToE5B9G9R9 = convertRGB32FToE5B9G9R9Scalar;
+	kernels.premultiplyAlpha8 = premultiplyAlpha8Scalar;
+	kernels.encodeSRGB8 = encodeSRGB8Scalar;
+	kernels.decodeSRGB8 = decodeSRGB8Scalar;
+
+#ifdef PIXEL_KERNELS_X86
+	if (features & PIXEL_KERNELS_SSE2) {
+		kernels.swizzleBGRA8ToRGBA8 = swizzleBGRA8ToRGBA8SSE2;
+		kernels.convertRGB32FToB10G11R11 = convertRGB32FToB10G11R11SSE2;
+		kernels.convertRGB32FToE5B9G9R9 = convertRGB32FToE5B9G9R9SSE2;
+		kernels.premultiplyAlpha8 = premultiplyAlpha8SSE2;
+		kernels.encodeSRGB8 = encodeSRGB8SSE2;
+	}
+
+	if (features & PIXEL_KERNELS_F16C)
+		kernels.convertRGB32FToRGBA16F = convertRGB32FToRGBA16FF16C;
+
+	if (features & PIXEL_KERNELS_AVX2) {
+		kernels.swizzleBGRA8ToRGBA8 = swizzleBGRA8ToRGBA8AVX2;
+		kernels.expandBGR8ToRGBA8 = expandBGR8ToRGBA8AVX2;
+		kernels.premultiplyAlpha8 = premultiplyAlpha8AVX2;
+		kernels.encodeSRGB8 = encodeSRGB8AVX2;
+		kernels.decodeSRGB8 = decodeSRGB8AVX2;
+	}
+#else
+	(void)features;
+#endif
+
+	return kernels;
+}
+
+const PixelKernels &getPixelKernels()
+{
+	static const PixelKernels kernels = getPixelKernels(getPixelKernelFeatures());
+	return kernels;
+}
@@ -0,0 +1,58 @@
+#ifndef PIXEL_KERNELS_H
+#define PIXEL_KERNELS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum PixelKernelFeatures {
+	PIXEL_KERNELS_SCALAR = 0,
+	PIXEL_KERNELS_SSE2 = 1 << 0,
+	PIXEL_KERNELS_F16C = 1 << 1,
+	PIXEL_KERNELS_AVX2 = 1 << 2,
+};
+
+/*
+ * Row kernels for converting texel-data, each converting count pixels.
+ * Channel-order follows FreeImage on little-endian machines, so 8-bit
+ * sources are BGR(A). Unless noted, dst and src must not overlap.
+ */
+struct PixelKernels {
+	// BGRA -> RGBA; swapping R and B works both ways, and in-place as well
+	void (*swizzleBGRA8ToRGBA8)(uint8_t *dst, const uint8_t *src, size_t count);
+
+	// BGR -> RGBA, with opaque alpha
+	void (*expandBGR8ToRGBA8)(uint8_t *dst, const uint8_t *src, size_t count);
+
+	// RGB float -> RGBA half-float, with alpha 1.0; rounds to nearest even
+	void (*convertRGB32FToRGBA16F)(uint16_t *dst, const float *src, size_t count);
+
+	/*
+	 * RGB float -> VK_FORMAT_B10G11R11_UFLOAT_PACK32; rounds to nearest
+	 * even. Negative numbers and NaN become 0, and anything too large
+	 * the largest finite value.
+	 */
+	void (*convertRGB32FToB10G11R11)(uint32_t *dst, const float *src, size_t count);
+
+	// RGB float -> VK_FORMAT_E5B9G9R9_UFLOAT_PACK32, clamped the same way; as in the Vulkan spec
+	void (*convertRGB32FToE5B9G9R9)(uint32_t *dst, const float *src, size_t count);
+
+	// multiplies the three color channels by alpha (the fourth byte); may be in-place
+	void (*premultiplyAlpha8)(uint8_t *dst, const uint8_t *src, size_t count);
+
+	// linear float -> sRGB 8-bit, per channel rather than per pixel
+	void (*encodeSRGB8)(uint8_t *dst, const float *src, size_t count);
+
+	// sRGB 8-bit -> linear float, per channel rather than per pixel
+	void (*decodeSRGB8)(float *dst, const uint8_t *src, size_t count);
+};
+
+// the PIXEL_KERNELS_* this CPU supports
+unsigned getPixelKernelFeatures();
+
+// the fastest kernels using only the given features; mostly for testing and benchmarking
+PixelKernels getPixelKernels(unsigned features);
+
+// the fastest kernels for this CPU
+const PixelKernels &getPixelKernels();
+
+#endif // PIXEL_KERNELS_H
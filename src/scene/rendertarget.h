@@ -2,6 +2,7 @@
 #define RENDERTARGET_H
 
 #include "../vulkan.h"
+#include "../memoryallocator.h"
 
 class RenderTargetBase {
 protected:
@@ -29,14 +30,7 @@ protected:
 		VkResult err = vkCreateImage(device, &imageCreateInfo, nullptr, &image);
 		assert(err == VK_SUCCESS);
 
-		VkMemoryRequirements memoryRequirements;
-		vkGetImageMemoryRequirements(device, image, &memoryRequirements);
-
-		auto memoryTypeIndex = getMemoryTypeIndex(memoryRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-		auto deviceMemory = allocateDeviceMemory(memoryRequirements.size, memoryTypeIndex);
-
-		err = vkBindImageMemory(device, image, deviceMemory, 0);
-		assert(err == VK_SUCCESS);
+		memory = allocateImageMemory(image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, false);
 
 		VkImageSubresourceRange subresourceRange;
 		subresourceRange.aspectMask = aspect;
@@ -49,6 +43,13 @@ protected:
 	}
 
 public:
+	virtual ~RenderTargetBase()
+	{
+		vkDestroyImageView(device, imageView, nullptr);
+		vkDestroyImage(device, image, nullptr);
+		freeDeviceMemory(memory);
+	}
+
 	VkFormat getFormat() { return format; }
 
 	int getWidth() const { return width; }
@@ -68,6 +69,7 @@ protected:
 
 	VkImage image;
 	VkImageView imageView;
+	vulkan::DeviceMemoryAllocation memory;
 };
 
 class ColorRenderTarget : public RenderTargetBase {
@@ -103,6 +105,12 @@ public:
 		}
 	}
 
+	~Texture2DArrayRenderTarget()
+	{
+		for (auto arrayImageView : arrayImageViews)
+			vkDestroyImageView(device, arrayImageView, nullptr);
+	}
+
 	const std::vector<VkImageView> &getArrayImageViews() const
 	{
 		return arrayImageViews;
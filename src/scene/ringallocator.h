@@ -0,0 +1,73 @@
+#ifndef RINGALLOCATOR_H
+#define RINGALLOCATOR_H
+
+#include "../vulkan.h"
+
+/*
+ * Offset bookkeeping for a ring of size bytes, which doesn't need to be
+ * a multiple of any alignment. head and tail count the bytes ever
+ * allocated and retired, including the padding skipped for alignment
+ * or at the wrap, so head - tail is the space in use.
+ */
+class RingAllocator {
+public:
+	explicit RingAllocator(VkDeviceSize size) :
+		size(size),
+		head(0),
+		tail(0)
+	{
+		assert(size > 0);
+	}
+
+	// returns false, and leaves the ring untouched, if there isn't enough free space
+	bool allocate(VkDeviceSize allocationSize, VkDeviceSize alignment, VkDeviceSize &offset)
+	{
+		assert(allocationSize <= size);
+
+		// align the position within the ring, not head, as size needn't be aligned
+		auto position = head % size;
+		auto alignedOffset = vulkan::alignSize(position, std::max(alignment, VkDeviceSize(1)));
+		auto padding = alignedOffset - position;
+
+		// allocations can't straddle the end of the ring, so skip to its start
+		if (alignedOffset + allocationSize > size) {
+			alignedOffset = 0;
+			padding = size - position;
+		}
+
+		if (head + padding + allocationSize - tail > size)
+			return false;
+
+		head += padding + allocationSize;
+		offset = alignedOffset;
+		return true;
+	}
+
+	// frees everything allocated before head was end
+	void retire(VkDeviceSize end)
+	{
+		assert(end - tail <= head - tail);
+		tail = end;
+	}
+
+	VkDeviceSize getHead() const
+	{
+		return head;
+	}
+
+	VkDeviceSize getUsed() const
+	{
+		return head - tail;
+	}
+
+	VkDeviceSize getSize() const
+	{
+		return size;
+	}
+
+private:
+	VkDeviceSize size;
+	VkDeviceSize head, tail;
+};
+
+#endif // RINGALLOCATOR_H
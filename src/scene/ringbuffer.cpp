@@ -0,0 +1,78 @@
+#include "ringbuffer.h"
+
+#include <stdexcept>
+
+using namespace vulkan;
+
+using std::runtime_error;
+
+RingBuffer::RingBuffer(VkDeviceSize size, VkBufferUsageFlags usageFlags) :
+	buffer(size, usageFlags, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT),
+	ring(size),
+	currentFence(VK_NULL_HANDLE)
+{
+	// dynamic offsets are 32-bit
+	assert(size <= UINT32_MAX);
+	data = static_cast<uint8_t *>(buffer.map(0, size));
+}
+
+void RingBuffer::retireOldestFrame(bool wait)
+{
+	assert(!pendingFrames.empty());
+	auto &frame = pendingFrames.front();
+
+	if (wait) {
+		VkResult err = vkWaitForFences(device, 1, &frame.fence, VK_TRUE, UINT64_MAX);
+		assert(err == VK_SUCCESS);
+	}
+
+	ring.retire(frame.end);
+	pendingFrames.pop_front();
+}
+
+void RingBuffer::beginFrame(VkFence fence)
+{
+	assert(fence != VK_NULL_HANDLE);
+	assert(vkGetFenceStatus(device, fence) == VK_SUCCESS);
+
+	if (currentFence != VK_NULL_HANDLE) {
+		PendingFrame frame = { currentFence, ring.getHead() };
+		pendingFrames.push_back(frame);
+	}
+
+	// the queue retires in order, so everything up to the last use of this fence is done
+	size_t retired = 0;
+	for (size_t i = 0; i < pendingFrames.size(); ++i)
+		if (pendingFrames[i].fence == fence)
+			retired = i + 1;
+
+	while (retired-- > 0)
+		retireOldestFrame(false);
+
+	while (!pendingFrames.empty() && vkGetFenceStatus(device, pendingFrames.front().fence) == VK_SUCCESS)
+		retireOldestFrame(false);
+
+	currentFence = fence;
+}
+
+RingAllocation RingBuffer::allocate(VkDeviceSize allocationSize, VkDeviceSize alignment)
+{
+	assert(currentFence != VK_NULL_HANDLE);
+
+	if (allocationSize > ring.getSize())
+		throw runtime_error("ring-buffer allocation too large!");
+
+	VkDeviceSize offset;
+	while (!ring.allocate(allocationSize, alignment, offset)) {
+		if (pendingFrames.empty())
+			throw runtime_error("ring-buffer exhausted within a single frame!");
+
+		retireOldestFrame(true);
+	}
+
+	RingAllocation allocation;
+	allocation.buffer = buffer.getBuffer();
+	allocation.offset = offset;
+	allocation.data = data + offset;
+	return allocation;
+}
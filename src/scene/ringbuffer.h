@@ -0,0 +1,91 @@
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+
+#include "buffer.h"
+#include "ringallocator.h"
+
+#include <deque>
+
+struct RingAllocation {
+	VkBuffer buffer;
+	VkDeviceSize offset;
+	void *data;
+};
+
+/*
+ * Persistently mapped buffer for data that is rewritten every frame.
+ * Allocations are handed out linearly, and the space used by a frame
+ * is only recycled once the fence guarding that frame has signaled.
+ */
+class RingBuffer {
+public:
+	RingBuffer(VkDeviceSize size, VkBufferUsageFlags usageFlags = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+
+	/*
+	 * Starts a new frame, whose submission will signal fence. The
+	 * caller must already have waited for the fence, but not yet
+	 * reset it.
+	 */
+	void beginFrame(VkFence fence);
+
+	RingAllocation allocate(VkDeviceSize size, VkDeviceSize alignment);
+
+	RingAllocation allocateUniform(VkDeviceSize size)
+	{
+		return allocate(size, vulkan::deviceProperties.limits.minUniformBufferOffsetAlignment);
+	}
+
+	RingAllocation allocateStorage(VkDeviceSize size)
+	{
+		return allocate(size, vulkan::deviceProperties.limits.minStorageBufferOffsetAlignment);
+	}
+
+	RingAllocation allocateVertices(VkDeviceSize size)
+	{
+		return allocate(size, 16);
+	}
+
+	RingAllocation allocateIndices(VkDeviceSize size)
+	{
+		return allocate(size, sizeof(uint32_t));
+	}
+
+	RingAllocation upload(const void *data, VkDeviceSize size, VkDeviceSize alignment)
+	{
+		auto allocation = allocate(size, alignment);
+		memcpy(allocation.data, data, size_t(size));
+		return allocation;
+	}
+
+	VkBuffer getBuffer() const
+	{
+		return buffer.getBuffer();
+	}
+
+	VkDeviceSize getSize() const
+	{
+		return ring.getSize();
+	}
+
+	VkDescriptorBufferInfo getDescriptorBufferInfo(VkDeviceSize range)
+	{
+		return buffer.getDescriptorBufferInfo(0, range);
+	}
+
+private:
+	void retireOldestFrame(bool wait);
+
+	struct PendingFrame {
+		VkFence fence;
+		VkDeviceSize end;
+	};
+
+	Buffer buffer;
+	uint8_t *data;
+	RingAllocator ring;
+
+	VkFence currentFence;
+	std::deque<PendingFrame> pendingFrames;
+};
+
+#endif // RINGBUFFER_H
@@ -5,7 +5,9 @@
 
 #include <glm/glm.hpp>
 
+#include <algorithm>
 #include <list>
+#include <vector>
 
 struct Vertex {
 	glm::vec3 position;
@@ -30,6 +32,19 @@ private:
 };
 
 class Material {
+public:
+	Material(Texture2D *albedoMap = nullptr, const glm::vec4 &albedoColor = glm::vec4(1)) :
+		albedoMap(albedoMap),
+		albedoColor(albedoColor),
+		normalMap(nullptr),
+		specularMap(nullptr)
+	{
+	}
+
+	Texture2D *getAlbedoMap() const { return albedoMap; }
+	const glm::vec4 &getAlbedoColor() const { return albedoColor; }
+
+private:
 	Texture2D *albedoMap;
 	glm::vec4 albedoColor;
 
@@ -56,9 +71,18 @@ private:
 	const Material &material;
 };
 
+class Scene;
+
+/*
+ * A node in the scene's transform hierarchy. The matrices live in the
+ * Scene, which keeps the absolute ones up to date in updateTransforms();
+ * a Transform is just a handle to its slot there.
+ */
 class Transform {
 public:
-	Transform() : parent(nullptr)
+	Transform() :
+		scene(nullptr),
+		index(UINT32_MAX)
 	{
 	}
 
@@ -66,50 +90,31 @@ public:
 	{
 	}
 
-	void setParent(Transform *parent)
-	{
-		if (this->parent) {
-			this->parent = nullptr;
-			unrooted();
-		}
-
-		this->parent = parent;
-
-		if (parent)
-			rooted();
-	}
-
-	virtual glm::mat4 getAbsoluteMatrix() const
-	{
-		glm::mat4 absoluteMatrix = getLocalMatrix();
-
-		const Transform *curr = getParent();
-		while (curr) {
-			absoluteMatrix = curr->getLocalMatrix() * absoluteMatrix;
-			curr = curr->getParent();
-		}
+	void setParent(Transform *parent);
 
-		return absoluteMatrix;
-	}
+	// as of the last Scene::updateTransforms()
+	const glm::mat4 &getAbsoluteMatrix() const;
 
 	const Transform *getRootTransform() const
 	{
 		const Transform *curr = this;
-		while (curr->parent)
-			curr = curr->parent;
+		while (curr->getParent())
+			curr = curr->getParent();
 
 		return curr;
 	}
 
-	Transform *getParent() const { return parent; }
-	virtual glm::mat4 getLocalMatrix() const = 0;
+	Transform *getParent() const;
+	const glm::mat4 &getLocalMatrix() const;
+
+	// slot in the scene's arrays, like Scene::getAbsoluteMatrices(); reparenting may move it, in the next update
+	uint32_t getIndex() const { return index; }
 
 protected:
-	virtual void rooted() {}
-	virtual void unrooted() {}
+	friend class Scene;
 
-private:
-	Transform *parent;
+	Scene *scene;
+	uint32_t index;
 };
 
 class RootTransform : public Transform {
@@ -117,32 +122,15 @@ public:
 	RootTransform() : Transform()
 	{
 	}
-
-	glm::mat4 getLocalMatrix() const override
-	{
-		return glm::mat4(1);
-	}
 };
 
 class MatrixTransform : public Transform {
 public:
 	MatrixTransform() : Transform()
 	{
-		localMatrix = glm::mat4(1);
-	}
-
-	glm::mat4 getLocalMatrix() const override
-	{
-		return localMatrix;
-	}
-
-	void setLocalMatrix(glm::mat4 localMatrix)
-	{
-		this->localMatrix = localMatrix;
 	}
 
-private:
-	glm::mat4 localMatrix;
+	void setLocalMatrix(const glm::mat4 &localMatrix);
 };
 
 class Object {
@@ -161,13 +149,24 @@ private:
 	const Transform &transform;
 };
 
+/*
+ * Transforms are kept as structure-of-arrays, sorted so parents come
+ * before their children. That way, updateTransforms() can compute all
+ * absolute matrices in a single pass, each from its parent's, and only
+ * for the subtrees where a local matrix or a parent has changed.
+ */
 class Scene {
 public:
-	Scene()
+	Scene() :
+		sorted(true)
 	{
-		transforms.push_back(&rootTransform);
+		addTransform(&rootTransform, nullptr);
 	}
 
+	// transforms refer back to their scene
+	Scene(const Scene &) = delete;
+	Scene &operator=(const Scene &) = delete;
+
 	MatrixTransform *createMatrixTransform(Transform *parent = nullptr)
 	{
 		auto trans = new MatrixTransform();
@@ -175,8 +174,7 @@ public:
 		if (parent == nullptr)
 			parent = &rootTransform;
 
-		trans->setParent(parent);
-		transforms.push_back(trans);
+		addTransform(trans, parent);
 		return trans;
 	}
 
@@ -189,16 +187,155 @@ public:
 		return obj;
 	}
 
+	// brings the absolute matrices up to date; call before using them, once everything has moved
+	void updateTransforms()
+	{
+		if (!sorted)
+			sortTransforms();
+
+		// parents come first, so their flags and matrices are final by the time the children get there
+		for (size_t i = 0; i < transforms.size(); ++i) {
+			auto parentIndex = parentIndices[i];
+			if (parentIndex != UINT32_MAX && dirtyFlags[parentIndex])
+				dirtyFlags[i] = 1;
+
+			if (!dirtyFlags[i])
+				continue;
+
+			if (parentIndex != UINT32_MAX)
+				absoluteMatrices[i] = absoluteMatrices[parentIndex] * localMatrices[i];
+			else
+				absoluteMatrices[i] = localMatrices[i];
+		}
+
+		std::fill(dirtyFlags.begin(), dirtyFlags.end(), uint8_t(0));
+	}
+
 	const Transform &getRootTransform() const { return rootTransform; }
 
 	const std::list<Object*> &getObjects() const { return objects; }
-	const std::list<Transform*> &getTransforms() const { return transforms; }
+
+	// in the order of the arrays; see Transform::getIndex()
+	const std::vector<Transform*> &getTransforms() const { return transforms; }
+	const std::vector<glm::mat4> &getAbsoluteMatrices() const { return absoluteMatrices; }
 
 private:
-	std::list<Transform*> transforms;
+	friend class Transform;
+	friend class MatrixTransform;
+
+	void addTransform(Transform *transform, Transform *parent)
+	{
+		assert(transform->scene == nullptr);
+		assert(!parent || parent->scene == this);
+
+		transform->scene = this;
+		transform->index = uint32_t(transforms.size());
+
+		transforms.push_back(transform);
+		parentIndices.push_back(parent ? parent->index : UINT32_MAX);
+		localMatrices.push_back(glm::mat4(1));
+		absoluteMatrices.push_back(glm::mat4(1));
+		dirtyFlags.push_back(1);
+	}
+
+	void setParent(uint32_t index, uint32_t parentIndex)
+	{
+		parentIndices[index] = parentIndex;
+		dirtyFlags[index] = 1;
+
+		// new transforms always come after their parents, but reparenting can break that
+		if (parentIndex != UINT32_MAX && parentIndex > index)
+			sorted = false;
+	}
+
+	void setLocalMatrix(uint32_t index, const glm::mat4 &localMatrix)
+	{
+		localMatrices[index] = localMatrix;
+		dirtyFlags[index] = 1;
+	}
+
+	// restores parents-first order, by depth; keeps the order otherwise, so most transforms stay put
+	void sortTransforms()
+	{
+		std::vector<uint32_t> depths(transforms.size());
+		for (size_t i = 0; i < transforms.size(); ++i) {
+			for (auto parentIndex = parentIndices[i]; parentIndex != UINT32_MAX; parentIndex = parentIndices[parentIndex]) {
+				assert(depths[i] < transforms.size()); // a cycle otherwise
+				++depths[i];
+			}
+		}
+
+		std::vector<uint32_t> order(transforms.size());
+		for (size_t i = 0; i < order.size(); ++i)
+			order[i] = uint32_t(i);
+		std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+			return depths[a] < depths[b];
+		});
+
+		std::vector<uint32_t> newIndices(transforms.size());
+		for (size_t i = 0; i < order.size(); ++i)
+			newIndices[order[i]] = uint32_t(i);
+
+		std::vector<Transform*> sortedTransforms(transforms.size());
+		std::vector<uint32_t> sortedParentIndices(transforms.size());
+		std::vector<glm::mat4> sortedLocalMatrices(transforms.size()), sortedAbsoluteMatrices(transforms.size());
+		std::vector<uint8_t> sortedDirtyFlags(transforms.size());
+		for (size_t i = 0; i < order.size(); ++i) {
+			auto oldIndex = order[i];
+			auto parentIndex = parentIndices[oldIndex];
+			sortedTransforms[i] = transforms[oldIndex];
+			sortedTransforms[i]->index = uint32_t(i);
+			sortedParentIndices[i] = parentIndex != UINT32_MAX ? newIndices[parentIndex] : UINT32_MAX;
+			sortedLocalMatrices[i] = localMatrices[oldIndex];
+			sortedAbsoluteMatrices[i] = absoluteMatrices[oldIndex];
+			sortedDirtyFlags[i] = dirtyFlags[oldIndex];
+		}
+
+		transforms.swap(sortedTransforms);
+		parentIndices.swap(sortedParentIndices);
+		localMatrices.swap(sortedLocalMatrices);
+		absoluteMatrices.swap(sortedAbsoluteMatrices);
+		dirtyFlags.swap(sortedDirtyFlags);
+		sorted = true;
+	}
+
+	std::vector<Transform*> transforms;
+	std::vector<uint32_t> parentIndices; // UINT32_MAX for roots
+	std::vector<glm::mat4> localMatrices, absoluteMatrices;
+	std::vector<uint8_t> dirtyFlags; // the local matrix or the parent changed since the last update
+	bool sorted;
+
 	std::list<Object*> objects;
 	RootTransform rootTransform;
 };
 
+inline void Transform::setParent(Transform *parent)
+{
+	assert(scene != nullptr);
+	assert(!parent || parent->scene == scene);
+	scene->setParent(index, parent ? parent->index : UINT32_MAX);
+}
+
+inline const glm::mat4 &Transform::getAbsoluteMatrix() const
+{
+	return scene->absoluteMatrices[index];
+}
+
+inline Transform *Transform::getParent() const
+{
+	auto parentIndex = scene->parentIndices[index];
+	return parentIndex != UINT32_MAX ? scene->transforms[parentIndex] : nullptr;
+}
+
+inline const glm::mat4 &Transform::getLocalMatrix() const
+{
+	return scene->localMatrices[index];
+}
+
+inline void MatrixTransform::setLocalMatrix(const glm::mat4 &localMatrix)
+{
+	scene->setLocalMatrix(index, localMatrix);
+}
+
 
 #endif // SCENE_H
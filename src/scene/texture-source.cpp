@@ -0,0 +1,461 @@
+#include "texture-source.h"
+#include "assetpack-format.h"
+#include "block-compress.h"
+#include "pixel-kernels.h"
+#include "../core/core.h"
+#include "../core/threadpool.h"
+
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <cstdio>
+#include <stdexcept>
+
+#include <sys/stat.h>
+
+using std::string;
+using std::runtime_error;
+using std::max;
+using std::min;
+using std::vector;
+using std::unique_ptr;
+using std::shared_ptr;
+using std::future;
+using std::function;
+
+#include <FreeImage.h>
+
+// the pixel-kernels assume FreeImage's little-endian layout
+static_assert(FI_RGBA_RED == 2 && FI_RGBA_GREEN == 1 && FI_RGBA_BLUE == 0 && FI_RGBA_ALPHA == 3, "unexpected channel-order");
+
+static int mipSize(int size, int mipLevel)
+{
+	return max(size >> mipLevel, 1);
+}
+
+// waits for all of them before rethrowing anything, as tasks tend to refer to the caller's locals
+static void waitAll(ThreadPool &threadPool, vector<future<void>> &futures)
+{
+	for (auto &future : futures)
+		threadPool.wait(future);
+	for (auto &future : futures)
+		future.get();
+}
+
+// runs body(0) .. body(count - 1), in parallel if there's a thread pool
+static void parallelFor(ThreadPool *threadPool, size_t count, const function<void(size_t)> &body)
+{
+	if (!threadPool) {
+		for (size_t i = 0; i < count; ++i)
+			body(i);
+		return;
+	}
+
+	vector<future<void>> futures;
+	for (size_t i = 0; i < count; ++i)
+		futures.push_back(threadPool->enqueue([&body, i] { body(i); }));
+	waitAll(*threadPool, futures);
+}
+
+static FIBITMAP *loadBitmap(string filename, VkFormat *format)
+{
+	FREE_IMAGE_FORMAT fif = FreeImage_GetFileType(filename.c_str(), 0);
+	if (fif == FIF_UNKNOWN) {
+		fif = FreeImage_GetFIFFromFilename(filename.c_str());
+		if (fif == FIF_UNKNOWN)
+			throw runtime_error("unknown image type");
+	}
+
+	if (!FreeImage_FIFSupportsReading(fif))
+		throw runtime_error(string("file format can't be read: ") + FreeImage_GetFIFDescription(fif));
+
+	FIBITMAP *dib = FreeImage_Load(fif, filename.c_str());
+	if (!dib)
+		throw runtime_error("failed to load image");
+
+	auto imageType = FreeImage_GetImageType(dib);
+	FIBITMAP *temp;
+	switch (imageType) {
+	case FIT_BITMAP:
+		// 24-bit gets expanded while copying, which saves a pass over the whole image
+		if (FreeImage_GetBPP(dib) != 24 && FreeImage_GetBPP(dib) != 32) {
+			temp = dib;
+			dib = FreeImage_ConvertTo32Bits(dib);
+			FreeImage_Unload(temp);
+			if (!dib)
+				throw runtime_error("failed to convert to 32bits!");
+		}
+		*format = VK_FORMAT_R8G8B8A8_UNORM;
+		break;
+
+	case FIT_RGBF:
+		*format = VK_FORMAT_R16G16B16A16_SFLOAT;
+		break;
+
+	default:
+		throw runtime_error("unsupported image-type!");
+	}
+
+	// left bottom-up, as FreeImage has it; copyPixels() reads the scanlines in reverse
+	return dib;
+}
+
+// what the source gets copied out as, before any packing or compression
+static VkFormat getExpandedFormat(FIBITMAP *dib)
+{
+	switch (FreeImage_GetImageType(dib)) {
+	case FIT_BITMAP: return VK_FORMAT_R8G8B8A8_UNORM; // 24-bit gets expanded to RGBA as well
+	case FIT_RGBF: return VK_FORMAT_R16G16B16A16_SFLOAT; // expand to RGBA, which is always supported
+	default:
+		unreachable("unsupported type!");
+	}
+}
+
+static size_t getPitch(VkFormat format, unsigned int width)
+{
+	auto pitch = assetPackSubresourceSize(format, width, 1);
+	assert(pitch > 0);
+	return size_t(pitch);
+}
+
+// format is the expanded one, or one of the packed HDR ones
+static void copyPixels(FIBITMAP *dib, VkFormat format, void *ptr)
+{
+	auto &kernels = getPixelKernels();
+	auto imageType = FreeImage_GetImageType(dib);
+	auto bpp = FreeImage_GetBPP(dib);
+	auto width = FreeImage_GetWidth(dib);
+	auto height = FreeImage_GetHeight(dib);
+	auto pitch = getPitch(format, width);
+
+	// FreeImage uses bottom-left origin, we use top-left; flipping while converting saves a pass
+	for (auto y = 0u; y < height; ++y) {
+		auto srcRow = FreeImage_GetScanLine(dib, height - 1 - y);
+		auto dstRow = static_cast<uint8_t *>(ptr) + pitch * y;
+
+		switch (imageType) {
+		case FIT_BITMAP:
+			assert(format == VK_FORMAT_R8G8B8A8_UNORM);
+			if (bpp == 24)
+				kernels.expandBGR8ToRGBA8(dstRow, srcRow, width);
+			else
+				kernels.swizzleBGRA8ToRGBA8(dstRow, srcRow, width);
+			break;
+		case FIT_RGBF:
+			switch (format) {
+			case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
+				kernels.convertRGB32FToB10G11R11(reinterpret_cast<uint32_t *>(dstRow), reinterpret_cast<const float *>(srcRow), width);
+				break;
+			case VK_FORMAT_E5B9G9R9_UFLOAT_PACK32:
+				kernels.convertRGB32FToE5B9G9R9(reinterpret_cast<uint32_t *>(dstRow), reinterpret_cast<const float *>(srcRow), width);
+				break;
+			default:
+				assert(format == VK_FORMAT_R16G16B16A16_SFLOAT);
+				kernels.convertRGB32FToRGBA16F(reinterpret_cast<uint16_t *>(dstRow), reinterpret_cast<const float *>(srcRow), width);
+			}
+			break;
+		default:
+			unreachable("unsupported type!");
+		}
+	}
+}
+
+// copies out a level, compressing it on the way if the format calls for that
+static void writePixels(FIBITMAP *dib, VkFormat format, void *ptr, ThreadPool *threadPool)
+{
+	if (!canCompressImage(format)) {
+		copyPixels(dib, format, ptr);
+		return;
+	}
+
+	// the encoders take what the uncompressed formats would get
+	auto width = int(FreeImage_GetWidth(dib));
+	auto height = int(FreeImage_GetHeight(dib));
+	auto expandedFormat = getExpandedFormat(dib);
+	auto pitch = getPitch(expandedFormat, width);
+	vector<uint8_t> pixels(pitch * height);
+	copyPixels(dib, expandedFormat, pixels.data());
+
+	// encoding is slow enough to be worth splitting big levels up into bands of block-rows
+	const int bandHeight = 64;
+	auto bandSize = size_t(assetPackSubresourceSize(format, width, bandHeight));
+	parallelFor(threadPool, (height + bandHeight - 1) / bandHeight, [&](size_t band) {
+		auto top = int(band) * bandHeight;
+		compressImage(format, static_cast<uint8_t *>(ptr) + bandSize * band, &pixels[pitch * top], width, min(bandHeight, height - top));
+	});
+}
+
+static bool hasTranslucency(FIBITMAP *dib)
+{
+	if (FreeImage_GetImageType(dib) != FIT_BITMAP || FreeImage_GetBPP(dib) != 32)
+		return false;
+
+	auto width = FreeImage_GetWidth(dib);
+	auto height = FreeImage_GetHeight(dib);
+	for (auto y = 0u; y < height; ++y) {
+		auto row = FreeImage_GetScanLine(dib, y);
+		for (auto x = 0u; x < width; ++x) {
+			if (row[x * 4 + FI_RGBA_ALPHA] != 255)
+				return true;
+		}
+	}
+	return false;
+}
+
+// the formats flags ask for, in order of preference; the format the source expands to comes last
+static vector<VkFormat> getFormatCandidates(VkFormat format, const vector<FIBITMAP *> &layers, TextureImportFlags flags)
+{
+	vector<VkFormat> candidates;
+	if (format == VK_FORMAT_R16G16B16A16_SFLOAT) {
+		if (flags & TextureImportFlags::COMPRESS)
+			candidates.push_back(VK_FORMAT_BC6H_UFLOAT_BLOCK);
+
+		if (flags & TextureImportFlags::PACKED_HDR) {
+			if (flags & TextureImportFlags::HIGH_QUALITY) {
+				candidates.push_back(VK_FORMAT_E5B9G9R9_UFLOAT_PACK32);
+				candidates.push_back(VK_FORMAT_B10G11R11_UFLOAT_PACK32);
+			} else {
+				candidates.push_back(VK_FORMAT_B10G11R11_UFLOAT_PACK32);
+				candidates.push_back(VK_FORMAT_E5B9G9R9_UFLOAT_PACK32);
+			}
+		}
+	} else {
+		assert(format == VK_FORMAT_R8G8B8A8_UNORM);
+		if (flags & TextureImportFlags::COMPRESS) {
+			if (flags & TextureImportFlags::RED_CHANNEL)
+				candidates.push_back(VK_FORMAT_BC4_UNORM_BLOCK);
+			else if (flags & TextureImportFlags::RED_GREEN_CHANNELS)
+				candidates.push_back(VK_FORMAT_BC5_UNORM_BLOCK);
+			else if (flags & TextureImportFlags::HIGH_QUALITY)
+				candidates.push_back(VK_FORMAT_BC7_UNORM_BLOCK);
+			else
+				candidates.push_back(std::any_of(layers.begin(), layers.end(), hasTranslucency) ? VK_FORMAT_BC3_UNORM_BLOCK : VK_FORMAT_BC1_RGB_UNORM_BLOCK);
+		}
+	}
+
+	candidates.push_back(format);
+	return candidates;
+}
+
+// same rounding as FreeImage_PreMultiplyWithAlpha, which also leaves everything but 32-bit alone
+static void premultiplyAlpha(FIBITMAP *dib)
+{
+	if (FreeImage_GetImageType(dib) != FIT_BITMAP || FreeImage_GetBPP(dib) != 32)
+		return;
+
+	auto &kernels = getPixelKernels();
+	auto width = FreeImage_GetWidth(dib);
+	auto height = FreeImage_GetHeight(dib);
+	for (auto y = 0u; y < height; ++y) {
+		auto row = FreeImage_GetScanLine(dib, y);
+		kernels.premultiplyAlpha8(row, row, width);
+	}
+}
+
+TextureSource::TextureSource(VkFormat format, VkImageViewType viewType, vector<FIBITMAP *> layers, TextureImportFlags flags, const FormatChooser &chooseFormat) :
+	format(format),
+	viewType(viewType),
+	layers(std::move(layers))
+{
+	assert(!this->layers.empty());
+	width = FreeImage_GetWidth(this->layers[0]);
+	height = FreeImage_GetHeight(this->layers[0]);
+
+	mipLevels = 1;
+	if (flags & TextureImportFlags::GENERATE_MIPMAPS)
+		mipLevels = 32 - clz(max(width, height));
+
+	if (flags & (TextureImportFlags::COMPRESS | TextureImportFlags::PACKED_HDR)) {
+		try {
+			auto candidates = getFormatCandidates(format, this->layers, flags);
+			this->format = chooseFormat ? chooseFormat(candidates) : candidates.front();
+		} catch (...) {
+			for (auto dib : this->layers)
+				FreeImage_Unload(dib);
+			throw;
+		}
+	}
+}
+
+TextureSource::~TextureSource()
+{
+	for (auto dib : layers)
+		FreeImage_Unload(dib);
+}
+
+size_t TextureSource::getSubresourceSize(int mipLevel) const
+{
+	auto size = assetPackSubresourceSize(format, mipSize(width, mipLevel), mipSize(height, mipLevel));
+	assert(size > 0);
+	return size_t(size);
+}
+
+void TextureSource::write(const SubresourceWriter &writer, ThreadPool *threadPool) const
+{
+	writeMipLevels(writer, mipLevels, threadPool);
+}
+
+void TextureSource::writeBaseLevel(const SubresourceWriter &writer, ThreadPool *threadPool) const
+{
+	writeMipLevels(writer, 1, threadPool);
+}
+
+void TextureSource::writeMipLevels(const SubresourceWriter &writer, int mipLevelCount, ThreadPool *threadPool) const
+{
+	assert(0 < mipLevelCount && mipLevelCount <= mipLevels);
+
+	// the writer is only ever called from here, so it doesn't need to be thread-safe
+	vector<void *> destinations;
+	for (auto arrayLayer = 0; arrayLayer < getArrayLayers(); ++arrayLayer)
+		for (auto mipLevel = 0; mipLevel < mipLevelCount; ++mipLevel)
+			destinations.push_back(writer(mipLevel, arrayLayer, getSubresourceSize(mipLevel)));
+
+	parallelFor(threadPool, layers.size(), [&](size_t arrayLayer) {
+		writeLayer(int(arrayLayer), mipLevelCount, &destinations[arrayLayer * mipLevelCount], threadPool);
+	});
+}
+
+void TextureSource::writeLayer(int arrayLayer, int mipLevelCount, void *const *destinations, ThreadPool *threadPool) const
+{
+	// the base level belongs to us, the rest to whoever is done with them last
+	shared_ptr<FIBITMAP> dib(layers[arrayLayer], [](FIBITMAP *) {});
+
+	// each level is downscaled from the one above it, while that one gets copied out
+	vector<future<void>> copies;
+	for (auto mipLevel = 0; mipLevel < mipLevelCount; ++mipLevel) {
+		auto mipWidth = mipSize(width, mipLevel),
+		     mipHeight = mipSize(height, mipLevel);
+
+		if (mipLevel > 0) {
+			auto scaled = FreeImage_Rescale(dib.get(), mipWidth, mipHeight, FILTER_BOX);
+			assert(scaled != nullptr);
+			dib = shared_ptr<FIBITMAP>(scaled, FreeImage_Unload);
+		}
+
+		assert(FreeImage_GetWidth(dib.get()) == unsigned(mipWidth));
+		assert(FreeImage_GetHeight(dib.get()) == unsigned(mipHeight));
+
+		auto destination = destinations[mipLevel];
+		auto format = this->format;
+		if (threadPool)
+			copies.push_back(threadPool->enqueue([dib, format, destination, threadPool] { writePixels(dib.get(), format, destination, threadPool); }));
+		else
+			writePixels(dib.get(), format, destination, nullptr);
+	}
+
+	if (threadPool)
+		waitAll(*threadPool, copies);
+}
+
+unique_ptr<TextureSource> TextureSource::load2D(const string &filename, TextureImportFlags flags, const FormatChooser &chooseFormat)
+{
+	VkFormat format = VK_FORMAT_UNDEFINED;
+	auto dib = loadBitmap(filename, &format);
+	assert(format != VK_FORMAT_UNDEFINED);
+
+	if (flags & TextureImportFlags::PREMULTIPLY_ALPHA)
+		premultiplyAlpha(dib);
+
+	return unique_ptr<TextureSource>(new TextureSource(format, VK_IMAGE_VIEW_TYPE_2D, { dib }, flags, chooseFormat));
+}
+
+vector<string> TextureSource::getArrayLayerPaths(const string &folder)
+{
+	vector<string> paths;
+	for (int i = 0; true; ++i) {
+		char path[256];
+		snprintf(path, sizeof(path), "%s/%04d.png", folder.c_str(), i);
+
+		struct stat st;
+		if ((stat(path, &st) < 0) ||
+		    (st.st_mode & S_IFMT) != S_IFREG)
+			break;
+
+		paths.push_back(path);
+	}
+	return paths;
+}
+
+unique_ptr<TextureSource> TextureSource::load2DArray(const string &folder, TextureImportFlags flags, ThreadPool *threadPool, const FormatChooser &chooseFormat)
+{
+	auto paths = getArrayLayerPaths(folder);
+	if (paths.size() == 0)
+		throw runtime_error("empty texture-array!");
+
+	assert(paths.size() < INT_MAX);
+
+	// decoding is the slow part, so every layer gets its own task
+	vector<FIBITMAP *> bitmaps(paths.size(), nullptr);
+	vector<VkFormat> formats(paths.size(), VK_FORMAT_UNDEFINED);
+	try {
+		parallelFor(threadPool, paths.size(), [&](size_t i) {
+			bitmaps[i] = loadBitmap(paths[i], &formats[i]);
+
+			if (flags & TextureImportFlags::PREMULTIPLY_ALPHA)
+				premultiplyAlpha(bitmaps[i]);
+		});
+
+		for (size_t i = 1; i < bitmaps.size(); ++i) {
+			if (formats[i] != formats[0] ||
+			    FreeImage_GetWidth(bitmaps[i]) != FreeImage_GetWidth(bitmaps[0]) ||
+			    FreeImage_GetHeight(bitmaps[i]) != FreeImage_GetHeight(bitmaps[0]))
+				throw runtime_error("inconsistent format or size!");
+		}
+	} catch (...) {
+		for (auto dib : bitmaps)
+			if (dib)
+				FreeImage_Unload(dib);
+		throw;
+	}
+
+	return unique_ptr<TextureSource>(new TextureSource(formats[0], VK_IMAGE_VIEW_TYPE_2D_ARRAY, bitmaps, flags, chooseFormat));
+}
+
+unique_ptr<TextureSource> TextureSource::loadCube(const string &filename, TextureImportFlags flags, ThreadPool *threadPool, const FormatChooser &chooseFormat)
+{
+	VkFormat format = VK_FORMAT_UNDEFINED;
+	auto dib = loadBitmap(filename, &format);
+	assert(format != VK_FORMAT_UNDEFINED);
+
+	auto imageWidth = FreeImage_GetWidth(dib);
+	auto imageHeight = FreeImage_GetHeight(dib);
+	auto baseSize = imageWidth / 3;
+
+	if (imageWidth % 3 != 0 ||
+		imageHeight != baseSize * 4) {
+		FreeImage_Unload(dib);
+		throw runtime_error("unexpected image size!");
+	}
+
+	// FreeImage_Copy() counts from the top, like the cross is drawn
+	static const int offsets[6][2] = {
+		{ 2, 1 }, // -X
+		{ 0, 1 }, // +X
+		{ 1, 0 }, // +Y
+		{ 1, 2 }, // -Y
+		{ 1, 1 }, // +Z
+		{ 1, 3 }, // -Z - this one is upside down :(
+	};
+
+	// only reads from the cross, so the faces can be cut out in parallel
+	vector<FIBITMAP *> faces(6, nullptr);
+	parallelFor(threadPool, faces.size(), [&](size_t face) {
+		auto left = offsets[face][0] * baseSize,
+		     top  = offsets[face][1] * baseSize;
+		auto faceDib = FreeImage_Copy(dib, left, top, left + baseSize, top + baseSize);
+
+		if (face == 5) {
+			FreeImage_FlipVertical(faceDib);
+			FreeImage_FlipHorizontal(faceDib);
+		}
+
+		// just the faces, rather than the whole cross
+		if (flags & TextureImportFlags::PREMULTIPLY_ALPHA)
+			premultiplyAlpha(faceDib);
+
+		faces[face] = faceDib;
+	});
+
+	FreeImage_Unload(dib);
+	return unique_ptr<TextureSource>(new TextureSource(format, VK_IMAGE_VIEW_TYPE_CUBE, faces, flags, chooseFormat));
+}
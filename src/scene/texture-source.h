@@ -0,0 +1,116 @@
+#ifndef TEXTURE_SOURCE_H
+#define TEXTURE_SOURCE_H
+
+#include <vulkan/vulkan.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct FIBITMAP;
+class ThreadPool;
+
+enum TextureImportFlags {
+	NONE = 0,
+	GENERATE_MIPMAPS = 1 << 0,
+	PREMULTIPLY_ALPHA = 1 << 1,
+
+	// block-compressed; BC1 for opaque images, BC3 with alpha, BC6H for HDR
+	COMPRESS = 1 << 2,
+
+	// quality over size; BC7 instead of BC1 and BC3, at twice the size of BC1, and E5B9G9R9 instead of B10G11R11
+	HIGH_QUALITY = 1 << 3,
+
+	// only matter along with COMPRESS; only red is used (BC4), or just red and green, like for normal-maps (BC5)
+	RED_CHANNEL = 1 << 4,
+	RED_GREEN_CHANNELS = 1 << 5,
+
+	/*
+	 * HDR images in 32 bits per texel rather than 64, as packed floats
+	 * without alpha or sign. B10G11R11 has separate exponents but fewer
+	 * mantissa bits; E5B9G9R9 shares one exponent between 9-bit ones.
+	 * With COMPRESS, they're the fallback for when BC6H isn't supported.
+	 */
+	PACKED_HDR = 1 << 6,
+};
+
+inline TextureImportFlags operator|(const TextureImportFlags &a, const TextureImportFlags &b)
+{
+	return static_cast<TextureImportFlags>(static_cast<int>(a) | static_cast<int>(b));
+}
+
+inline TextureImportFlags operator |= (TextureImportFlags &a, const TextureImportFlags &b)
+{
+	return static_cast<TextureImportFlags>(static_cast<int>(a) | static_cast<int>(b));
+}
+
+/*
+ * Returns memory for the tightly packed texel-data of a subresource. It
+ * is called for every subresource before any of them gets written, and
+ * the memory has to stay valid until write() returns.
+ */
+typedef std::function<void *(int mipLevel, int arrayLayer, size_t size)> SubresourceWriter;
+
+/*
+ * Picks the first of the candidate formats the device supports. They
+ * come in order of preference, with an uncompressed one last. Without
+ * one, the first candidate is taken.
+ */
+typedef std::function<VkFormat(const std::vector<VkFormat> &candidates)> FormatChooser;
+
+/*
+ * Decoded source images of a texture, before they go anywhere. This
+ * doesn't touch the device, so the importers and the offline baker can
+ * both use it.
+ *
+ * Given a thread pool, layers and faces are decoded in parallel, and
+ * write() generates the mip-chains of all layers at once while the
+ * finished levels are copied out. Without one, everything runs on the
+ * calling thread.
+ *
+ * Block-compression happens as the levels are copied out, so the mips
+ * are downscaled from the uncompressed levels above them.
+ */
+class TextureSource {
+public:
+	~TextureSource();
+
+	TextureSource(const TextureSource &) = delete;
+	TextureSource &operator=(const TextureSource &) = delete;
+
+	static std::unique_ptr<TextureSource> load2D(const std::string &filename, TextureImportFlags flags, const FormatChooser &chooseFormat = nullptr);
+	static std::unique_ptr<TextureSource> loadCube(const std::string &filename, TextureImportFlags flags, ThreadPool *threadPool = nullptr, const FormatChooser &chooseFormat = nullptr);
+	static std::unique_ptr<TextureSource> load2DArray(const std::string &folder, TextureImportFlags flags, ThreadPool *threadPool = nullptr, const FormatChooser &chooseFormat = nullptr);
+
+	// the files load2DArray() reads, in layer order
+	static std::vector<std::string> getArrayLayerPaths(const std::string &folder);
+
+	// what write() produces
+	VkFormat getFormat() const { return format; }
+	VkImageViewType getViewType() const { return viewType; }
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+	int getMipLevels() const { return mipLevels; }
+	int getArrayLayers() const { return int(layers.size()); }
+
+	// generates the mip-chains, and hands out every subresource in upload-order; layer by layer, mip by mip
+	void write(const SubresourceWriter &writer, ThreadPool *threadPool = nullptr) const;
+
+	// just level 0 of every layer, for when the rest of the chain is generated on the GPU
+	void writeBaseLevel(const SubresourceWriter &writer, ThreadPool *threadPool = nullptr) const;
+
+private:
+	TextureSource(VkFormat format, VkImageViewType viewType, std::vector<FIBITMAP *> layers, TextureImportFlags flags, const FormatChooser &chooseFormat);
+
+	size_t getSubresourceSize(int mipLevel) const;
+	void writeMipLevels(const SubresourceWriter &writer, int mipLevelCount, ThreadPool *threadPool) const;
+	void writeLayer(int arrayLayer, int mipLevelCount, void *const *destinations, ThreadPool *threadPool) const;
+
+	VkFormat format;
+	VkImageViewType viewType;
+	int width, height, mipLevels;
+	std::vector<FIBITMAP *> layers;
+};
+
+#endif // TEXTURE_SOURCE_H
@@ -1,5 +1,7 @@
 #include "texture.h"
 
+#include <utility>
+
 using namespace vulkan;
 
 TextureBase::TextureBase(VkFormat format, VkImageType imageType, VkImageViewType imageViewType, int width, int height, int depth, int mipLevels, int arrayLayers, bool useStaging) :
@@ -7,7 +9,9 @@ TextureBase::TextureBase(VkFormat format, VkImageType imageType, VkImageViewType
 	baseHeight(height),
 	baseDepth(depth),
 	mipLevels(mipLevels),
-	arrayLayers(arrayLayers)
+	arrayLayers(arrayLayers),
+	format(format),
+	linear(!useStaging)
 {
 	assert(0 < width && (uint32_t)width <= UINT32_MAX);
 	assert(0 < height && (uint32_t)height <= UINT32_MAX);
@@ -34,20 +38,18 @@ TextureBase::TextureBase(VkFormat format, VkImageType imageType, VkImageViewType
 	imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 	imageCreateInfo.initialLayout = useStaging ? VK_IMAGE_LAYOUT_UNDEFINED : VK_IMAGE_LAYOUT_PREINITIALIZED;
 
+	// uploaded into, and mip-levels blitted from the ones above
 	if (useStaging)
-		imageCreateInfo.usage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		imageCreateInfo.usage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
 
 	VkResult err = vkCreateImage(device, &imageCreateInfo, nullptr, &image);
 	assert(err == VK_SUCCESS);
 
-	VkMemoryRequirements memoryRequirements;
-	vkGetImageMemoryRequirements(device, image, &memoryRequirements);
-
-	auto memoryTypeIndex = getMemoryTypeIndex(memoryRequirements, useStaging ? VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT : VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
-	deviceMemory = allocateDeviceMemory(memoryRequirements.size, memoryTypeIndex);
-
-	err = vkBindImageMemory(device, image, deviceMemory, 0);
-	assert(err == VK_SUCCESS);
+	// linear images are sampled straight from where they're written, so device-local is best there too, if available
+	if (useStaging)
+		memory = allocateImageMemory(image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, false);
+	else
+		memory = allocateImageMemory(image, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, true, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
 	VkImageSubresourceRange subresourceRange;
 	subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -57,57 +59,43 @@ TextureBase::TextureBase(VkFormat format, VkImageType imageType, VkImageViewType
 	subresourceRange.layerCount = arrayLayers;
 
 	imageView = createImageView(image, imageViewType, format, subresourceRange);
-}
-
-void TextureBase::uploadFromStagingBuffer(StagingBuffer *stagingBuffer, int mipLevel, int arrayLayer)
-{
-	assert(stagingBuffer != nullptr);
 
-	auto commandBuffer = allocateCommandBuffers(setupCommandPool, 1)[0];
+	heap = TextureHeap::getCurrent();
+	heapIndex = heap ? heap->add(imageView) : UINT32_MAX;
 
-	VkCommandBufferBeginInfo commandBufferBeginInfo = {};
-	commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	residency = TextureResidency::getCurrent();
+	residencyIndex = SIZE_MAX;
+	residencyCategory = TEXTURE_CATEGORY_OTHER;
+	lastUsedFrame = residency ? residency->getFrame() : 0;
+	if (residency)
+		residency->add(this);
+}
 
-	VkResult err = vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo);
-	assert(err == VK_SUCCESS);
+TextureBase::~TextureBase()
+{
+	if (residency)
+		residency->remove(this);
 
-	VkImageSubresourceRange subresourceRange = {
-		VK_IMAGE_ASPECT_COLOR_BIT,
-		uint32_t(mipLevel), 1,
-		uint32_t(arrayLayer), 1
-	};
-
-	imageBarrier(commandBuffer,
-		image, subresourceRange,
-		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
-		0, VK_ACCESS_TRANSFER_WRITE_BIT,
-		VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-
-	VkBufferImageCopy copyRegion = {};
-	copyRegion.bufferOffset = 0;
-	copyRegion.bufferRowLength = 0;
-	copyRegion.bufferImageHeight = 0;
-	copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	copyRegion.imageSubresource.baseArrayLayer = arrayLayer;
-	copyRegion.imageSubresource.mipLevel = mipLevel;
-	copyRegion.imageSubresource.layerCount = 1;
-	copyRegion.imageOffset = { 0, 0, 0 };
-	copyRegion.imageExtent.width = mipSize(baseWidth, mipLevel);
-	copyRegion.imageExtent.height = mipSize(baseHeight, mipLevel);
-	copyRegion.imageExtent.depth = mipSize(baseDepth, mipLevel);
-
-	vkCmdCopyBufferToImage(commandBuffer, stagingBuffer->getBuffer(), image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
-
-	err = vkEndCommandBuffer(commandBuffer);
-	assert(err == VK_SUCCESS);
+	if (heap)
+		heap->remove(heapIndex);
 
-	VkSubmitInfo submitInfo = {};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffer;
+	vkDestroyImageView(device, imageView, nullptr);
+	vkDestroyImage(device, image, nullptr);
+	freeDeviceMemory(memory);
+}
 
-	// Submit draw command buffer
-	err = vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-	assert(err == VK_SUCCESS);
+void TextureBase::swapStorage(TextureBase &other)
+{
+	std::swap(baseWidth, other.baseWidth);
+	std::swap(baseHeight, other.baseHeight);
+	std::swap(baseDepth, other.baseDepth);
+	std::swap(mipLevels, other.mipLevels);
+	std::swap(arrayLayers, other.arrayLayers);
+	std::swap(format, other.format);
+	std::swap(linear, other.linear);
+	std::swap(image, other.image);
+	std::swap(imageView, other.imageView);
+	std::swap(memory, other.memory);
+	std::swap(heap, other.heap);
+	std::swap(heapIndex, other.heapIndex);
 }
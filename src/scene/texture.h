@@ -3,6 +3,8 @@
 
 #include <algorithm>
 #include "buffer.h"
+#include "textureheap.h"
+#include "textureresidency.h"
 #include "../core/core.h"
 
 class TextureBase {
@@ -10,6 +12,7 @@ protected:
 	TextureBase(VkFormat format, VkImageType imageType, VkImageViewType imageViewType, int width, int height, int depth, int mipLevels = 1, int arrayLayers = 1, bool useStaging = true);
 
 public:
+	virtual ~TextureBase();
 
 	static int mipSize(int size, int mipLevel)
 	{
@@ -28,14 +31,69 @@ public:
 
 	int getMipLevels() const { return mipLevels; }
 	int getArrayLayers() const { return arrayLayers; }
+	VkFormat getFormat() const { return format; }
 
-	void uploadFromStagingBuffer(StagingBuffer *stagingBuffer, int mipLevel = 0, int arrayLayer = 0);
+	// linear images live in host-visible memory, and get written in place rather than staged
+	bool isLinear() const { return linear; }
+
+	VkImage getImage()
+	{
+		return image;
+	}
 
 	VkImageView getImageView()
 	{
 		return imageView;
 	}
 
+	// index into the texture heap that was current when the texture was created, or UINT32_MAX
+	uint32_t getHeapIndex() const
+	{
+		return heapIndex;
+	}
+
+	VkDeviceSize getMemorySize() const
+	{
+		return memory.size;
+	}
+
+	// what the texture will take up once the uploads in flight are done
+	virtual VkDeviceSize getCommittedSize() const
+	{
+		return memory.size;
+	}
+
+	// call whenever something is drawn with the texture; the least recently used ones are evicted first
+	void markUsed()
+	{
+		if (residency)
+			lastUsedFrame = residency->getFrame();
+	}
+
+	uint64_t getLastUsedFrame() const
+	{
+		return lastUsedFrame;
+	}
+
+	TextureCategory getResidencyCategory() const
+	{
+		return residencyCategory;
+	}
+
+	void setResidencyCategory(TextureCategory category)
+	{
+		if (residency)
+			residency->setCategory(this, category);
+		else
+			residencyCategory = category;
+	}
+
+	// releases what can be brought back later, like detail that can be streamed in again; false if there's nothing
+	virtual bool evict()
+	{
+		return false;
+	}
+
 	VkSubresourceLayout getSubresourceLayout(int mipLevel = 0, int arrayLayer = 0)
 	{
 		VkImageSubresource subRes = {};
@@ -48,6 +106,24 @@ public:
 		return ret;
 	}
 
+	// tightly packed copy of a whole subresource, for uploads
+	VkBufferImageCopy getBufferImageCopy(VkDeviceSize bufferOffset, int mipLevel = 0, int arrayLayer = 0)
+	{
+		VkBufferImageCopy copyRegion = {};
+		copyRegion.bufferOffset = bufferOffset;
+		copyRegion.bufferRowLength = 0;
+		copyRegion.bufferImageHeight = 0;
+		copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		copyRegion.imageSubresource.mipLevel = mipLevel;
+		copyRegion.imageSubresource.baseArrayLayer = arrayLayer;
+		copyRegion.imageSubresource.layerCount = 1;
+		copyRegion.imageOffset = { 0, 0, 0 };
+		copyRegion.imageExtent.width = getWidth(mipLevel);
+		copyRegion.imageExtent.height = getHeight(mipLevel);
+		copyRegion.imageExtent.depth = getDepth(mipLevel);
+		return copyRegion;
+	}
+
 	VkDescriptorImageInfo getDescriptorImageInfo(VkSampler textureSampler)
 	{
 		VkDescriptorImageInfo descriptorImageInfo;
@@ -59,24 +135,39 @@ public:
 
 	void *map(VkDeviceSize offset, VkDeviceSize size)
 	{
-		void *ret;
-		VkResult err = vkMapMemory(vulkan::device, deviceMemory, offset, size, 0, &ret);
-		assert(err == VK_SUCCESS);
-		return ret;
+		assert(memory.mappedData != nullptr);
+		assert(offset + size <= memory.size);
+		return static_cast<uint8_t *>(memory.mappedData) + offset;
 	}
 
 	void unmap()
 	{
-		vkUnmapMemory(vulkan::device, deviceMemory);
+		vulkan::flushDeviceMemory(memory);
 	}
 
 protected:
+	// trades images, memory, views and heap-slots, along with the sizes describing them
+	void swapStorage(TextureBase &other);
+
 	int baseWidth, baseHeight, baseDepth;
 	int mipLevels, arrayLayers;
+	VkFormat format;
+	bool linear;
 
 	VkImage image;
 	VkImageView imageView;
-	VkDeviceMemory deviceMemory;
+	vulkan::DeviceMemoryAllocation memory;
+
+	TextureHeap *heap;
+	uint32_t heapIndex;
+
+private:
+	friend class TextureResidency;
+
+	TextureResidency *residency;
+	size_t residencyIndex;
+	TextureCategory residencyCategory;
+	uint64_t lastUsedFrame;
 };
 
 class Texture2D : public TextureBase {
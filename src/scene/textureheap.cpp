@@ -0,0 +1,147 @@
+#include "textureheap.h"
+
+#include <stdexcept>
+
+using namespace vulkan;
+
+using std::lock_guard;
+using std::mutex;
+using std::runtime_error;
+
+TextureHeap *TextureHeap::current = nullptr;
+
+bool TextureHeap::isSupported()
+{
+	// draws pick their texture with a push-constant, which is uniform but not constant
+	return enabledFeatures.shaderSampledImageArrayDynamicIndexing &&
+	       enabledDescriptorIndexingFeatures.runtimeDescriptorArray &&
+	       enabledDescriptorIndexingFeatures.descriptorBindingPartiallyBound &&
+	       enabledDescriptorIndexingFeatures.descriptorBindingSampledImageUpdateAfterBind &&
+	       enabledDescriptorIndexingFeatures.descriptorBindingUpdateUnusedWhilePending;
+}
+
+TextureHeap::TextureHeap(uint32_t capacity, VkSampler sampler, int retireFrames) :
+	retireFrames(retireFrames),
+	nextIndex(0),
+	frame(0)
+{
+	if (!isSupported())
+		throw runtime_error("texture heap needs VK_EXT_descriptor_indexing with update-after-bind and update-unused-while-pending!");
+
+	assert(current == nullptr);
+
+	this->capacity = std::min({ capacity, deviceProperties.limits.maxPerStageDescriptorSampledImages, deviceProperties.limits.maxDescriptorSetSampledImages });
+
+	VkDescriptorSetLayoutBinding layoutBindings[2] = {};
+	layoutBindings[0].binding = 0;
+	layoutBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+	layoutBindings[0].descriptorCount = this->capacity;
+	layoutBindings[0].stageFlags = VK_SHADER_STAGE_ALL;
+
+	layoutBindings[1].binding = 1;
+	layoutBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+	layoutBindings[1].descriptorCount = 1;
+	layoutBindings[1].stageFlags = VK_SHADER_STAGE_ALL;
+	layoutBindings[1].pImmutableSamplers = &sampler;
+
+	// slots are written while other frames using the set are still pending, so they need both update flags
+	VkDescriptorBindingFlagsEXT bindingFlags[2] = {
+		VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT_EXT,
+		0
+	};
+
+	VkDescriptorSetLayoutBindingFlagsCreateInfoEXT bindingFlagsCreateInfo = {};
+	bindingFlagsCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+	bindingFlagsCreateInfo.bindingCount = ARRAY_SIZE(bindingFlags);
+	bindingFlagsCreateInfo.pBindingFlags = bindingFlags;
+
+	VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo = {};
+	descriptorSetLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	descriptorSetLayoutCreateInfo.pNext = &bindingFlagsCreateInfo;
+	descriptorSetLayoutCreateInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+	descriptorSetLayoutCreateInfo.bindingCount = ARRAY_SIZE(layoutBindings);
+	descriptorSetLayoutCreateInfo.pBindings = layoutBindings;
+
+	VkResult err = vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCreateInfo, nullptr, &descriptorSetLayout);
+	assert(err == VK_SUCCESS);
+
+	VkDescriptorPoolSize poolSizes[2] = {
+		{ VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, this->capacity },
+		{ VK_DESCRIPTOR_TYPE_SAMPLER, 1 }
+	};
+
+	VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {};
+	descriptorPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	descriptorPoolCreateInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+	descriptorPoolCreateInfo.poolSizeCount = ARRAY_SIZE(poolSizes);
+	descriptorPoolCreateInfo.pPoolSizes = poolSizes;
+	descriptorPoolCreateInfo.maxSets = 1;
+
+	err = vkCreateDescriptorPool(device, &descriptorPoolCreateInfo, nullptr, &descriptorPool);
+	assert(err == VK_SUCCESS);
+
+	descriptorSet = allocateDescriptorSet(descriptorPool, descriptorSetLayout);
+
+	current = this;
+}
+
+TextureHeap::~TextureHeap()
+{
+	if (current == this)
+		current = nullptr;
+
+	vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+	vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+}
+
+uint32_t TextureHeap::add(VkImageView imageView, VkImageLayout imageLayout)
+{
+	// also guards the descriptor set, which needs external synchronization
+	lock_guard<mutex> lock(indicesMutex);
+
+	uint32_t index;
+	if (!freeIndices.empty()) {
+		index = freeIndices.back();
+		freeIndices.pop_back();
+	} else if (nextIndex < capacity)
+		index = nextIndex++;
+	else
+		throw runtime_error("texture heap is full!");
+
+	VkDescriptorImageInfo descriptorImageInfo = {};
+	descriptorImageInfo.imageView = imageView;
+	descriptorImageInfo.imageLayout = imageLayout;
+
+	VkWriteDescriptorSet writeDescriptorSet = {};
+	writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	writeDescriptorSet.dstSet = descriptorSet;
+	writeDescriptorSet.dstBinding = 0;
+	writeDescriptorSet.dstArrayElement = index;
+	writeDescriptorSet.descriptorCount = 1;
+	writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+	writeDescriptorSet.pImageInfo = &descriptorImageInfo;
+	vkUpdateDescriptorSets(device, 1, &writeDescriptorSet, 0, nullptr);
+
+	return index;
+}
+
+void TextureHeap::remove(uint32_t index)
+{
+	lock_guard<mutex> lock(indicesMutex);
+	assert(index < nextIndex);
+
+	// the stale descriptor stays, but it's never used again, which is fine for a partially bound array
+	RetiredIndex retiredIndex = { index, frame };
+	retiredIndices.push_back(retiredIndex);
+}
+
+void TextureHeap::beginFrame()
+{
+	lock_guard<mutex> lock(indicesMutex);
+
+	++frame;
+	while (!retiredIndices.empty() && retiredIndices.front().frame + retireFrames < frame) {
+		freeIndices.push_back(retiredIndices.front().index);
+		retiredIndices.pop_front();
+	}
+}
@@ -0,0 +1,70 @@
+#ifndef TEXTUREHEAP_H
+#define TEXTUREHEAP_H
+
+#include "../vulkan.h"
+
+#include <deque>
+#include <mutex>
+#include <vector>
+
+/*
+ * One big, partially bound array of sampled images, that every texture
+ * adds itself to when it's created. Shaders pick textures by index
+ * instead of through per-draw descriptor sets:
+ *
+ *   layout (set = N, binding = 0) uniform texture2D textures[];
+ *   layout (set = N, binding = 1) uniform sampler textureSampler;
+ *
+ * The set is updated after bind, so textures can come and go while
+ * frames are in flight. Freed indices are only handed out again once
+ * retireFrames frames have begun, so in-flight frames can't see a slot
+ * change under them.
+ *
+ * Needs VK_EXT_descriptor_indexing, including updating unused slots
+ * while the set is pending; see isSupported().
+ */
+class TextureHeap {
+public:
+	TextureHeap(uint32_t capacity, VkSampler sampler, int retireFrames);
+	~TextureHeap();
+
+	TextureHeap(const TextureHeap &) = delete;
+	TextureHeap &operator=(const TextureHeap &) = delete;
+
+	static bool isSupported();
+
+	// the heap new textures go into, if any
+	static TextureHeap *getCurrent() { return current; }
+
+	uint32_t add(VkImageView imageView, VkImageLayout imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	void remove(uint32_t index);
+
+	// call once per frame, after waiting for the frame's fence
+	void beginFrame();
+
+	VkDescriptorSetLayout getDescriptorSetLayout() const { return descriptorSetLayout; }
+	VkDescriptorSet getDescriptorSet() const { return descriptorSet; }
+	uint32_t getCapacity() const { return capacity; }
+
+private:
+	struct RetiredIndex {
+		uint32_t index;
+		uint64_t frame;
+	};
+
+	static TextureHeap *current;
+
+	uint32_t capacity;
+	int retireFrames;
+	VkDescriptorSetLayout descriptorSetLayout;
+	VkDescriptorPool descriptorPool;
+	VkDescriptorSet descriptorSet;
+
+	std::mutex indicesMutex;
+	uint32_t nextIndex;
+	uint64_t frame;
+	std::vector<uint32_t> freeIndices;
+	std::deque<RetiredIndex> retiredIndices;
+};
+
+#endif // TEXTUREHEAP_H
@@ -0,0 +1,207 @@
+#include "textureresidency.h"
+#include "texture.h"
+
+#include <algorithm>
+
+using namespace vulkan;
+
+using std::lock_guard;
+using std::mutex;
+using std::vector;
+
+TextureResidency *TextureResidency::current = nullptr;
+
+const char *getTextureCategoryName(TextureCategory category)
+{
+	switch (category) {
+	case TEXTURE_CATEGORY_OTHER: return "other";
+	case TEXTURE_CATEGORY_IMPORTED: return "imported";
+	case TEXTURE_CATEGORY_ASSET_PACK: return "asset-pack";
+	case TEXTURE_CATEGORY_STREAMING: return "streaming";
+	case TEXTURE_CATEGORY_TRANSIENT: return "transient";
+	default:
+		unreachable("unexpected texture category");
+	}
+}
+
+TextureResidency::TextureResidency(VkDeviceSize budget, int unusedFrames) :
+	budget(budget),
+	deviceBudget(VK_WHOLE_SIZE),
+	unusedFrames(unusedFrames),
+	frame(0),
+	evictionCount(0),
+	evictedSize(0)
+{
+	assert(current == nullptr);
+	current = this;
+}
+
+TextureResidency::~TextureResidency()
+{
+	assert(textures.empty());
+
+	if (current == this)
+		current = nullptr;
+}
+
+void TextureResidency::add(TextureBase *texture)
+{
+	lock_guard<mutex> lock(texturesMutex);
+	texture->residencyIndex = textures.size();
+	textures.push_back(texture);
+}
+
+void TextureResidency::remove(TextureBase *texture)
+{
+	lock_guard<mutex> lock(texturesMutex);
+	assert(textures[texture->residencyIndex] == texture);
+
+	// swap with the last one, so the others keep their indices
+	auto last = textures.back();
+	textures[texture->residencyIndex] = last;
+	last->residencyIndex = texture->residencyIndex;
+	textures.pop_back();
+}
+
+void TextureResidency::setCategory(TextureBase *texture, TextureCategory category)
+{
+	lock_guard<mutex> lock(texturesMutex);
+	texture->residencyCategory = category;
+}
+
+bool TextureResidency::isRecentlyUsed(const TextureBase &texture) const
+{
+	return frame - texture.lastUsedFrame <= uint64_t(unusedFrames);
+}
+
+VkDeviceSize TextureResidency::getCommittedSize()
+{
+	lock_guard<mutex> lock(texturesMutex);
+
+	VkDeviceSize size = 0;
+	for (auto texture : textures) {
+		if (texture->residencyCategory != TEXTURE_CATEGORY_TRANSIENT)
+			size += texture->getCommittedSize();
+	}
+	return size;
+}
+
+void TextureResidency::update()
+{
+	++frame;
+
+	if (memoryBudgetEnabled)
+		updateDeviceBudget();
+
+	auto committedSize = getCommittedSize();
+	if (committedSize > getBudget())
+		evict(committedSize - getBudget());
+}
+
+void TextureResidency::updateDeviceBudget()
+{
+	VkPhysicalDeviceMemoryBudgetPropertiesEXT memoryBudgetProperties = {};
+	memoryBudgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+	VkPhysicalDeviceMemoryProperties2KHR memoryProperties2 = {};
+	memoryProperties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2_KHR;
+	memoryProperties2.pNext = &memoryBudgetProperties;
+	instanceFuncs.vkGetPhysicalDeviceMemoryProperties2KHR(physicalDevice, &memoryProperties2);
+
+	// what's left on the device-local heaps, on top of what the textures already have
+	VkDeviceSize available = 0;
+	auto &memoryProperties = memoryProperties2.memoryProperties;
+	for (auto i = 0u; i < memoryProperties.memoryHeapCount; ++i) {
+		if (!(memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT))
+			continue;
+
+		if (memoryBudgetProperties.heapBudget[i] > memoryBudgetProperties.heapUsage[i])
+			available += memoryBudgetProperties.heapBudget[i] - memoryBudgetProperties.heapUsage[i];
+	}
+
+	VkDeviceSize textureSize = 0;
+	{
+		lock_guard<mutex> lock(texturesMutex);
+		for (auto texture : textures)
+			textureSize += texture->getMemorySize();
+	}
+
+	deviceBudget = textureSize + available;
+}
+
+VkDeviceSize TextureResidency::evict(VkDeviceSize size)
+{
+	vector<TextureBase *> candidates;
+	{
+		lock_guard<mutex> lock(texturesMutex);
+		for (auto texture : textures) {
+			if (texture->residencyCategory != TEXTURE_CATEGORY_TRANSIENT && !isRecentlyUsed(*texture))
+				candidates.push_back(texture);
+		}
+	}
+
+	std::stable_sort(candidates.begin(), candidates.end(), [](const TextureBase *a, const TextureBase *b) {
+		return a->lastUsedFrame < b->lastUsedFrame;
+	});
+
+	// evicting creates the replacements, which register themselves, so this can't hold the lock
+	VkDeviceSize releasedSize = 0;
+	for (auto texture : candidates) {
+		if (releasedSize >= size)
+			break;
+
+		auto committedSize = texture->getCommittedSize();
+		if (!texture->evict())
+			continue;
+
+		auto releasing = committedSize - std::min(committedSize, texture->getCommittedSize());
+		releasedSize += releasing;
+		evictedSize += releasing;
+		++evictionCount;
+	}
+
+	return releasedSize;
+}
+
+TextureResidency::Stats TextureResidency::getStats()
+{
+	Stats stats = {};
+	stats.budget = budget;
+	stats.deviceBudget = deviceBudget;
+	stats.evictionCount = evictionCount;
+	stats.evictedSize = evictedSize;
+
+	lock_guard<mutex> lock(texturesMutex);
+	for (auto texture : textures) {
+		stats.textureCount[texture->residencyCategory] += 1;
+		stats.memorySize[texture->residencyCategory] += texture->getMemorySize();
+		if (texture->residencyCategory != TEXTURE_CATEGORY_TRANSIENT)
+			stats.committedSize += texture->getCommittedSize();
+	}
+
+	return stats;
+}
+
+void TextureResidency::dumpStats(FILE *fp)
+{
+	auto stats = getStats();
+
+	fprintf(fp, "textures: %llu KiB committed, %llu KiB budget",
+	        (unsigned long long)(stats.committedSize / 1024),
+	        (unsigned long long)(stats.budget / 1024));
+	if (stats.deviceBudget != VK_WHOLE_SIZE)
+		fprintf(fp, " (device has room for %llu KiB)", (unsigned long long)(stats.deviceBudget / 1024));
+	fprintf(fp, ", %llu evictions releasing %llu KiB\n",
+	        (unsigned long long)stats.evictionCount,
+	        (unsigned long long)(stats.evictedSize / 1024));
+
+	for (auto i = 0; i < TEXTURE_CATEGORY_COUNT; ++i) {
+		if (stats.textureCount[i] == 0)
+			continue;
+
+		fprintf(fp, "  %-10s: %u textures, %llu KiB\n",
+		        getTextureCategoryName(TextureCategory(i)),
+		        stats.textureCount[i],
+		        (unsigned long long)(stats.memorySize[i] / 1024));
+	}
+}
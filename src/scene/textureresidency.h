@@ -0,0 +1,104 @@
+#ifndef TEXTURERESIDENCY_H
+#define TEXTURERESIDENCY_H
+
+#include "../vulkan.h"
+
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+class TextureBase;
+
+enum TextureCategory {
+	TEXTURE_CATEGORY_OTHER,
+	TEXTURE_CATEGORY_IMPORTED,
+	TEXTURE_CATEGORY_ASSET_PACK,
+	TEXTURE_CATEGORY_STREAMING,
+	// images on their way in or out, like the streamer's replacements; the textures they belong to account for them
+	TEXTURE_CATEGORY_TRANSIENT,
+	TEXTURE_CATEGORY_COUNT
+};
+
+const char *getTextureCategoryName(TextureCategory category);
+
+/*
+ * Keeps track of the device-memory of every texture, and of when each
+ * was last drawn with (see TextureBase::markUsed()). Textures register
+ * themselves with the current TextureResidency when they're created,
+ * like they do with the TextureHeap.
+ *
+ * When the textures take up more than the budget, update() evicts the
+ * ones that haven't been used for unusedFrames frames, least recently
+ * used first. Only textures that can be brought back are evictable;
+ * see TextureBase::evict(). With VK_EXT_memory_budget, the budget also
+ * shrinks to what the device-local heaps have room for, so textures
+ * make way when something else needs the memory.
+ *
+ * Budgets count what the textures will take up once the uploads in
+ * flight are done, so textures that are about to shrink don't cause
+ * evictions.
+ */
+class TextureResidency {
+public:
+	struct Stats {
+		uint32_t textureCount[TEXTURE_CATEGORY_COUNT];
+		VkDeviceSize memorySize[TEXTURE_CATEGORY_COUNT];
+		VkDeviceSize committedSize;
+		VkDeviceSize budget;
+		VkDeviceSize deviceBudget; // VK_WHOLE_SIZE without VK_EXT_memory_budget
+		uint64_t evictionCount;
+		VkDeviceSize evictedSize;
+	};
+
+	TextureResidency(VkDeviceSize budget, int unusedFrames = 60);
+	~TextureResidency();
+
+	TextureResidency(const TextureResidency &) = delete;
+	TextureResidency &operator=(const TextureResidency &) = delete;
+
+	// the residency new textures register with, if any
+	static TextureResidency *getCurrent() { return current; }
+
+	// call once per frame, after waiting for the frame's fence, and before anything that streams textures
+	void update();
+
+	uint64_t getFrame() const { return frame; }
+
+	bool isRecentlyUsed(const TextureBase &texture) const;
+
+	// the configured budget, or what the device has room for if that's less
+	VkDeviceSize getBudget() const { return std::min(budget, deviceBudget); }
+	void setBudget(VkDeviceSize budget) { this->budget = budget; }
+
+	// what the textures will take up once the uploads in flight are done
+	VkDeviceSize getCommittedSize();
+
+	// evicts unused textures, least recently used first, until size bytes are on their way out; returns how many are
+	VkDeviceSize evict(VkDeviceSize size);
+
+	Stats getStats();
+	void dumpStats(FILE *fp);
+
+private:
+	friend class TextureBase;
+
+	static TextureResidency *current;
+
+	void add(TextureBase *texture);
+	void remove(TextureBase *texture);
+	void setCategory(TextureBase *texture, TextureCategory category);
+
+	void updateDeviceBudget();
+
+	VkDeviceSize budget, deviceBudget;
+	int unusedFrames;
+	uint64_t frame;
+	uint64_t evictionCount;
+	VkDeviceSize evictedSize;
+
+	// textures are created on worker-threads too; everything else happens on the thread that owns them
+	std::mutex texturesMutex;
+	std::vector<TextureBase *> textures;
+};
+
+#endif // TEXTURERESIDENCY_H
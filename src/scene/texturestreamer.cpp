@@ -0,0 +1,171 @@
+#include "texturestreamer.h"
+
+#include <algorithm>
+
+using std::max;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+StreamingTexture::StreamingTexture(TextureStreamer &streamer, const AssetPackTexture &entry, int tailMipLevel) :
+	Texture2D(VkFormat(entry.format), mipSize(entry.width, tailMipLevel), mipSize(entry.height, tailMipLevel), entry.mipLevels - tailMipLevel, 1, true),
+	streamer(streamer),
+	entry(entry),
+	fullWidth(entry.width),
+	fullHeight(entry.height),
+	fullMipLevels(entry.mipLevels),
+	residentMipLevel(tailMipLevel),
+	tailMipLevel(tailMipLevel),
+	pendingMipLevel(-1),
+	pendingTicket(0)
+{
+	setResidencyCategory(TEXTURE_CATEGORY_STREAMING);
+}
+
+VkDeviceSize StreamingTexture::getCommittedSize() const
+{
+	return pending ? pending->getMemorySize() : getMemorySize();
+}
+
+bool StreamingTexture::evict()
+{
+	if (pending || residentMipLevel == tailMipLevel)
+		return false;
+
+	streamer.request(*this, tailMipLevel);
+	return true;
+}
+
+VkDeviceSize StreamingTexture::getSize(int mipLevel) const
+{
+	VkDeviceSize size = 0;
+	for (auto level = mipLevel; level < fullMipLevels; ++level)
+		size += assetPackSubresourceSize(VkFormat(entry.format), mipSize(fullWidth, level), mipSize(fullHeight, level));
+	return size;
+}
+
+TextureStreamer::TextureStreamer(const AssetPack &assetPack, AsyncUploader &uploader, TextureResidency &residency, int retireFrames, int tailSize) :
+	assetPack(assetPack),
+	uploader(uploader),
+	residency(residency),
+	retireFrames(retireFrames),
+	tailSize(tailSize),
+	maxUploadSize(16 * 1024 * 1024)
+{
+}
+
+TextureStreamer::~TextureStreamer()
+{
+	// the replacements can't go away while they're being uploaded to
+	uploader.finish();
+}
+
+StreamingTexture *TextureStreamer::loadTexture2D(UploadBatch &uploadBatch, const string &name)
+{
+	auto &entry = assetPack.getTexture(name, VK_IMAGE_VIEW_TYPE_2D);
+
+	// the finest level that fits within tailSize, or the last one if none do
+	auto tailMipLevel = 0;
+	while (tailMipLevel + 1 < entry.mipLevels &&
+	       max(TextureBase::mipSize(entry.width, tailMipLevel), TextureBase::mipSize(entry.height, tailMipLevel)) > tailSize)
+		++tailMipLevel;
+
+	unique_ptr<StreamingTexture> texture(new StreamingTexture(*this, entry, tailMipLevel));
+	assetPack.stageTexture(uploadBatch, *texture, entry, tailMipLevel);
+
+	textures.push_back(std::move(texture));
+	return textures.back().get();
+}
+
+void TextureStreamer::request(StreamingTexture &texture, int mipLevel)
+{
+	assert(!texture.pending);
+	assert(0 <= mipLevel && mipLevel <= texture.tailMipLevel);
+	assert(mipLevel != texture.residentMipLevel);
+
+	auto &entry = texture.entry;
+	texture.pending.reset(new Texture2D(VkFormat(entry.format),
+		TextureBase::mipSize(entry.width, mipLevel),
+		TextureBase::mipSize(entry.height, mipLevel),
+		entry.mipLevels - mipLevel, 1, true));
+	texture.pending->setResidencyCategory(TEXTURE_CATEGORY_TRANSIENT);
+	texture.pendingMipLevel = mipLevel;
+	assetPack.stageTexture(uploader.getBatch(), *texture.pending, entry, mipLevel);
+
+	requested.push_back(&texture);
+}
+
+void TextureStreamer::update()
+{
+	auto frame = residency.getFrame();
+	while (!retired.empty() && retired.front().frame + retireFrames <= frame)
+		retired.pop_front();
+
+	// switch over to the images that are ready; the old ones might still be in use by frames in flight
+	for (auto &texture : textures) {
+		if (!texture->pending || !uploader.isReady(texture->pendingTicket))
+			continue;
+
+		texture->swapStorage(*texture->pending);
+		texture->residentMipLevel = texture->pendingMipLevel;
+
+		RetiredTexture retiredTexture = { std::move(texture->pending), frame };
+		retired.push_back(std::move(retiredTexture));
+	}
+
+	vector<StreamingTexture *> order;
+	for (auto &texture : textures)
+		order.push_back(texture.get());
+
+	std::stable_sort(order.begin(), order.end(), [](const StreamingTexture *a, const StreamingTexture *b) {
+		return a->getLastUsedFrame() > b->getLastUsedFrame();
+	});
+
+	// refine what's in use, most recently used first, as long as it fits
+	auto budget = residency.getBudget();
+	auto committedSize = residency.getCommittedSize();
+	VkDeviceSize uploadSize = 0;
+	for (auto texture : order) {
+		if (!residency.isRecentlyUsed(*texture))
+			break;
+
+		if (texture->pending || texture->residentMipLevel == 0)
+			continue;
+
+		// an estimate, as the image doesn't exist yet
+		auto mipLevel = texture->residentMipLevel - 1;
+		auto size = texture->getSize(mipLevel);
+		auto growth = size - texture->getSize(texture->residentMipLevel);
+		if (committedSize + growth > budget) {
+			committedSize -= residency.evict(committedSize + growth - budget);
+			if (committedSize + growth > budget)
+				break;
+		}
+
+		if (uploadSize > 0 && uploadSize + size > maxUploadSize)
+			break;
+
+		committedSize -= texture->getCommittedSize();
+		request(*texture, mipLevel);
+		committedSize += texture->getCommittedSize();
+		uploadSize += size;
+	}
+
+	// still too much, so textures in use lose detail too, least recently used first
+	for (auto it = order.rbegin(); it != order.rend() && committedSize > budget; ++it) {
+		auto texture = *it;
+		if (texture->pending || texture->residentMipLevel == texture->tailMipLevel)
+			continue;
+
+		committedSize -= texture->getCommittedSize();
+		request(*texture, texture->residentMipLevel + 1);
+		committedSize += texture->getCommittedSize();
+	}
+
+	if (!requested.empty()) {
+		auto ticket = uploader.submit();
+		for (auto texture : requested)
+			texture->pendingTicket = ticket;
+		requested.clear();
+	}
+}
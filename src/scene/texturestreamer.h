@@ -0,0 +1,118 @@
+#ifndef TEXTURESTREAMER_H
+#define TEXTURESTREAMER_H
+
+#include "assetpack.h"
+#include "asyncuploader.h"
+#include "texture.h"
+#include "textureresidency.h"
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+class TextureStreamer;
+
+/*
+ * A 2D texture from an asset pack, with only some of its mip-levels
+ * resident; the TextureStreamer decides which. The image only has the
+ * resident levels, so its view (and heap-slot) starts at the finest of
+ * them. That clamps the LOD like a sampler minLod would, but per
+ * texture, and the dropped levels don't take up any memory.
+ *
+ * getWidth() and friends describe the resident image; getFullWidth()
+ * and getResidentMipLevel() relate that to the whole texture.
+ */
+class StreamingTexture : public Texture2D {
+public:
+	int getFullWidth() const { return fullWidth; }
+	int getFullHeight() const { return fullHeight; }
+	int getFullMipLevels() const { return fullMipLevels; }
+
+	// the level of the whole texture that level 0 of the image is
+	int getResidentMipLevel() const { return residentMipLevel; }
+
+	// the coarsest levels, which are always resident
+	int getTailMipLevel() const { return tailMipLevel; }
+
+	VkDeviceSize getCommittedSize() const override;
+
+	// drops down to the mip-tail
+	bool evict() override;
+
+private:
+	friend class TextureStreamer;
+
+	StreamingTexture(TextureStreamer &streamer, const AssetPackTexture &entry, int tailMipLevel);
+
+	// texel-data size of an image with the levels from mipLevel and up
+	VkDeviceSize getSize(int mipLevel) const;
+
+	TextureStreamer &streamer;
+	const AssetPackTexture &entry;
+	int fullWidth, fullHeight, fullMipLevels;
+	int residentMipLevel, tailMipLevel;
+
+	// the replacement image, while it's being uploaded
+	std::unique_ptr<Texture2D> pending;
+	int pendingMipLevel;
+	uint64_t pendingTicket;
+};
+
+/*
+ * Streams the mip-levels of textures in and out of memory. A texture
+ * is usable as soon as its mip-tail is uploaded, and update() then
+ * refines the ones that have been drawn recently, one level at a time,
+ * on the async uploader.
+ *
+ * Textures are kept within the budget of the TextureResidency: when a
+ * texture in use needs the room, the residency evicts the ones that
+ * haven't been used for a while, which cuts streaming textures back to
+ * their mip-tails. If that isn't enough, textures in use lose detail
+ * too, so scenes with more textures than memory still run, only
+ * blurrier.
+ *
+ * Changing what's resident builds a new image next to the old one, and
+ * the texture only switches over once the upload is ready, so it stays
+ * usable all along. Old images are kept for retireFrames frames, for
+ * the frames in flight that might still use them.
+ */
+class TextureStreamer {
+	friend class StreamingTexture;
+
+public:
+	TextureStreamer(const AssetPack &assetPack, AsyncUploader &uploader, TextureResidency &residency, int retireFrames, int tailSize = 128);
+	~TextureStreamer();
+
+	TextureStreamer(const TextureStreamer &) = delete;
+	TextureStreamer &operator=(const TextureStreamer &) = delete;
+
+	// stages the mip-tail in uploadBatch; the texture is ready for use once that has been submitted
+	StreamingTexture *loadTexture2D(UploadBatch &uploadBatch, const std::string &name);
+
+	// call once per frame, after waiting for the frame's fence, and after updating the residency
+	void update();
+
+private:
+	struct RetiredTexture {
+		std::unique_ptr<Texture2D> texture;
+		uint64_t frame;
+	};
+
+	// builds and stages a replacement with mipLevel as its finest level; it's swapped in when ready
+	void request(StreamingTexture &texture, int mipLevel);
+
+	const AssetPack &assetPack;
+	AsyncUploader &uploader;
+	TextureResidency &residency;
+	int retireFrames, tailSize;
+
+	// upper bound for the texel-data staged per update(), to keep frame-times even
+	VkDeviceSize maxUploadSize;
+
+	std::vector<std::unique_ptr<StreamingTexture>> textures;
+	std::vector<StreamingTexture *> requested;
+	std::deque<RetiredTexture> retired;
+};
+
+#endif // TEXTURESTREAMER_H
@@ -0,0 +1,571 @@
+#include "uploadbatch.h"
+
+#include <set>
+#include <tuple>
+
+using namespace vulkan;
+
+using std::lock_guard;
+using std::mutex;
+using std::set;
+using std::tuple;
+using std::make_tuple;
+using std::unique_ptr;
+using std::vector;
+
+// everywhere uploaded data might be consumed
+static const VkPipelineStageFlags consumerStages = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+static const VkAccessFlags consumerAccess = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+
+void AcquireBarriers::record(VkCommandBuffer commandBuffer) const
+{
+	if (empty())
+		return;
+
+	vkCmdPipelineBarrier(commandBuffer,
+		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, consumerStages, 0,
+		0, nullptr,
+		uint32_t(bufferBarriers.size()), bufferBarriers.data(),
+		uint32_t(imageBarriers.size()), imageBarriers.data());
+}
+
+UploadBatch::UploadBatch(VkQueue queue, uint32_t queueFamilyIndex, uint32_t dstQueueFamilyIndex, VkDeviceSize chunkSize) :
+	queue(queue),
+	queueFamilyIndex(queueFamilyIndex),
+	dstQueueFamilyIndex(dstQueueFamilyIndex),
+	chunkSize(chunkSize),
+	submittedSerial(0),
+	completedSerial(0)
+{
+	commandPool = createCommandPool(queueFamilyIndex);
+
+	uint32_t queueCount;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueCount, nullptr);
+	vector<VkQueueFamilyProperties> props(queueCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueCount, props.data());
+
+	assert(queueFamilyIndex < queueCount);
+	supportsBlits = (props[queueFamilyIndex].queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
+}
+
+UploadBatch::~UploadBatch()
+{
+	flush();
+
+	for (auto fence : freeFences)
+		vkDestroyFence(device, fence, nullptr);
+
+	// frees the command buffers as well
+	vkDestroyCommandPool(device, commandPool, nullptr);
+}
+
+StagingAllocation UploadBatch::allocateStaging(VkDeviceSize size, VkDeviceSize alignment)
+{
+	assert(size > 0);
+	alignment = std::max(alignment, VkDeviceSize(4));
+
+	lock_guard<mutex> lock(stagingMutex);
+
+	StagingChunk *chunk = nullptr;
+	if (!chunks.empty()) {
+		auto last = chunks.back().get();
+		if (alignSize(last->used, alignment) + size <= last->size)
+			chunk = last;
+	}
+
+	if (chunk == nullptr) {
+		collect();
+
+		for (auto it = freeChunks.begin(); it != freeChunks.end(); ++it) {
+			if ((*it)->size >= size) {
+				chunks.push_back(std::move(*it));
+				freeChunks.erase(it);
+				chunk = chunks.back().get();
+				break;
+			}
+		}
+	}
+
+	if (chunk == nullptr) {
+		unique_ptr<StagingChunk> newChunk(new StagingChunk);
+		newChunk->size = std::max(chunkSize, size);
+		newChunk->buffer.reset(new StagingBuffer(newChunk->size));
+		newChunk->data = static_cast<uint8_t *>(newChunk->buffer->map(0, newChunk->size));
+		newChunk->used = 0;
+		chunks.push_back(std::move(newChunk));
+		chunk = chunks.back().get();
+	}
+
+	StagingAllocation allocation;
+	allocation.buffer = chunk->buffer->getBuffer();
+	allocation.offset = alignSize(chunk->used, alignment);
+	allocation.data = chunk->data + allocation.offset;
+
+	chunk->used = allocation.offset + size;
+	assert(chunk->used <= chunk->size);
+
+	return allocation;
+}
+
+void UploadBatch::copyToBuffer(const StagingAllocation &src, Buffer &dst, VkDeviceSize dstOffset, VkDeviceSize size)
+{
+	BufferCopy copy;
+	copy.srcBuffer = src.buffer;
+	copy.dstBuffer = dst.getBuffer();
+	copy.region.srcOffset = src.offset;
+	copy.region.dstOffset = dstOffset;
+	copy.region.size = size;
+
+	lock_guard<mutex> lock(stagingMutex);
+	bufferCopies.push_back(copy);
+}
+
+void UploadBatch::uploadBuffer(Buffer &dst, VkDeviceSize dstOffset, const void *data, VkDeviceSize size)
+{
+	auto inPlace = dst.isMappable();
+	if (inPlace) {
+		// writing now would jump ahead of copies that only happen at submit
+		lock_guard<mutex> lock(stagingMutex);
+		for (auto &copy : bufferCopies)
+			if (copy.dstBuffer == dst.getBuffer())
+				inPlace = false;
+	}
+
+	if (inPlace) {
+		memcpy(dst.map(dstOffset, size), data, size_t(size));
+		dst.unmap();
+		return;
+	}
+
+	auto staging = allocateStaging(size);
+	memcpy(staging.data, data, size_t(size));
+	copyToBuffer(staging, dst, dstOffset, size);
+}
+
+void UploadBatch::copyToImage(const StagingAllocation &src, TextureBase &dst, int mipLevel, int arrayLayer)
+{
+	assert(mipLevel < dst.getMipLevels());
+	assert(arrayLayer < dst.getArrayLayers());
+	assert(src.offset % 4 == 0);
+
+	ImageCopy copy;
+	copy.srcBuffer = src.buffer;
+	copy.dstImage = dst.getImage();
+	copy.region = dst.getBufferImageCopy(src.offset, mipLevel, arrayLayer);
+
+	lock_guard<mutex> lock(stagingMutex);
+	imageCopies.push_back(copy);
+}
+
+void *UploadBatch::writeImage(TextureBase &dst, int mipLevel, int arrayLayer, VkDeviceSize size)
+{
+	assert(dst.isLinear());
+	assert(mipLevel < dst.getMipLevels());
+	assert(arrayLayer < dst.getArrayLayers());
+	assert(dst.getDepth(mipLevel) == 1);
+
+	ImageWrite write;
+	write.texture = &dst;
+	write.mipLevel = mipLevel;
+	write.arrayLayer = arrayLayer;
+	write.layout = dst.getSubresourceLayout(mipLevel, arrayLayer);
+	write.rows = getLinearImageRows(dst.getFormat(), dst.getHeight(mipLevel), size);
+
+	void *data;
+	if (write.layout.rowPitch == write.rows.rowSize)
+		data = dst.map(write.layout.offset, size);
+	else {
+		write.packedData.reset(new uint8_t[size_t(size)]);
+		data = write.packedData.get();
+	}
+
+	lock_guard<mutex> lock(stagingMutex);
+	imageWrites.push_back(std::move(write));
+	return data;
+}
+
+bool UploadBatch::canGenerateMipmaps(VkFormat format) const
+{
+	if (!supportsBlits)
+		return false;
+
+	VkFormatProperties formatProperties;
+	vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &formatProperties);
+
+	auto requiredFeatures = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+	return (formatProperties.optimalTilingFeatures & requiredFeatures) == requiredFeatures;
+}
+
+void UploadBatch::generateMipmaps(TextureBase &texture)
+{
+	assert(supportsBlits);
+
+	if (texture.getMipLevels() == 1)
+		return;
+
+	MipmapGeneration generation;
+	generation.image = texture.getImage();
+	generation.width = texture.getWidth();
+	generation.height = texture.getHeight();
+	generation.mipLevels = texture.getMipLevels();
+	generation.arrayLayers = texture.getArrayLayers();
+
+	lock_guard<mutex> lock(stagingMutex);
+	mipmapGenerations.push_back(generation);
+}
+
+uint64_t UploadBatch::submit(VkSemaphore signalSemaphore, AcquireBarriers *acquireBarriers)
+{
+	assert(!transfersOwnership() || acquireBarriers != nullptr);
+
+	if (empty())
+		return submittedSerial;
+
+	collect();
+
+	VkCommandBuffer commandBuffer;
+	if (!freeCommandBuffers.empty()) {
+		commandBuffer = freeCommandBuffers.back();
+		freeCommandBuffers.pop_back();
+	} else {
+		auto commandBuffers = allocateCommandBuffers(commandPool, 1);
+		commandBuffer = commandBuffers[0];
+		delete[] commandBuffers;
+	}
+
+	VkCommandBufferBeginInfo commandBufferBeginInfo = {};
+	commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	VkResult err = vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo);
+	assert(err == VK_SUCCESS);
+
+	// generated images are handled as a whole, below
+	set<VkImage> generatedImages;
+	for (auto &generation : mipmapGenerations)
+		generatedImages.insert(generation.image);
+
+	// the barriers towards the consumers, releasing ownership if it's transferred
+	vector<VkImageMemoryBarrier> preBarriers, postBarriers;
+	auto addPostBarrier = [&](VkImageMemoryBarrier imageMemoryBarrier) {
+		if (transfersOwnership()) {
+			imageMemoryBarrier.srcQueueFamilyIndex = queueFamilyIndex;
+			imageMemoryBarrier.dstQueueFamilyIndex = dstQueueFamilyIndex;
+
+			auto acquireBarrier = imageMemoryBarrier;
+			acquireBarrier.srcAccessMask = 0;
+			acquireBarriers->imageBarriers.push_back(acquireBarrier);
+
+			imageMemoryBarrier.dstAccessMask = 0;
+		}
+
+		postBarriers.push_back(imageMemoryBarrier);
+	};
+
+	// one barrier per distinct subresource, into and out of TRANSFER_DST
+	set<tuple<VkImage, uint32_t, uint32_t>> subresources;
+	for (auto &copy : imageCopies) {
+		auto &subresource = copy.region.imageSubresource;
+		if (!subresources.insert(make_tuple(copy.dstImage, subresource.mipLevel, subresource.baseArrayLayer)).second)
+			continue;
+
+		VkImageMemoryBarrier imageMemoryBarrier = {};
+		imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imageMemoryBarrier.image = copy.dstImage;
+		imageMemoryBarrier.subresourceRange = {
+			subresource.aspectMask,
+			subresource.mipLevel, 1,
+			subresource.baseArrayLayer, subresource.layerCount
+		};
+
+		imageMemoryBarrier.srcAccessMask = 0;
+		imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		preBarriers.push_back(imageMemoryBarrier);
+
+		if (generatedImages.count(copy.dstImage))
+			continue;
+
+		imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		addPostBarrier(imageMemoryBarrier);
+	}
+
+	// written by the host, so they only need their layout changed; vkQueueSubmit() makes host-writes visible
+	for (auto &write : imageWrites) {
+		VkImageMemoryBarrier imageMemoryBarrier = {};
+		imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imageMemoryBarrier.image = write.texture->getImage();
+		imageMemoryBarrier.subresourceRange = {
+			VK_IMAGE_ASPECT_COLOR_BIT,
+			uint32_t(write.mipLevel), 1,
+			uint32_t(write.arrayLayer), 1
+		};
+
+		imageMemoryBarrier.srcAccessMask = 0;
+		imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_PREINITIALIZED;
+		imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		addPostBarrier(imageMemoryBarrier);
+	}
+
+	// the generated levels start out as blit destinations; all but the last end up as sources
+	int maxMipLevels = 0;
+	for (auto &generation : mipmapGenerations) {
+		maxMipLevels = std::max(maxMipLevels, generation.mipLevels);
+
+		VkImageMemoryBarrier imageMemoryBarrier = {};
+		imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imageMemoryBarrier.image = generation.image;
+		imageMemoryBarrier.subresourceRange = {
+			VK_IMAGE_ASPECT_COLOR_BIT,
+			1, uint32_t(generation.mipLevels - 1),
+			0, uint32_t(generation.arrayLayers)
+		};
+
+		imageMemoryBarrier.srcAccessMask = 0;
+		imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		preBarriers.push_back(imageMemoryBarrier);
+
+		imageMemoryBarrier.subresourceRange.baseMipLevel = 0;
+		imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		addPostBarrier(imageMemoryBarrier);
+
+		imageMemoryBarrier.subresourceRange.baseMipLevel = generation.mipLevels - 1;
+		imageMemoryBarrier.subresourceRange.levelCount = 1;
+		imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		addPostBarrier(imageMemoryBarrier);
+	}
+
+	if (!preBarriers.empty())
+		vkCmdPipelineBarrier(commandBuffer,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+			0, nullptr,
+			0, nullptr,
+			uint32_t(preBarriers.size()), preBarriers.data());
+
+	// merge consecutive copies between the same pair of resources
+	vector<VkBufferCopy> bufferRegions;
+	for (size_t i = 0; i < bufferCopies.size(); ++i) {
+		auto &copy = bufferCopies[i];
+		bufferRegions.push_back(copy.region);
+		if (i + 1 == bufferCopies.size() ||
+		    bufferCopies[i + 1].srcBuffer != copy.srcBuffer ||
+		    bufferCopies[i + 1].dstBuffer != copy.dstBuffer) {
+			vkCmdCopyBuffer(commandBuffer, copy.srcBuffer, copy.dstBuffer, uint32_t(bufferRegions.size()), bufferRegions.data());
+			bufferRegions.clear();
+		}
+	}
+
+	vector<VkBufferImageCopy> imageRegions;
+	for (size_t i = 0; i < imageCopies.size(); ++i) {
+		auto &copy = imageCopies[i];
+		imageRegions.push_back(copy.region);
+		if (i + 1 == imageCopies.size() ||
+		    imageCopies[i + 1].srcBuffer != copy.srcBuffer ||
+		    imageCopies[i + 1].dstImage != copy.dstImage) {
+			vkCmdCopyBufferToImage(commandBuffer, copy.srcBuffer, copy.dstImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, uint32_t(imageRegions.size()), imageRegions.data());
+			imageRegions.clear();
+		}
+	}
+
+	// each level is blitted from the one above it, for all images at once
+	for (auto mipLevel = 1; mipLevel < maxMipLevels; ++mipLevel) {
+		vector<VkImageMemoryBarrier> barriers;
+		for (auto &generation : mipmapGenerations) {
+			if (mipLevel >= generation.mipLevels)
+				continue;
+
+			VkImageMemoryBarrier imageMemoryBarrier = {};
+			imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+			imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+			imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			imageMemoryBarrier.image = generation.image;
+			imageMemoryBarrier.subresourceRange = {
+				VK_IMAGE_ASPECT_COLOR_BIT,
+				uint32_t(mipLevel - 1), 1,
+				0, uint32_t(generation.arrayLayers)
+			};
+			barriers.push_back(imageMemoryBarrier);
+		}
+
+		vkCmdPipelineBarrier(commandBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+			0, nullptr,
+			0, nullptr,
+			uint32_t(barriers.size()), barriers.data());
+
+		for (auto &generation : mipmapGenerations) {
+			if (mipLevel >= generation.mipLevels)
+				continue;
+
+			VkImageBlit imageBlit = {};
+			imageBlit.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, uint32_t(mipLevel - 1), 0, uint32_t(generation.arrayLayers) };
+			imageBlit.srcOffsets[1].x = TextureBase::mipSize(generation.width, mipLevel - 1);
+			imageBlit.srcOffsets[1].y = TextureBase::mipSize(generation.height, mipLevel - 1);
+			imageBlit.srcOffsets[1].z = 1;
+
+			imageBlit.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, uint32_t(mipLevel), 0, uint32_t(generation.arrayLayers) };
+			imageBlit.dstOffsets[1].x = TextureBase::mipSize(generation.width, mipLevel);
+			imageBlit.dstOffsets[1].y = TextureBase::mipSize(generation.height, mipLevel);
+			imageBlit.dstOffsets[1].z = 1;
+
+			blitImage(commandBuffer, generation.image, generation.image, { imageBlit }, VK_FILTER_LINEAR);
+		}
+	}
+
+	if (transfersOwnership()) {
+		// buffers need an ownership transfer each, and the consumer stages don't exist on this queue
+		vector<VkBufferMemoryBarrier> bufferBarriers;
+		set<VkBuffer> buffers;
+		for (auto &copy : bufferCopies) {
+			if (!buffers.insert(copy.dstBuffer).second)
+				continue;
+
+			VkBufferMemoryBarrier bufferMemoryBarrier = {};
+			bufferMemoryBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			bufferMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			bufferMemoryBarrier.dstAccessMask = 0;
+			bufferMemoryBarrier.srcQueueFamilyIndex = queueFamilyIndex;
+			bufferMemoryBarrier.dstQueueFamilyIndex = dstQueueFamilyIndex;
+			bufferMemoryBarrier.buffer = copy.dstBuffer;
+			bufferMemoryBarrier.offset = 0;
+			bufferMemoryBarrier.size = VK_WHOLE_SIZE;
+			bufferBarriers.push_back(bufferMemoryBarrier);
+
+			bufferMemoryBarrier.srcAccessMask = 0;
+			bufferMemoryBarrier.dstAccessMask = consumerAccess;
+			acquireBarriers->bufferBarriers.push_back(bufferMemoryBarrier);
+		}
+
+		vkCmdPipelineBarrier(commandBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+			0, nullptr,
+			uint32_t(bufferBarriers.size()), bufferBarriers.data(),
+			uint32_t(postBarriers.size()), postBarriers.data());
+	} else {
+		VkMemoryBarrier memoryBarrier = {};
+		memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		memoryBarrier.dstAccessMask = consumerAccess;
+
+		vkCmdPipelineBarrier(commandBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, consumerStages, 0,
+			bufferCopies.empty() ? 0 : 1, &memoryBarrier,
+			0, nullptr,
+			uint32_t(postBarriers.size()), postBarriers.data());
+	}
+
+	err = vkEndCommandBuffer(commandBuffer);
+	assert(err == VK_SUCCESS);
+
+	for (auto &chunk : chunks)
+		chunk->buffer->unmap();
+
+	for (auto &write : imageWrites) {
+		if (write.packedData) {
+			auto dst = write.texture->map(write.layout.offset, write.layout.size);
+			spreadLinearImageRows(dst, write.layout, write.packedData.get(), write.rows);
+		}
+
+		write.texture->unmap();
+	}
+
+	VkFence fence;
+	if (!freeFences.empty()) {
+		fence = freeFences.back();
+		freeFences.pop_back();
+	} else
+		fence = createFence(0);
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &commandBuffer;
+
+	if (signalSemaphore != VK_NULL_HANDLE) {
+		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.pSignalSemaphores = &signalSemaphore;
+	}
+
+	err = vkQueueSubmit(queue, 1, &submitInfo, fence);
+	assert(err == VK_SUCCESS);
+
+	InFlight submitted;
+	submitted.serial = ++submittedSerial;
+	submitted.fence = fence;
+	submitted.commandBuffer = commandBuffer;
+	submitted.chunks = std::move(chunks);
+	inFlight.push_back(std::move(submitted));
+
+	chunks.clear();
+	bufferCopies.clear();
+	imageCopies.clear();
+	imageWrites.clear();
+	mipmapGenerations.clear();
+
+	return submittedSerial;
+}
+
+void UploadBatch::flush()
+{
+	submit();
+
+	while (!inFlight.empty()) {
+		auto &oldest = inFlight.front();
+		VkResult err = vkWaitForFences(device, 1, &oldest.fence, VK_TRUE, UINT64_MAX);
+		assert(err == VK_SUCCESS);
+
+		recycle(oldest);
+		inFlight.pop_front();
+	}
+}
+
+void UploadBatch::collect()
+{
+	while (!inFlight.empty() && vkGetFenceStatus(device, inFlight.front().fence) == VK_SUCCESS) {
+		recycle(inFlight.front());
+		inFlight.pop_front();
+	}
+}
+
+void UploadBatch::recycle(InFlight &submitted)
+{
+	assert(submitted.serial > completedSerial);
+	completedSerial = submitted.serial;
+
+	VkResult err = vkResetFences(device, 1, &submitted.fence);
+	assert(err == VK_SUCCESS);
+	freeFences.push_back(submitted.fence);
+
+	err = vkResetCommandBuffer(submitted.commandBuffer, 0);
+	assert(err == VK_SUCCESS);
+	freeCommandBuffers.push_back(submitted.commandBuffer);
+
+	// oversized chunks were for a one-off; don't hang on to them
+	for (auto &chunk : submitted.chunks) {
+		if (chunk->size > chunkSize)
+			continue;
+
+		chunk->used = 0;
+		freeChunks.push_back(std::move(chunk));
+	}
+}
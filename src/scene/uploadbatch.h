@@ -0,0 +1,192 @@
+#ifndef UPLOADBATCH_H
+#define UPLOADBATCH_H
+
+#include "buffer.h"
+#include "linear-image.h"
+#include "texture.h"
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+struct StagingAllocation {
+	VkBuffer buffer;
+	VkDeviceSize offset;
+	void *data;
+};
+
+/*
+ * The acquire half of a queue-family ownership transfer, to be recorded
+ * on the receiving queue after the releasing submit has completed.
+ */
+struct AcquireBarriers {
+	std::vector<VkBufferMemoryBarrier> bufferBarriers;
+	std::vector<VkImageMemoryBarrier> imageBarriers;
+
+	bool empty() const
+	{
+		return bufferBarriers.empty() && imageBarriers.empty();
+	}
+
+	void record(VkCommandBuffer commandBuffer) const;
+};
+
+/*
+ * Collects buffer and image uploads, and submits them all at once.
+ * Staging memory is sub-allocated from a pool of large chunks, and
+ * both the chunks and the command buffers are recycled once the fence
+ * of the submit that used them has signaled.
+ *
+ * Images are transitioned from UNDEFINED, so every staged image copy
+ * must cover its whole subresource. After the submit, images are in
+ * SHADER_READ_ONLY_OPTIMAL.
+ *
+ * Mip-chains can be generated on the GPU instead of staged; level 0 is
+ * copied as usual, and the rest are blitted from it after all copies.
+ *
+ * Destinations the host can write skip the staging memory: buffers in
+ * host-visible memory are written in place right away, which is what
+ * device-local buffers get on unified memory, and linear images are
+ * written in place at submit. Linear images still need their layout
+ * transitioned from PREINITIALIZED, so they take a submit, but no
+ * copies; batches of nothing but buffers don't submit anything. A
+ * buffer that already has a staged copy in the batch is staged again,
+ * so the copies land in the order they were recorded. Nothing waits
+ * for the GPU before an in-place write, so those destinations must not
+ * be in use by pending GPU work.
+ *
+ * If dstQueueFamilyIndex names another queue-family, the submit ends
+ * with release barriers towards it, and the matching acquire barriers
+ * are handed back to the caller.
+ *
+ * Staging, and recording copies, may happen from several threads at
+ * once; everything else, submit() in particular, must not race with it.
+ */
+class UploadBatch {
+public:
+	UploadBatch(VkQueue queue = vulkan::graphicsQueue, uint32_t queueFamilyIndex = vulkan::graphicsQueueIndex, uint32_t dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED, VkDeviceSize chunkSize = 16 * 1024 * 1024);
+	~UploadBatch();
+
+	UploadBatch(const UploadBatch &) = delete;
+	UploadBatch &operator=(const UploadBatch &) = delete;
+
+	StagingAllocation allocateStaging(VkDeviceSize size, VkDeviceSize alignment = 16);
+
+	void copyToBuffer(const StagingAllocation &src, Buffer &dst, VkDeviceSize dstOffset, VkDeviceSize size);
+	void copyToImage(const StagingAllocation &src, TextureBase &dst, int mipLevel = 0, int arrayLayer = 0);
+
+	void uploadBuffer(Buffer &dst, VkDeviceSize dstOffset, const void *data, VkDeviceSize size);
+
+	// returns memory for the caller to write the tightly packed texel-data of a subresource into
+	void *stageImage(TextureBase &dst, int mipLevel, int arrayLayer, VkDeviceSize size)
+	{
+		if (dst.isLinear())
+			return writeImage(dst, mipLevel, arrayLayer, size);
+
+		auto staging = allocateStaging(size);
+		copyToImage(staging, dst, mipLevel, arrayLayer);
+		return staging.data;
+	}
+
+	// like stageImage(), but for linear images; the memory is the image's own, unless its rows are padded
+	void *writeImage(TextureBase &dst, int mipLevel, int arrayLayer, VkDeviceSize size);
+
+	// whether generateMipmaps() works for images of this format; blits need a graphics queue
+	bool canGenerateMipmaps(VkFormat format) const;
+
+	// fills every mip-level but the first, in all layers; level 0 must be staged in this batch as well
+	void generateMipmaps(TextureBase &texture);
+
+	bool empty() const
+	{
+		return bufferCopies.empty() && imageCopies.empty() && mipmapGenerations.empty() && imageWrites.empty();
+	}
+
+	bool transfersOwnership() const
+	{
+		return dstQueueFamilyIndex != VK_QUEUE_FAMILY_IGNORED && dstQueueFamilyIndex != queueFamilyIndex;
+	}
+
+	/*
+	 * Returns a serial for isComplete(). If there was nothing to submit,
+	 * that's the serial of the previous submit. acquireBarriers must be
+	 * given when ownership is transferred.
+	 */
+	uint64_t submit(VkSemaphore signalSemaphore = VK_NULL_HANDLE, AcquireBarriers *acquireBarriers = nullptr);
+
+	bool isComplete(uint64_t serial)
+	{
+		collect();
+		return serial <= completedSerial;
+	}
+
+	// submit, and wait for everything in flight to finish
+	void flush();
+
+	// recycle the resources of finished submits
+	void collect();
+
+private:
+	struct StagingChunk {
+		std::unique_ptr<StagingBuffer> buffer;
+		uint8_t *data;
+		VkDeviceSize size;
+		VkDeviceSize used;
+	};
+
+	struct BufferCopy {
+		VkBuffer srcBuffer, dstBuffer;
+		VkBufferCopy region;
+	};
+
+	struct ImageCopy {
+		VkBuffer srcBuffer;
+		VkImage dstImage;
+		VkBufferImageCopy region;
+	};
+
+	struct ImageWrite {
+		TextureBase *texture;
+		int mipLevel, arrayLayer;
+		VkSubresourceLayout layout;
+		LinearImageRows rows;
+		std::unique_ptr<uint8_t[]> packedData; // for images with padded rows, to be spread out at submit
+	};
+
+	struct MipmapGeneration {
+		VkImage image;
+		int width, height;
+		int mipLevels, arrayLayers;
+	};
+
+	struct InFlight {
+		uint64_t serial;
+		VkFence fence;
+		VkCommandBuffer commandBuffer;
+		std::vector<std::unique_ptr<StagingChunk>> chunks;
+	};
+
+	void recycle(InFlight &submitted);
+
+	VkQueue queue;
+	uint32_t queueFamilyIndex, dstQueueFamilyIndex;
+	bool supportsBlits;
+	VkDeviceSize chunkSize;
+	uint64_t submittedSerial, completedSerial;
+	VkCommandPool commandPool;
+
+	std::mutex stagingMutex; // guards chunks, the copies, the image writes and the mipmap generations
+	std::vector<BufferCopy> bufferCopies;
+	std::vector<ImageCopy> imageCopies;
+	std::vector<ImageWrite> imageWrites;
+	std::vector<MipmapGeneration> mipmapGenerations;
+	std::vector<std::unique_ptr<StagingChunk>> chunks;
+
+	std::deque<InFlight> inFlight;
+	std::vector<std::unique_ptr<StagingChunk>> freeChunks;
+	std::vector<VkCommandBuffer> freeCommandBuffers;
+	std::vector<VkFence> freeFences;
+};
+
+#endif // UPLOADBATCH_H
@@ -41,7 +41,7 @@ public:
 		assert(immutableSamplers.size() == 0 || immutableSamplers.size() == count);
 	}
 
-	VkDescriptorSetLayoutBinding getBinding()
+	VkDescriptorSetLayoutBinding getBinding() const
 	{
 		VkDescriptorSetLayoutBinding ret;
 		ret.binding = uint32_t(binding);
@@ -63,7 +63,8 @@ private:
 
 class ShaderProgram {
 public:
-	ShaderProgram(const std::vector<ShaderStage> &stages, const std::vector<ShaderDescriptor> &descriptors, const std::vector<VkPushConstantRange> &pushConstantRanges = {}) :
+	// the descriptors make up set 0, and any extra set-layouts (like the texture heap's) follow it
+	ShaderProgram(const std::vector<ShaderStage> &stages, const std::vector<ShaderDescriptor> &descriptors, const std::vector<VkPushConstantRange> &pushConstantRanges = {}, const std::vector<VkDescriptorSetLayout> &extraDescriptorSetLayouts = {}) :
 		stages(stages),
 		descriptors(descriptors)
 	{
@@ -73,11 +74,15 @@ public:
 			layoutBindings.push_back(descriptor.getBinding());
 
 		descriptorSetLayout = vulkan::createDescriptorSetLayout(layoutBindings);
-		pipelineLayout = vulkan::createPipelineLayout({ descriptorSetLayout }, pushConstantRanges);
+
+		std::vector<VkDescriptorSetLayout> descriptorSetLayouts = { descriptorSetLayout };
+		descriptorSetLayouts.insert(descriptorSetLayouts.end(), extraDescriptorSetLayouts.begin(), extraDescriptorSetLayouts.end());
+		pipelineLayout = vulkan::createPipelineLayout(descriptorSetLayouts, pushConstantRanges);
 	}
 
 	VkDescriptorSetLayout getDescriptorSetLayout() const { return descriptorSetLayout; }
 	VkPipelineLayout getPipelineLayout() const { return pipelineLayout; }
+	const std::vector<ShaderDescriptor> &getDescriptors() const { return descriptors; }
 
 	std::vector<VkPipelineShaderStageCreateInfo> getPipelineShaderStageCreateInfos() const
 	{
@@ -2,14 +2,24 @@
 
 #extension GL_ARB_separate_shader_objects : enable
 #extension GL_ARB_shading_language_420pack : enable
+#extension GL_EXT_nonuniform_qualifier : require
 
 layout (location = 0) in vec2 texCoord;
 
 layout (location = 0) out vec4 outFragColor;
 
-layout (binding = 1) uniform sampler2D samplerColor;
+// the texture heap
+layout (set = 1, binding = 0) uniform texture2D textures[];
+layout (set = 1, binding = 1) uniform sampler textureSampler;
+
+layout (push_constant) uniform PerDraw
+{
+	uint objectIndex;
+	uint textureIndex;
+} perDraw;
 
 void main()
 {
-	outFragColor = vec4(textureLod(samplerColor, texCoord, 0.35).xyz, 1.0);
+	// the index comes from a push-constant, so it's uniform and needs no nonuniformEXT()
+	outFragColor = vec4(textureLod(sampler2D(textures[perDraw.textureIndex], textureSampler), texCoord, 0.35).xyz, 1.0);
 }
@@ -5,15 +5,21 @@
 
 layout (location = 0) in vec3 inPos;
 
-layout (binding = 0) uniform UBO
+layout (set = 0, binding = 0) readonly buffer ObjectMatrices
 {
-	mat4 modelViewProjectionMatrix;
-} ubo;
+	mat4 modelViewProjectionMatrix[];
+} objectMatrices;
+
+layout (push_constant) uniform PerDraw
+{
+	uint objectIndex;
+	uint textureIndex;
+} perDraw;
 
 layout (location = 0) out vec2 outTexCoord;
 
 void main()
 {
 	outTexCoord = 0.5 + 0.5 * inPos.xy;
-	gl_Position = ubo.modelViewProjectionMatrix * vec4(inPos.xyz, 1.0);
+	gl_Position = objectMatrices.modelViewProjectionMatrix[perDraw.objectIndex] * vec4(inPos.xyz, 1.0);
 }
@@ -9,6 +9,9 @@ using namespace vulkan;
 
 using std::vector;
 using std::runtime_error;
+using std::make_unique;
+
+#include "scene/rendertarget.h"
 
 static vector<VkSurfaceFormatKHR> getSurfaceFormats(VkSurfaceKHR surface)
 {
@@ -90,6 +93,9 @@ SwapChain::SwapChain(VkSurfaceKHR surface, int width, int height, VkImageUsageFl
 		assert(surfaceFormat.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR);
 	}
 
+	format = surfaceFormat.format;
+	presentLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
 	VkSurfaceCapabilitiesKHR surfaceCapabilities;
 	err = vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice, surface, &surfaceCapabilities);
 	assert(err == VK_SUCCESS);
@@ -171,3 +177,104 @@ void SwapChain::queuePresent(uint32_t currentSwapImage, const VkSemaphore *waitS
 	VkResult err = vkQueuePresentKHR(graphicsQueue, &presentInfo);
 	assert(err == VK_SUCCESS);
 }
+
+HeadlessSwapChain::HeadlessSwapChain(int width, int height, int imageCount, VkImageUsageFlags imageUsage) :
+	nextImage(0)
+{
+	assert(imageCount > 0);
+
+	VkFormatFeatureFlags features = 0;
+	if (imageUsage & VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT)
+		features |= VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT;
+	if (imageUsage & VK_IMAGE_USAGE_STORAGE_BIT)
+		features |= VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT;
+	if (imageUsage & VK_IMAGE_USAGE_TRANSFER_DST_BIT)
+		features |= VK_FORMAT_FEATURE_BLIT_DST_BIT;
+
+	// match what we'd typically get from a window
+	format = findBestFormat({ VK_FORMAT_B8G8R8A8_SRGB, VK_FORMAT_R8G8B8A8_SRGB }, VK_IMAGE_TILING_OPTIMAL, features);
+
+	// presented images are left ready to be read back
+	presentLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+
+	for (auto i = 0; i < imageCount; ++i) {
+		renderTargets.push_back(make_unique<ColorRenderTarget>(format, width, height, imageUsage));
+		images.push_back(renderTargets.back()->getImage());
+		imageViews.push_back(renderTargets.back()->getImageView());
+	}
+
+	// start out as if every image had been presented once, like the rest of the frames expect
+	auto commandBuffers = allocateCommandBuffers(setupCommandPool, 1);
+	auto commandBuffer = commandBuffers[0];
+	delete[] commandBuffers;
+
+	VkCommandBufferBeginInfo commandBufferBeginInfo = {};
+	commandBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	VkResult err = vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo);
+	assert(err == VK_SUCCESS);
+
+	for (auto image : images)
+		imageBarrier(
+			commandBuffer,
+			image,
+			VK_IMAGE_ASPECT_COLOR_BIT,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+			0, 0,
+			VK_IMAGE_LAYOUT_UNDEFINED, presentLayout);
+
+	err = vkEndCommandBuffer(commandBuffer);
+	assert(err == VK_SUCCESS);
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &commandBuffer;
+
+	err = vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
+	assert(err == VK_SUCCESS);
+
+	err = vkQueueWaitIdle(graphicsQueue);
+	assert(err == VK_SUCCESS);
+
+	vkFreeCommandBuffers(device, setupCommandPool, 1, &commandBuffer);
+}
+
+HeadlessSwapChain::~HeadlessSwapChain()
+{
+}
+
+uint32_t HeadlessSwapChain::aquireNextImage(VkSemaphore presentCompleteSemaphore)
+{
+	// the image is ours right away, but the caller will still wait for the semaphore
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.pSignalSemaphores = &presentCompleteSemaphore;
+
+	VkResult err = vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
+	assert(err == VK_SUCCESS);
+
+	auto currentSwapImage = nextImage;
+	nextImage = (nextImage + 1) % images.size();
+	return currentSwapImage;
+}
+
+void HeadlessSwapChain::queuePresent(uint32_t currentSwapImage, const VkSemaphore *waitSemaphores, uint32_t numWaitSemaphores)
+{
+	assert(currentSwapImage < images.size());
+
+	// nobody looks at the image, but the semaphores must be waited on before they can be signaled again
+	vector<VkPipelineStageFlags> waitDstStageMasks(numWaitSemaphores, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.waitSemaphoreCount = numWaitSemaphores;
+	submitInfo.pWaitSemaphores = waitSemaphores;
+	submitInfo.pWaitDstStageMask = waitDstStageMasks.data();
+
+	VkResult err = vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
+	assert(err == VK_SUCCESS);
+}
@@ -1,10 +1,14 @@
+#ifndef SWAPCHAIN_H
+#define SWAPCHAIN_H
+
 #include "vulkan.h"
 
+#include <memory>
 #include <vector>
 
-class SwapChain {
+class SwapChainBase {
 public:
-	SwapChain(VkSurfaceKHR surface, int width, int height, VkImageUsageFlags imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT);
+	virtual ~SwapChainBase() {}
 
 	const std::vector<VkImage> &getImages() const
 	{
@@ -16,18 +20,66 @@ public:
 		return imageViews;
 	}
 
+	VkFormat getFormat() const
+	{
+		return format;
+	}
+
+	// the layout images must be in when they're presented
+	VkImageLayout getPresentLayout() const
+	{
+		return presentLayout;
+	}
+
+	virtual uint32_t aquireNextImage(VkSemaphore presentCompleteSemaphore) = 0;
+
+	virtual void queuePresent(uint32_t currentSwapImage, const VkSemaphore *waitSemaphores, uint32_t numWaitSemaphores) = 0;
+
+protected:
+	VkFormat format;
+	VkImageLayout presentLayout;
+	std::vector<VkImage> images;
+	std::vector<VkImageView> imageViews;
+};
+
+class SwapChain : public SwapChainBase {
+public:
+	SwapChain(VkSurfaceKHR surface, int width, int height, VkImageUsageFlags imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT);
+
 	const VkSurfaceFormatKHR &getSurfaceFormat() const
 	{
 		return surfaceFormat;
 	}
 
-	uint32_t aquireNextImage(VkSemaphore presentCompleteSemaphore);
+	uint32_t aquireNextImage(VkSemaphore presentCompleteSemaphore) override;
 
-	void queuePresent(uint32_t currentSwapImage, const VkSemaphore *waitSemaphores, uint32_t numWaitSemaphores);
+	void queuePresent(uint32_t currentSwapImage, const VkSemaphore *waitSemaphores, uint32_t numWaitSemaphores) override;
 
 private:
 	VkSurfaceFormatKHR surfaceFormat;
 	VkSwapchainKHR swapChain;
-	std::vector<VkImage> images;
-	std::vector<VkImageView> imageViews;
 };
+
+class ColorRenderTarget;
+
+/*
+ * Stands in for a swap-chain when there's no window to present to. The
+ * images are plain render-targets that are handed out round-robin, and
+ * "presenting" only consumes the wait-semaphores. Without VK_KHR_swapchain
+ * there's no PRESENT_SRC_KHR, so they're presented in TRANSFER_SRC_OPTIMAL.
+ */
+class HeadlessSwapChain : public SwapChainBase {
+public:
+	HeadlessSwapChain(int width, int height, int imageCount, VkImageUsageFlags imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT);
+	~HeadlessSwapChain();
+
+	uint32_t aquireNextImage(VkSemaphore presentCompleteSemaphore) override;
+
+	void queuePresent(uint32_t currentSwapImage, const VkSemaphore *waitSemaphores, uint32_t numWaitSemaphores) override;
+
+private:
+	std::vector<std::unique_ptr<ColorRenderTarget>> renderTargets;
+	uint32_t nextImage;
+};
+
+#endif // SWAPCHAIN_H
@@ -21,10 +21,17 @@ VkInstance vulkan::instance;
 VkDevice vulkan::device;
 VkPhysicalDevice vulkan::physicalDevice;
 VkPhysicalDeviceFeatures vulkan::enabledFeatures = { 0 };
+VkPhysicalDeviceDescriptorIndexingFeaturesEXT vulkan::enabledDescriptorIndexingFeatures = {};
+bool vulkan::memoryBudgetEnabled = false;
+bool vulkan::unifiedMemory = false;
 VkPhysicalDeviceProperties vulkan::deviceProperties;
 VkPhysicalDeviceMemoryProperties vulkan::deviceMemoryProperties;
 uint32_t vulkan::graphicsQueueIndex = UINT32_MAX;
 VkQueue vulkan::graphicsQueue;
+uint32_t vulkan::transferQueueIndex = UINT32_MAX;
+VkQueue vulkan::transferQueue;
+uint32_t vulkan::computeQueueIndex = UINT32_MAX;
+VkQueue vulkan::computeQueue;
 VkCommandPool vulkan::setupCommandPool;
 VkDebugReportCallbackEXT vulkan::debugReportCallback;
 
@@ -55,7 +62,11 @@ static VkBool32 messageCallback(
 		return false;
 	}
 
+#ifdef WIN32
 	OutputDebugStringA(message);
+#else
+	fputs(message, stderr);
+#endif
 	delete[] message;
 	return false;
 }
@@ -125,7 +136,51 @@ static uint32_t findQueue(VkPhysicalDevice physicalDevice, VkQueueFlags required
 	throw runtime_error("failed to find queue!");
 }
 
-void vulkan::deviceInit(VkPhysicalDevice physicalDevice, function<bool(VkInstance, VkPhysicalDevice, uint32_t)> usableQueue)
+// families without the excluded capabilities usually map to hardware that runs alongside rendering
+static uint32_t findDedicatedQueue(VkPhysicalDevice physicalDevice, VkQueueFlags requiredFlags, VkQueueFlags excludedFlags)
+{
+	uint32_t queueCount;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueCount, nullptr);
+	assert(queueCount > 0);
+
+	vector<VkQueueFamilyProperties> props(queueCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueCount, props.data());
+
+	for (uint32_t i = 0; i < queueCount; i++) {
+		if ((props[i].queueFlags & requiredFlags) == requiredFlags &&
+		    !(props[i].queueFlags & excludedFlags) &&
+		    props[i].queueCount > 0)
+			return i;
+	}
+
+	return UINT32_MAX;
+}
+
+template <typename T>
+static T getDeviceProc(VkDevice device, const std::string &entrypoint)
+{
+	auto ret = reinterpret_cast<T>(vkGetDeviceProcAddr(device, entrypoint.c_str()));
+	assert(ret != nullptr);
+	return ret;
+}
+
+struct vulkan::device_funcs vulkan::deviceFuncs;
+
+static void deviceFuncsInit(VkDevice device)
+{
+	deviceFuncs.vkCreateDescriptorUpdateTemplateKHR = getDeviceProc<PFN_vkCreateDescriptorUpdateTemplateKHR>(device, "vkCreateDescriptorUpdateTemplateKHR");
+	deviceFuncs.vkDestroyDescriptorUpdateTemplateKHR = getDeviceProc<PFN_vkDestroyDescriptorUpdateTemplateKHR>(device, "vkDestroyDescriptorUpdateTemplateKHR");
+	deviceFuncs.vkUpdateDescriptorSetWithTemplateKHR = getDeviceProc<PFN_vkUpdateDescriptorSetWithTemplateKHR>(device, "vkUpdateDescriptorSetWithTemplateKHR");
+}
+
+static bool hasExtension(const vector<const char *> &extensions, const char *extensionName)
+{
+	return std::any_of(extensions.begin(), extensions.end(), [extensionName](const char *extension) {
+		return strcmp(extension, extensionName) == 0;
+	});
+}
+
+void vulkan::deviceInit(VkPhysicalDevice physicalDevice, function<bool(VkInstance, VkPhysicalDevice, uint32_t)> usableQueue, const vector<const char *> &enabledExtensions)
 {
 	vulkan::physicalDevice = physicalDevice;
 
@@ -133,30 +188,63 @@ void vulkan::deviceInit(VkPhysicalDevice physicalDevice, function<bool(VkInstanc
 	vkGetPhysicalDeviceFeatures(physicalDevice, &physicalDeviceFeatures);
 
 	enabledFeatures.samplerAnisotropy = physicalDeviceFeatures.samplerAnisotropy;
+	enabledFeatures.pipelineStatisticsQuery = physicalDeviceFeatures.pipelineStatisticsQuery;
+	enabledFeatures.shaderSampledImageArrayDynamicIndexing = physicalDeviceFeatures.shaderSampledImageArrayDynamicIndexing; // the texture-heap's push-constant index
 
 	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
 
+	auto descriptorIndexing = hasExtension(enabledExtensions, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+	if (descriptorIndexing) {
+		assert(instanceFuncs.vkGetPhysicalDeviceFeatures2KHR != nullptr);
+
+		VkPhysicalDeviceDescriptorIndexingFeaturesEXT descriptorIndexingFeatures = {};
+		descriptorIndexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+
+		VkPhysicalDeviceFeatures2KHR physicalDeviceFeatures2 = {};
+		physicalDeviceFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+		physicalDeviceFeatures2.pNext = &descriptorIndexingFeatures;
+		instanceFuncs.vkGetPhysicalDeviceFeatures2KHR(physicalDevice, &physicalDeviceFeatures2);
+
+		// just what the texture-heap needs
+		enabledDescriptorIndexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+		enabledDescriptorIndexingFeatures.descriptorBindingSampledImageUpdateAfterBind = descriptorIndexingFeatures.descriptorBindingSampledImageUpdateAfterBind;
+		enabledDescriptorIndexingFeatures.descriptorBindingUpdateUnusedWhilePending = descriptorIndexingFeatures.descriptorBindingUpdateUnusedWhilePending;
+		enabledDescriptorIndexingFeatures.descriptorBindingPartiallyBound = descriptorIndexingFeatures.descriptorBindingPartiallyBound;
+		enabledDescriptorIndexingFeatures.runtimeDescriptorArray = descriptorIndexingFeatures.runtimeDescriptorArray;
+	}
+
+	// queried through vkGetPhysicalDeviceMemoryProperties2KHR
+	memoryBudgetEnabled = hasExtension(enabledExtensions, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+	assert(!memoryBudgetEnabled || instanceFuncs.vkGetPhysicalDeviceMemoryProperties2KHR != nullptr);
+
 	graphicsQueueIndex = findQueue(physicalDevice, VK_QUEUE_GRAPHICS_BIT, usableQueue);
+	transferQueueIndex = findDedicatedQueue(physicalDevice, VK_QUEUE_TRANSFER_BIT, VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT);
+	computeQueueIndex = findDedicatedQueue(physicalDevice, VK_QUEUE_COMPUTE_BIT, VK_QUEUE_GRAPHICS_BIT);
 
-	VkDeviceQueueCreateInfo queueCreateInfo = {};
+	vector<VkDeviceQueueCreateInfo> queueCreateInfos;
 	float queuePriorities = 0.0f;
-	queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-	queueCreateInfo.queueFamilyIndex = graphicsQueueIndex;
-	queueCreateInfo.queueCount = 1;
-	queueCreateInfo.pQueuePriorities = &queuePriorities;
+	for (auto queueFamilyIndex : { graphicsQueueIndex, transferQueueIndex, computeQueueIndex }) {
+		if (queueFamilyIndex == UINT32_MAX)
+			continue;
+
+		VkDeviceQueueCreateInfo queueCreateInfo = {};
+		queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+		queueCreateInfo.queueFamilyIndex = queueFamilyIndex;
+		queueCreateInfo.queueCount = 1;
+		queueCreateInfo.pQueuePriorities = &queuePriorities;
+		queueCreateInfos.push_back(queueCreateInfo);
+	}
 
 	VkDeviceCreateInfo deviceCreateInfo = {};
 	deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-	deviceCreateInfo.pNext = nullptr;
-	deviceCreateInfo.queueCreateInfoCount = 1;
-	deviceCreateInfo.pQueueCreateInfos = &queueCreateInfo;
+	deviceCreateInfo.pNext = descriptorIndexing ? &enabledDescriptorIndexingFeatures : nullptr;
+	deviceCreateInfo.queueCreateInfoCount = uint32_t(queueCreateInfos.size());
+	deviceCreateInfo.pQueueCreateInfos = queueCreateInfos.data();
 	deviceCreateInfo.pEnabledFeatures = &enabledFeatures;
 
-	const char *enabledExtensions[] = {
-		VK_KHR_SWAPCHAIN_EXTENSION_NAME,
-	};
-	deviceCreateInfo.enabledExtensionCount = ARRAY_SIZE(enabledExtensions);
-	deviceCreateInfo.ppEnabledExtensionNames = enabledExtensions;
+	assert(enabledExtensions.size() < UINT32_MAX);
+	deviceCreateInfo.enabledExtensionCount = uint32_t(enabledExtensions.size());
+	deviceCreateInfo.ppEnabledExtensionNames = enabledExtensions.data();
 
 #ifndef NDEBUG
 	deviceCreateInfo.ppEnabledLayerNames = validationLayerNames;
@@ -167,17 +255,38 @@ void vulkan::deviceInit(VkPhysicalDevice physicalDevice, function<bool(VkInstanc
 	assert(err == VK_SUCCESS);
 
 	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &deviceMemoryProperties);
+
+	// discrete GPUs can have such memory too, but as a small window over the bus; only trust it when it's all the same memory
+	unifiedMemory = false;
+	if (deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU ||
+	    deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU) {
+		auto unifiedFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+		for (auto i = 0u; i < deviceMemoryProperties.memoryTypeCount; ++i) {
+			if ((deviceMemoryProperties.memoryTypes[i].propertyFlags & unifiedFlags) == unifiedFlags)
+				unifiedMemory = true;
+		}
+	}
 	vkGetDeviceQueue(device, graphicsQueueIndex, 0, &graphicsQueue);
 
+	// without a dedicated transfer family, uploads share the graphics queue
+	if (transferQueueIndex != UINT32_MAX)
+		vkGetDeviceQueue(device, transferQueueIndex, 0, &transferQueue);
+	else {
+		transferQueueIndex = graphicsQueueIndex;
+		transferQueue = graphicsQueue;
+	}
+
+	if (computeQueueIndex != UINT32_MAX)
+		vkGetDeviceQueue(device, computeQueueIndex, 0, &computeQueue);
+	else {
+		computeQueueIndex = graphicsQueueIndex;
+		computeQueue = graphicsQueue;
+	}
+
 	setupCommandPool = createCommandPool(graphicsQueueIndex);
-}
 
-template <typename T>
-static T getDeviceProc(VkDevice device, const std::string &entrypoint)
-{
-	auto ret = reinterpret_cast<T>(vkGetDeviceProcAddr(device, entrypoint.c_str()));
-	assert(ret != nullptr);
-	return ret;
+	if (hasExtension(enabledExtensions, VK_KHR_DESCRIPTOR_UPDATE_TEMPLATE_EXTENSION_NAME))
+		deviceFuncsInit(device);
 }
 
 struct vulkan::instance_funcs vulkan::instanceFuncs;
@@ -195,4 +304,8 @@ void vulkan::instanceFuncsInit(VkInstance instance)
 	instanceFuncs.vkCreateDebugReportCallbackEXT = getInstanceProc<PFN_vkCreateDebugReportCallbackEXT>(instance, "vkCreateDebugReportCallbackEXT");
 	instanceFuncs.vkDestroyDebugReportCallbackEXT = getInstanceProc<PFN_vkDestroyDebugReportCallbackEXT>(instance, "vkDestroyDebugReportCallbackEXT");
 	instanceFuncs.vkDebugReportMessageEXT = getInstanceProc<PFN_vkDebugReportMessageEXT>(instance, "vkDebugReportMessageEXT");
+
+	// optional, so no getInstanceProc()
+	instanceFuncs.vkGetPhysicalDeviceFeatures2KHR = reinterpret_cast<PFN_vkGetPhysicalDeviceFeatures2KHR>(vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceFeatures2KHR"));
+	instanceFuncs.vkGetPhysicalDeviceMemoryProperties2KHR = reinterpret_cast<PFN_vkGetPhysicalDeviceMemoryProperties2KHR>(vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceMemoryProperties2KHR"));
 }
@@ -6,6 +6,7 @@
 #include <vulkan/vulkan.h>
 
 #include <algorithm>
+#include <cstring>
 #include <functional>
 #include <vector>
 #include <cassert>
@@ -18,24 +19,70 @@ namespace vulkan
 	extern VkDevice device;
 	extern VkPhysicalDevice physicalDevice;
 	extern VkPhysicalDeviceFeatures enabledFeatures;
+	extern VkPhysicalDeviceDescriptorIndexingFeaturesEXT enabledDescriptorIndexingFeatures; // all false unless VK_EXT_descriptor_indexing is enabled
+	extern bool memoryBudgetEnabled; // VK_EXT_memory_budget
+	extern bool unifiedMemory; // integrated or CPU device, with memory that's both device-local and host-visible
 	extern VkPhysicalDeviceProperties deviceProperties;
 	extern VkPhysicalDeviceMemoryProperties deviceMemoryProperties;
 	extern VkQueue graphicsQueue;
 	extern uint32_t graphicsQueueIndex;
+	extern VkQueue transferQueue; // same as graphicsQueue if there's no transfer-only family
+	extern uint32_t transferQueueIndex;
+	extern VkQueue computeQueue; // same as graphicsQueue if there's no compute family without graphics
+	extern uint32_t computeQueueIndex;
 
 	extern VkCommandPool setupCommandPool;
 
 	extern VkDebugReportCallbackEXT debugReportCallback;
 
 	void instanceInit(const std::string &appName, const std::vector<const char *> &enabledExtensions);
-	void deviceInit(VkPhysicalDevice physicalDevice, std::function<bool(VkInstance, VkPhysicalDevice, uint32_t)> usableQueue);
+	void deviceInit(VkPhysicalDevice physicalDevice, std::function<bool(VkInstance, VkPhysicalDevice, uint32_t)> usableQueue, const std::vector<const char *> &enabledExtensions);
 
 	extern struct instance_funcs {
 		PFN_vkCreateDebugReportCallbackEXT vkCreateDebugReportCallbackEXT;
 		PFN_vkDestroyDebugReportCallbackEXT vkDestroyDebugReportCallbackEXT;
 		PFN_vkDebugReportMessageEXT vkDebugReportMessageEXT;
+		PFN_vkGetPhysicalDeviceFeatures2KHR vkGetPhysicalDeviceFeatures2KHR; // only with VK_KHR_get_physical_device_properties2
+		PFN_vkGetPhysicalDeviceMemoryProperties2KHR vkGetPhysicalDeviceMemoryProperties2KHR; // ditto
 	} instanceFuncs;
 
+	// null unless VK_KHR_descriptor_update_template is enabled
+	extern struct device_funcs {
+		PFN_vkCreateDescriptorUpdateTemplateKHR vkCreateDescriptorUpdateTemplateKHR;
+		PFN_vkDestroyDescriptorUpdateTemplateKHR vkDestroyDescriptorUpdateTemplateKHR;
+		PFN_vkUpdateDescriptorSetWithTemplateKHR vkUpdateDescriptorSetWithTemplateKHR;
+	} deviceFuncs;
+
+	inline bool instanceExtensionSupported(const char *extensionName)
+	{
+		uint32_t extensionCount;
+		VkResult err = vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
+		assert(err == VK_SUCCESS);
+
+		std::vector<VkExtensionProperties> extensions(extensionCount);
+		err = vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, extensions.data());
+		assert(err == VK_SUCCESS);
+
+		return std::any_of(extensions.begin(), extensions.end(), [extensionName](const VkExtensionProperties &extension) {
+			return strcmp(extension.extensionName, extensionName) == 0;
+		});
+	}
+
+	inline bool deviceExtensionSupported(VkPhysicalDevice physicalDevice, const char *extensionName)
+	{
+		uint32_t extensionCount;
+		VkResult err = vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+		assert(err == VK_SUCCESS);
+
+		std::vector<VkExtensionProperties> extensions(extensionCount);
+		err = vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, extensions.data());
+		assert(err == VK_SUCCESS);
+
+		return std::any_of(extensions.begin(), extensions.end(), [extensionName](const VkExtensionProperties &extension) {
+			return strcmp(extension.extensionName, extensionName) == 0;
+		});
+	}
+
 	inline VkDeviceSize alignSize(VkDeviceSize value, VkDeviceSize alignment)
 	{
 		return ((value + alignment - 1) / alignment) * alignment;
@@ -56,20 +103,6 @@ namespace vulkan
 		throw std::runtime_error("invalid memory type!");
 	}
 
-	inline VkDeviceMemory allocateDeviceMemory(VkDeviceSize size, uint32_t memoryTypeIndex)
-	{
-		VkMemoryAllocateInfo memoryAllocateInfo = {};
-		memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		memoryAllocateInfo.allocationSize = size;
-		memoryAllocateInfo.memoryTypeIndex = memoryTypeIndex;
-
-		VkDeviceMemory deviceMemory;
-		VkResult err = vkAllocateMemory(device, &memoryAllocateInfo, nullptr, &deviceMemory);
-		assert(err == VK_SUCCESS);
-
-		return deviceMemory;
-	}
-
 	inline VkCommandBuffer *allocateCommandBuffers(VkCommandPool commandPool, size_t commandBufferCount)
 	{
 		assert(commandBufferCount < UINT32_MAX);
@@ -86,29 +119,43 @@ namespace vulkan
 		return commandBuffers;
 	}
 
+	inline bool formatSupported(VkFormat format, VkImageTiling tiling, VkFormatFeatureFlags features)
+	{
+		VkFormatProperties props;
+		vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &props);
+
+		switch (tiling) {
+		case VK_IMAGE_TILING_LINEAR:
+			return (props.linearTilingFeatures & features) == features;
+		case VK_IMAGE_TILING_OPTIMAL:
+			return (props.optimalTilingFeatures & features) == features;
+		default:
+			unreachable("unexpected tiling mode");
+			return false;
+		}
+	}
+
 	inline VkFormat findBestFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features)
 	{
 		for (auto format : candidates) {
-			VkFormatProperties props;
-			vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &props);
-
-			switch (tiling) {
-			case VK_IMAGE_TILING_LINEAR:
-				if ((props.linearTilingFeatures & features) == features)
-					return format;
-				break;
-			case VK_IMAGE_TILING_OPTIMAL:
-				if ((props.optimalTilingFeatures & features) == features)
-					return format;
-				break;
-			default:
-				unreachable("unexpected tiling mode");
-			}
+			if (formatSupported(format, tiling, features))
+				return format;
 		}
 
 		throw std::runtime_error("no supported format!");
 	}
 
+	// texel rows per row of blocks, which is 1 for uncompressed formats
+	inline uint32_t getFormatBlockHeight(VkFormat format)
+	{
+		if ((format >= VK_FORMAT_BC1_RGB_UNORM_BLOCK && format <= VK_FORMAT_BC7_SRGB_BLOCK) ||
+		    (format >= VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK && format <= VK_FORMAT_EAC_R11G11_SNORM_BLOCK))
+			return 4;
+
+		assert(format < VK_FORMAT_ASTC_4x4_UNORM_BLOCK || format > VK_FORMAT_ASTC_12x12_SRGB_BLOCK);
+		return 1;
+	}
+
 	inline VkFence createFence(VkFenceCreateFlags flags)
 	{
 		VkFenceCreateInfo fenceCreateInfo = {};
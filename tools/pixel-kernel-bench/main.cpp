@@ -0,0 +1,198 @@
+#include "../../src/scene/pixel-kernels.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using std::vector;
+
+/*
+ * Times every pixel-kernel at every feature-level this CPU has, after
+ * checking it against the scalar version. Rows are a bit over 4096
+ * pixels, so the vector loops and the scalar tails both get exercised,
+ * and the whole working set stays in cache.
+ */
+
+static const size_t rowPixels = 4096 + 7;
+
+struct Level {
+	const char *name;
+	unsigned features;
+};
+
+static const Level levels[] = {
+	{ "scalar", PIXEL_KERNELS_SCALAR },
+	{ "sse2", PIXEL_KERNELS_SSE2 },
+	{ "sse2+f16c", PIXEL_KERNELS_SSE2 | PIXEL_KERNELS_F16C },
+	{ "avx2", PIXEL_KERNELS_SSE2 | PIXEL_KERNELS_F16C | PIXEL_KERNELS_AVX2 },
+};
+
+// runs body until at least minSeconds have passed, and returns the bytes processed per second
+template <typename T>
+static double measure(size_t bytesPerCall, T body, double minSeconds)
+{
+	typedef std::chrono::high_resolution_clock clock;
+
+	body(); // warm up
+
+	size_t calls = 0, batch = 1;
+	auto start = clock::now();
+	double elapsed;
+	for (;;) {
+		for (size_t i = 0; i < batch; ++i)
+			body();
+		calls += batch;
+		batch *= 2;
+
+		elapsed = std::chrono::duration<double>(clock::now() - start).count();
+		if (elapsed >= minSeconds)
+			break;
+	}
+
+	return double(bytesPerCall) * calls / elapsed;
+}
+
+// the largest difference between a and b, or -1 if the sizes differ
+template <typename T>
+static int maxDifference(const vector<T> &a, const vector<T> &b)
+{
+	if (a.size() != b.size())
+		return -1;
+
+	int worst = 0;
+	for (size_t i = 0; i < a.size(); ++i) {
+		auto difference = abs(int(a[i]) - int(b[i]));
+		if (difference > worst)
+			worst = difference;
+	}
+	return worst;
+}
+
+static bool equalFloats(const vector<float> &a, const vector<float> &b)
+{
+	return a.size() == b.size() && memcmp(a.data(), b.data(), a.size() * sizeof(float)) == 0;
+}
+
+static void report(const char *kernel, const char *level, double bytesPerSecond, bool matches)
+{
+	printf("%-24s %-10s %8.2f GB/s%s\n", kernel, level, bytesPerSecond / 1e9, matches ? "" : "  MISMATCH");
+}
+
+int main(int argc, char *argv[])
+{
+	double minSeconds = 0.25;
+	for (int i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "-t") && i + 1 < argc)
+			minSeconds = atof(argv[++i]);
+		else {
+			fprintf(stderr, "usage: %s [-t seconds-per-kernel]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	std::mt19937 rng(1234);
+	std::uniform_int_distribution<int> byteDistribution(0, 255);
+	std::uniform_real_distribution<float> unitDistribution(-0.1f, 1.1f);
+	std::uniform_real_distribution<float> hdrDistribution(-70000.0f, 70000.0f);
+
+	vector<uint8_t> bgra(rowPixels * 4), bgr(rowPixels * 3);
+	for (auto &v : bgra)
+		v = uint8_t(byteDistribution(rng));
+	for (auto &v : bgr)
+		v = uint8_t(byteDistribution(rng));
+
+	// spans the whole half-float range, denormals and overflow included
+	vector<float> rgbf(rowPixels * 3), linear(rowPixels * 4);
+	for (size_t i = 0; i < rgbf.size(); ++i)
+		rgbf[i] = i % 3 == 0 ? hdrDistribution(rng) : ldexpf(unitDistribution(rng), int(i % 40) - 30);
+	for (auto &v : linear)
+		v = unitDistribution(rng);
+
+	auto scalar = getPixelKernels(PIXEL_KERNELS_SCALAR);
+	vector<uint8_t> refSwizzle(rowPixels * 4), refExpand(rowPixels * 4), refPremultiply(rowPixels * 4), refEncode(rowPixels * 4);
+	vector<uint16_t> refHalf(rowPixels * 4);
+	vector<uint32_t> refB10G11R11(rowPixels), refE5B9G9R9(rowPixels);
+	vector<float> refDecode(rowPixels * 4);
+	scalar.swizzleBGRA8ToRGBA8(refSwizzle.data(), bgra.data(), rowPixels);
+	scalar.expandBGR8ToRGBA8(refExpand.data(), bgr.data(), rowPixels);
+	scalar.convertRGB32FToRGBA16F(refHalf.data(), rgbf.data(), rowPixels);
+	scalar.convertRGB32FToB10G11R11(refB10G11R11.data(), rgbf.data(), rowPixels);
+	scalar.convertRGB32FToE5B9G9R9(refE5B9G9R9.data(), rgbf.data(), rowPixels);
+	scalar.premultiplyAlpha8(refPremultiply.data(), bgra.data(), rowPixels);
+	scalar.encodeSRGB8(refEncode.data(), linear.data(), rowPixels * 4);
+	scalar.decodeSRGB8(refDecode.data(), bgra.data(), rowPixels * 4);
+
+	auto supported = getPixelKernelFeatures();
+	printf("supported:%s%s%s\n\n",
+	       supported & PIXEL_KERNELS_SSE2 ? " sse2" : "",
+	       supported & PIXEL_KERNELS_F16C ? " f16c" : "",
+	       supported & PIXEL_KERNELS_AVX2 ? " avx2" : "");
+
+	bool allMatch = true;
+	for (auto &level : levels) {
+		if ((level.features & supported) != level.features)
+			continue;
+
+		auto kernels = getPixelKernels(level.features);
+		vector<uint8_t> bytes(rowPixels * 4);
+		vector<uint16_t> halfs(rowPixels * 4);
+		vector<uint32_t> packed(rowPixels);
+		vector<float> floats(rowPixels * 4);
+
+		// throughput counts the bytes read and written
+		auto rate = measure(rowPixels * 8, [&] { kernels.swizzleBGRA8ToRGBA8(bytes.data(), bgra.data(), rowPixels); }, minSeconds);
+		bool matches = maxDifference(bytes, refSwizzle) == 0;
+		report("swizzleBGRA8ToRGBA8", level.name, rate, matches);
+		allMatch = allMatch && matches;
+
+		rate = measure(rowPixels * 7, [&] { kernels.expandBGR8ToRGBA8(bytes.data(), bgr.data(), rowPixels); }, minSeconds);
+		matches = maxDifference(bytes, refExpand) == 0;
+		report("expandBGR8ToRGBA8", level.name, rate, matches);
+		allMatch = allMatch && matches;
+
+		rate = measure(rowPixels * 20, [&] { kernels.convertRGB32FToRGBA16F(halfs.data(), rgbf.data(), rowPixels); }, minSeconds);
+		matches = maxDifference(halfs, refHalf) == 0;
+		report("convertRGB32FToRGBA16F", level.name, rate, matches);
+		allMatch = allMatch && matches;
+
+		rate = measure(rowPixels * 16, [&] { kernels.convertRGB32FToB10G11R11(packed.data(), rgbf.data(), rowPixels); }, minSeconds);
+		matches = packed == refB10G11R11;
+		report("convertRGB32FToB10G11R11", level.name, rate, matches);
+		allMatch = allMatch && matches;
+
+		rate = measure(rowPixels * 16, [&] { kernels.convertRGB32FToE5B9G9R9(packed.data(), rgbf.data(), rowPixels); }, minSeconds);
+		matches = packed == refE5B9G9R9;
+		report("convertRGB32FToE5B9G9R9", level.name, rate, matches);
+		allMatch = allMatch && matches;
+
+		rate = measure(rowPixels * 8, [&] { kernels.premultiplyAlpha8(bytes.data(), bgra.data(), rowPixels); }, minSeconds);
+		matches = maxDifference(bytes, refPremultiply) == 0;
+		report("premultiplyAlpha8", level.name, rate, matches);
+		allMatch = allMatch && matches;
+
+		// the vectorized curve is an approximation, so it may round the other way now and then
+		rate = measure(rowPixels * 4 * 5, [&] { kernels.encodeSRGB8(bytes.data(), linear.data(), rowPixels * 4); }, minSeconds);
+		auto difference = maxDifference(bytes, refEncode);
+		matches = difference >= 0 && difference <= 1;
+		report("encodeSRGB8", level.name, rate, matches);
+		allMatch = allMatch && matches;
+
+		rate = measure(rowPixels * 4 * 5, [&] { kernels.decodeSRGB8(floats.data(), bgra.data(), rowPixels * 4); }, minSeconds);
+		matches = equalFloats(floats, refDecode);
+		report("decodeSRGB8", level.name, rate, matches);
+		allMatch = allMatch && matches;
+
+		printf("\n");
+	}
+
+	if (!allMatch) {
+		fprintf(stderr, "some kernels don't match the scalar versions!\n");
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,455 @@
+/*
+ * Bakes textures into an asset pack, for AssetPack to load without any
+ * decoding at startup.
+ *
+ *   texture-baker [-j threads] [-c cache-dir] manifest output.pack
+ *
+ * Each line of the manifest names a source the way the importers take
+ * it; a type, any import flags, and a path:
+ *
+ *   2d mipmaps premultiply assets/excess-logo.png
+ *   2d mipmaps compress high-quality assets/albedo.png
+ *   2d mipmaps compress red-green assets/normals.png
+ *   cube mipmaps assets/skybox.png
+ *   cube mipmaps packed-hdr assets/environment.hdr
+ *   array assets/frames
+ *
+ * The path doubles as the texture's name in the pack. Baked textures are
+ * kept in the cache directory, keyed on a hash of the source bytes, the
+ * type and the flags, so only changed sources get re-baked. Baking runs
+ * on every core, with the layers and mip-levels of a texture spread out
+ * as well.
+ */
+
+#include "../../src/core/memorymappedfile.h"
+#include "../../src/core/threadpool.h"
+#include "../../src/scene/assetpack-format.h"
+#include "../../src/scene/texture-source.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#ifdef WIN32
+#include <direct.h>
+#endif
+
+using std::exception;
+using std::future;
+using std::runtime_error;
+using std::string;
+using std::vector;
+
+struct ManifestEntry {
+	string name;
+	VkImageViewType viewType;
+	TextureImportFlags flags;
+};
+
+// what goes into the cache, ahead of the data
+struct CachedTextureHeader {
+	char magic[4];
+	uint32_t version;
+	AssetPackTexture texture;
+};
+
+static const char cacheMagic[4] = { 'E', 'L', 'T', 'C' };
+
+// bump whenever the baked output changes for the same input, to invalidate old cache entries
+static const uint32_t bakerVersion = 2;
+
+struct BakeResult {
+	string cachePath;
+	AssetPackTexture texture;
+	bool rebuilt;
+};
+
+static vector<ManifestEntry> readManifest(const string &path)
+{
+	std::ifstream file(path);
+	if (!file)
+		throw runtime_error("failed to open manifest: " + path);
+
+	vector<ManifestEntry> entries;
+	string line;
+	for (int lineNumber = 1; std::getline(file, line); ++lineNumber) {
+		auto comment = line.find('#');
+		if (comment != string::npos)
+			line.erase(comment);
+
+		std::istringstream words(line);
+		vector<string> tokens;
+		string word;
+		while (words >> word)
+			tokens.push_back(word);
+
+		if (tokens.empty())
+			continue;
+
+		auto error = [&](const string &what) {
+			return runtime_error(path + ":" + std::to_string(lineNumber) + ": " + what);
+		};
+
+		if (tokens.size() < 2)
+			throw error("expected a type and a path");
+
+		ManifestEntry entry;
+		if (tokens.front() == "2d")
+			entry.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		else if (tokens.front() == "cube")
+			entry.viewType = VK_IMAGE_VIEW_TYPE_CUBE;
+		else if (tokens.front() == "array")
+			entry.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+		else
+			throw error("unknown type: " + tokens.front());
+
+		entry.flags = TextureImportFlags::NONE;
+		for (size_t i = 1; i + 1 < tokens.size(); ++i) {
+			if (tokens[i] == "mipmaps")
+				entry.flags = entry.flags | TextureImportFlags::GENERATE_MIPMAPS;
+			else if (tokens[i] == "premultiply")
+				entry.flags = entry.flags | TextureImportFlags::PREMULTIPLY_ALPHA;
+			else if (tokens[i] == "compress")
+				entry.flags = entry.flags | TextureImportFlags::COMPRESS;
+			else if (tokens[i] == "high-quality")
+				entry.flags = entry.flags | TextureImportFlags::HIGH_QUALITY;
+			else if (tokens[i] == "red")
+				entry.flags = entry.flags | TextureImportFlags::RED_CHANNEL;
+			else if (tokens[i] == "red-green")
+				entry.flags = entry.flags | TextureImportFlags::RED_GREEN_CHANNELS;
+			else if (tokens[i] == "packed-hdr")
+				entry.flags = entry.flags | TextureImportFlags::PACKED_HDR;
+			else
+				throw error("unknown flag: " + tokens[i]);
+		}
+
+		entry.name = tokens.back();
+		entries.push_back(entry);
+	}
+
+	return entries;
+}
+
+// FNV-1a, continuing from hash
+static uint64_t hashBytes(uint64_t hash, const void *data, size_t size)
+{
+	auto bytes = static_cast<const uint8_t *>(data);
+	for (size_t i = 0; i < size; ++i) {
+		hash ^= bytes[i];
+		hash *= uint64_t(1099511628211ull);
+	}
+	return hash;
+}
+
+static uint64_t hashEntry(const ManifestEntry &entry)
+{
+	auto hash = uint64_t(14695981039346656037ull);
+
+	uint32_t settings[] = { bakerVersion, uint32_t(entry.viewType), uint32_t(entry.flags) };
+	hash = hashBytes(hash, settings, sizeof(settings));
+
+	vector<string> paths;
+	if (entry.viewType == VK_IMAGE_VIEW_TYPE_2D_ARRAY)
+		paths = TextureSource::getArrayLayerPaths(entry.name);
+	else
+		paths.push_back(entry.name);
+
+	// the sizes keep the layer boundaries in the hash
+	for (auto &path : paths) {
+		MemoryMappedFile file(path, 0, MemoryMappedFile::WHOLE_FILE, MemoryMappedFile::AccessPattern::SEQUENTIAL);
+		uint64_t size = file.getSize();
+		hash = hashBytes(hash, &size, sizeof(size));
+		hash = hashBytes(hash, file.getData(), file.getSize());
+	}
+
+	return hash;
+}
+
+static bool readCachedTexture(const string &path, AssetPackTexture *texture)
+{
+	auto fp = fopen(path.c_str(), "rb");
+	if (!fp)
+		return false;
+
+	CachedTextureHeader header;
+	bool valid = fread(&header, sizeof(header), 1, fp) == 1 &&
+	    !memcmp(header.magic, cacheMagic, sizeof(header.magic)) &&
+	    header.version == bakerVersion;
+
+	if (valid) {
+		// a cache entry that was cut short gets rebuilt
+		fseek(fp, 0, SEEK_END);
+		auto size = uint64_t(ftell(fp));
+		valid = header.texture.dataOffset <= size &&
+		    header.texture.dataSize <= size - header.texture.dataOffset;
+	}
+
+	fclose(fp);
+
+	if (valid)
+		*texture = header.texture;
+	return valid;
+}
+
+static void replaceFile(const string &from, const string &to)
+{
+#ifdef WIN32
+	// rename() doesn't replace existing files on Windows
+	remove(to.c_str());
+#endif
+	if (rename(from.c_str(), to.c_str()) != 0) {
+		remove(from.c_str());
+		throw runtime_error("failed to write " + to);
+	}
+}
+
+static AssetPackTexture bakeTexture(const ManifestEntry &entry, const string &cachePath, const string &tempPath, ThreadPool &threadPool)
+{
+	std::unique_ptr<TextureSource> source;
+	switch (entry.viewType) {
+	case VK_IMAGE_VIEW_TYPE_2D:
+		source = TextureSource::load2D(entry.name, entry.flags);
+		break;
+	case VK_IMAGE_VIEW_TYPE_CUBE:
+		source = TextureSource::loadCube(entry.name, entry.flags, &threadPool);
+		break;
+	case VK_IMAGE_VIEW_TYPE_2D_ARRAY:
+		source = TextureSource::load2DArray(entry.name, entry.flags, &threadPool);
+		break;
+	default:
+		throw runtime_error("unexpected texture type");
+	}
+
+	CachedTextureHeader header = {};
+	memcpy(header.magic, cacheMagic, sizeof(header.magic));
+	header.version = bakerVersion;
+
+	auto &texture = header.texture;
+	texture.format = source->getFormat();
+	texture.viewType = source->getViewType();
+	texture.width = source->getWidth();
+	texture.height = source->getHeight();
+	texture.mipLevels = uint16_t(source->getMipLevels());
+	texture.arrayLayers = uint16_t(source->getArrayLayers());
+	texture.dataOffset = assetPackAlign(sizeof(header));
+
+	// laid out just like in the pack, so it can be copied over as-is
+	uint64_t dataSize = 0;
+	for (auto arrayLayer = 0; arrayLayer < texture.arrayLayers; ++arrayLayer) {
+		for (auto mipLevel = 0; mipLevel < texture.mipLevels; ++mipLevel) {
+			dataSize = assetPackAlign(dataSize);
+			dataSize += assetPackSubresourceSize(VkFormat(texture.format),
+			    std::max(texture.width >> mipLevel, 1u),
+			    std::max(texture.height >> mipLevel, 1u));
+		}
+	}
+
+	// sized up front, as the writer's pointers have to stay valid
+	vector<uint8_t> data(static_cast<size_t>(dataSize));
+	size_t offset = 0;
+	source->write([&](int, int, size_t size) {
+		offset = size_t(assetPackAlign(offset));
+		if (offset + size > data.size())
+			throw runtime_error("unexpected subresource size");
+
+		auto ptr = data.data() + offset;
+		offset += size;
+		return static_cast<void *>(ptr);
+	}, &threadPool);
+	texture.dataSize = data.size();
+
+	auto fp = fopen(tempPath.c_str(), "wb");
+	if (!fp)
+		throw runtime_error("failed to open " + tempPath + " for writing");
+
+	static const uint8_t padding[ASSETPACK_DATA_ALIGNMENT] = {};
+	bool success = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+	    fwrite(padding, 1, size_t(texture.dataOffset - sizeof(header)), fp) == texture.dataOffset - sizeof(header) &&
+	    fwrite(data.data(), 1, data.size(), fp) == data.size();
+	success = fclose(fp) == 0 && success;
+
+	if (!success) {
+		remove(tempPath.c_str());
+		throw runtime_error("failed to write " + tempPath);
+	}
+
+	replaceFile(tempPath, cachePath);
+	return texture;
+}
+
+static BakeResult bake(const ManifestEntry &entry, const string &cacheDir, size_t index, ThreadPool &threadPool)
+{
+	char key[17];
+	snprintf(key, sizeof(key), "%016llx", (unsigned long long)hashEntry(entry));
+
+	BakeResult result;
+	result.cachePath = cacheDir + "/" + key + ".bin";
+	result.rebuilt = !readCachedTexture(result.cachePath, &result.texture);
+
+	// the same source can be listed twice, so don't share temp-files between tasks
+	if (result.rebuilt)
+		result.texture = bakeTexture(entry, result.cachePath, result.cachePath + "." + std::to_string(index) + ".tmp", threadPool);
+
+	return result;
+}
+
+static void writePack(const string &path, const vector<ManifestEntry> &entries, const vector<BakeResult> &results)
+{
+	// AssetPack looks names up with a binary search
+	vector<size_t> order(entries.size());
+	for (size_t i = 0; i < order.size(); ++i)
+		order[i] = i;
+	std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+		return strcmp(entries[a].name.c_str(), entries[b].name.c_str()) < 0;
+	});
+
+	string stringTable;
+	vector<AssetPackTexture> toc;
+	for (size_t i = 0; i < order.size(); ++i) {
+		auto &entry = entries[order[i]];
+		if (i > 0 && entry.name == entries[order[i - 1]].name)
+			throw runtime_error("duplicate texture: " + entry.name);
+
+		auto texture = results[order[i]].texture;
+		texture.nameOffset = uint32_t(stringTable.size());
+		stringTable.append(entry.name.c_str(), entry.name.size() + 1);
+		toc.push_back(texture);
+	}
+
+	AssetPackHeader header;
+	memcpy(header.magic, ASSETPACK_MAGIC, sizeof(header.magic));
+	header.version = ASSETPACK_VERSION;
+	header.textureCount = uint32_t(toc.size());
+	header.stringTableSize = uint32_t(stringTable.size());
+
+	auto offset = uint64_t(sizeof(header) + toc.size() * sizeof(AssetPackTexture) + stringTable.size());
+	for (auto &texture : toc) {
+		offset = assetPackAlign(offset);
+		texture.dataOffset = offset;
+		offset += texture.dataSize;
+	}
+
+	auto tempPath = path + ".tmp";
+	auto fp = fopen(tempPath.c_str(), "wb");
+	if (!fp)
+		throw runtime_error("failed to open " + tempPath + " for writing");
+
+	bool success = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+	    fwrite(toc.data(), sizeof(AssetPackTexture), toc.size(), fp) == toc.size() &&
+	    fwrite(stringTable.data(), 1, stringTable.size(), fp) == stringTable.size();
+
+	offset = sizeof(header) + toc.size() * sizeof(AssetPackTexture) + stringTable.size();
+	for (size_t i = 0; success && i < toc.size(); ++i) {
+		static const uint8_t padding[ASSETPACK_DATA_ALIGNMENT] = {};
+		auto paddingSize = size_t(toc[i].dataOffset - offset);
+		success = fwrite(padding, 1, paddingSize, fp) == paddingSize;
+
+		auto &cached = results[order[i]];
+		MemoryMappedFile file(cached.cachePath, cached.texture.dataOffset, cached.texture.dataSize, MemoryMappedFile::AccessPattern::SEQUENTIAL);
+		success = success && file.getSize() == toc[i].dataSize &&
+		    fwrite(file.getData(), 1, file.getSize(), fp) == file.getSize();
+
+		offset = toc[i].dataOffset + toc[i].dataSize;
+	}
+	success = fclose(fp) == 0 && success;
+
+	if (!success) {
+		remove(tempPath.c_str());
+		throw runtime_error("failed to write " + tempPath);
+	}
+
+	replaceFile(tempPath, path);
+}
+
+static void makeDirectory(const string &path)
+{
+	struct stat st;
+	if (stat(path.c_str(), &st) == 0 && (st.st_mode & S_IFMT) == S_IFDIR)
+		return;
+
+#ifdef WIN32
+	auto err = _mkdir(path.c_str());
+#else
+	auto err = mkdir(path.c_str(), 0777);
+#endif
+	if (err != 0)
+		throw runtime_error("failed to create directory " + path);
+}
+
+static void usage()
+{
+	fprintf(stderr, "usage: texture-baker [-j threads] [-c cache-dir] manifest output.pack\n");
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+	string cacheDir = "texture-cache";
+	vector<string> arguments;
+
+	for (int i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "-j") && i + 1 < argc)
+			threadCount = std::max(atoi(argv[++i]), 1);
+		else if (!strcmp(argv[i], "-c") && i + 1 < argc)
+			cacheDir = argv[++i];
+		else if (argv[i][0] == '-')
+			usage();
+		else
+			arguments.push_back(argv[i]);
+	}
+
+	if (arguments.size() != 2)
+		usage();
+
+	try {
+		auto entries = readManifest(arguments[0]);
+		makeDirectory(cacheDir);
+
+		vector<future<BakeResult>> futures;
+		{
+			ThreadPool threadPool(threadCount);
+			for (size_t i = 0; i < entries.size(); ++i) {
+				auto &entry = entries[i];
+				futures.push_back(threadPool.enqueue([&entry, &cacheDir, &threadPool, i] {
+					return bake(entry, cacheDir, i, threadPool);
+				}));
+			}
+		}
+
+		vector<BakeResult> results;
+		int failures = 0, rebuilt = 0;
+		for (size_t i = 0; i < futures.size(); ++i) {
+			try {
+				results.push_back(futures[i].get());
+				if (results.back().rebuilt) {
+					printf("baked %s\n", entries[i].name.c_str());
+					rebuilt++;
+				}
+			} catch (const exception &e) {
+				fprintf(stderr, "%s: %s\n", entries[i].name.c_str(), e.what());
+				failures++;
+			}
+		}
+
+		if (failures > 0) {
+			fprintf(stderr, "%d texture(s) failed to bake\n", failures);
+			return 1;
+		}
+
+		writePack(arguments[1], entries, results);
+		printf("%s: %d texture(s), %d rebuilt\n", arguments[1].c_str(), int(entries.size()), rebuilt);
+	} catch (const exception &e) {
+		fprintf(stderr, "texture-baker: %s\n", e.what());
+		return 1;
+	}
+
+	return 0;
+}
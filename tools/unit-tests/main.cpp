@@ -0,0 +1,175 @@
+#include "../../src/scene/linear-image.h"
+#include "../../src/scene/ringallocator.h"
+
+#include <cstdio>
+#include <deque>
+#include <random>
+#include <vector>
+
+using std::deque;
+using std::vector;
+
+/*
+ * Checks for the parts of the engine that don't need a device. Every
+ * test runs even if an earlier one failed, and the exit code is the
+ * number of failed checks.
+ */
+
+static int failures = 0;
+
+#define CHECK(expr) \
+do { \
+	if (!(expr)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #expr); \
+		++failures; \
+	} \
+} while (0)
+
+// a ring whose size isn't a multiple of the alignment, filled until it has to wrap
+static void testRingAllocatorWrap()
+{
+	RingAllocator ring(100);
+	VkDeviceSize offset;
+
+	CHECK(ring.allocate(10, 64, offset));
+	CHECK(offset == 0);
+
+	CHECK(ring.allocate(10, 64, offset));
+	CHECK(offset == 64);
+
+	// 128 would straddle the end, and the start is still in use
+	CHECK(!ring.allocate(10, 64, offset));
+	CHECK(ring.getUsed() == 74);
+
+	ring.retire(10);
+	CHECK(ring.allocate(10, 64, offset));
+	CHECK(offset == 0);
+	CHECK(ring.getUsed() == 100);
+}
+
+struct LiveAllocation {
+	VkDeviceSize offset, size;
+};
+
+static bool overlaps(const LiveAllocation &a, const LiveAllocation &b)
+{
+	return a.offset < b.offset + b.size && b.offset < a.offset + a.size;
+}
+
+// frames of random allocations through an odd-sized ring, with two frames in flight
+static void testRingAllocatorFrames()
+{
+	static const VkDeviceSize alignments[] = { 1, 4, 16, 64, 256 };
+	const VkDeviceSize ringSize = 4099;
+	const size_t framesInFlight = 2;
+
+	RingAllocator ring(ringSize);
+	std::mt19937 random(1234);
+
+	struct Frame {
+		VkDeviceSize end;
+		vector<LiveAllocation> allocations;
+	};
+	deque<Frame> frames;
+
+	int wraps = 0;
+	VkDeviceSize lastOffset = 0;
+	for (int frameIndex = 0; frameIndex < 1000; ++frameIndex) {
+		if (frames.size() == framesInFlight) {
+			ring.retire(frames.front().end);
+			frames.pop_front();
+		}
+
+		Frame frame;
+		auto allocationCount = random() % 8;
+		for (size_t i = 0; i < allocationCount; ++i) {
+			LiveAllocation allocation;
+			allocation.size = 1 + random() % 300;
+			auto alignment = alignments[random() % ARRAY_SIZE(alignments)];
+
+			if (!ring.allocate(allocation.size, alignment, allocation.offset))
+				break;
+
+			CHECK(allocation.offset % alignment == 0);
+			CHECK(allocation.offset + allocation.size <= ringSize);
+
+			for (auto &other : frame.allocations)
+				CHECK(!overlaps(allocation, other));
+			for (auto &pending : frames)
+				for (auto &other : pending.allocations)
+					CHECK(!overlaps(allocation, other));
+
+			if (allocation.offset < lastOffset)
+				++wraps;
+			lastOffset = allocation.offset;
+
+			frame.allocations.push_back(allocation);
+		}
+
+		CHECK(ring.getUsed() <= ringSize);
+		frame.end = ring.getHead();
+		frames.push_back(frame);
+	}
+
+	CHECK(wraps > 10);
+}
+
+// a BC1 mip chain with partial blocks, spread into padded rows the way UploadBatch::writeImage() does
+static void testLinearImageRowsBC1()
+{
+	const int width = 13, height = 10, mipLevels = 4;
+	const VkDeviceSize rowAlignment = 64;
+	const size_t guardSize = 16;
+
+	for (int mipLevel = 0; mipLevel < mipLevels; ++mipLevel) {
+		auto mipWidth = std::max(width >> mipLevel, 1);
+		auto mipHeight = std::max(height >> mipLevel, 1);
+		auto blocksX = uint32_t(mipWidth + 3) / 4;
+		auto blocksY = uint32_t(mipHeight + 3) / 4;
+		auto size = VkDeviceSize(blocksX * blocksY * 8);
+
+		auto rows = getLinearImageRows(VK_FORMAT_BC1_RGB_UNORM_BLOCK, mipHeight, size);
+		CHECK(rows.rowCount == blocksY);
+		CHECK(rows.rowSize == blocksX * 8);
+
+		// drivers may leave out the padding after the last row
+		VkSubresourceLayout layout = {};
+		layout.rowPitch = vulkan::alignSize(rows.rowSize, rowAlignment);
+		layout.size = layout.rowPitch * (rows.rowCount - 1) + rows.rowSize;
+
+		auto packed = vector<uint8_t>(size_t(size));
+		for (size_t i = 0; i < packed.size(); ++i)
+			packed[i] = uint8_t(i * 7 + mipLevel);
+
+		vector<uint8_t> image(size_t(layout.size) + guardSize, 0xcd);
+		spreadLinearImageRows(image.data(), layout, packed.data(), rows);
+
+		for (uint32_t row = 0; row < rows.rowCount; ++row)
+			CHECK(memcmp(image.data() + layout.rowPitch * row, packed.data() + rows.rowSize * row, rows.rowSize) == 0);
+
+		for (size_t i = 0; i < guardSize; ++i)
+			CHECK(image[size_t(layout.size) + i] == 0xcd);
+	}
+}
+
+static void testLinearImageRowsUncompressed()
+{
+	auto rows = getLinearImageRows(VK_FORMAT_R8G8B8A8_UNORM, 10, 13 * 10 * 4);
+	CHECK(rows.rowCount == 10);
+	CHECK(rows.rowSize == 13 * 4);
+}
+
+int main()
+{
+	testRingAllocatorWrap();
+	testRingAllocatorFrames();
+	testLinearImageRowsBC1();
+	testLinearImageRowsUncompressed();
+
+	if (failures == 0)
+		printf("all checks passed\n");
+	else
+		printf("%d checks failed\n", failures);
+
+	return failures;
+}